@@ -0,0 +1,92 @@
+/**
+ * @file blip.h
+ * @brief Band-limited synthesis of a waveform from its steps, and the ring
+ * the resulting samples are streamed into.
+ *
+ * Rather than sampling the APU's output every CPU cycle, the APU reports
+ * only when (and by how much) its output changes. Each such step is added
+ * to the sample buffer as a band-limited impulse, which is spread over the
+ * neighbouring samples by a windowed sinc kernel; summing the buffer as it
+ * is read out turns the impulses back into band-limited steps. The cost is
+ * a few multiply-adds per step, and nothing at all between steps.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu/ucpu.h"
+
+/*
+ * The NTSC CPU's clock rate, in Hz (the master clock's 21.477 MHz over 12)
+ */
+#define CPU_CLOCK_RATE 1789773u
+
+/*
+ * Kernel resolution: impulses land on one of BLIP_PHASES points between
+ * samples, and spread over BLIP_TAPS samples
+ */
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_TAPS 16
+
+/*
+ * Samples that can be pending between reads of the buffer. The APU reads
+ * it out at least every few thousand cycles, i.e. a few hundred samples.
+ */
+#define BLIP_BUF_SZ 2048
+
+/*
+ * A ring of mono 16-bit samples, written by the emulator and read by
+ * whoever plays them (e.g. an audio callback on another thread). The
+ * caller owns the storage. When the ring is full, new samples are dropped
+ * rather than overwriting ones not yet read.
+ */
+typedef struct audio_ring {
+  int16_t *samples;  // `mask + 1` of them, a power of two
+  size_t mask;
+  _Atomic uint64_t head;  // samples written so far
+  _Atomic uint64_t tail;  // samples read so far
+  uint64_t dropped;       // samples lost to a full ring
+} audio_ring_t;
+
+int init_audio_ring(audio_ring_t *ring, int16_t *samples, size_t cap);
+size_t audio_ring_write(audio_ring_t *ring, const int16_t *in, size_t n);
+size_t audio_ring_read(audio_ring_t *ring, int16_t *out, size_t n);
+
+/*
+ * A synthesis buffer. Time is measured in CPU cycles; `base` is the cycle
+ * that `offset` (a sample position, in 32.32 fixed point) corresponds to.
+ */
+typedef struct blip {
+  uint64_t factor;  // samples per CPU cycle, in 32.32 fixed point
+  clk_t base;
+  uint64_t offset;
+  int32_t sum;  // running sum of the buffer read out so far
+  int32_t buf[BLIP_BUF_SZ + BLIP_TAPS];
+} blip_t;
+
+/*
+ * The impulse each kernel phase spreads over BLIP_TAPS samples; every
+ * phase sums to 1 << 15
+ */
+extern const int16_t BLIP_KERNEL[BLIP_PHASES][BLIP_TAPS];
+
+void init_blip(blip_t *blip, uint32_t sample_rate, clk_t now);
+size_t blip_read(blip_t *blip, clk_t now, audio_ring_t *ring);
+
+/**
+ * @brief Adds a step of `delta` to the waveform at CPU cycle `when`, which
+ * must not be before the last blip_read().
+ */
+static inline void blip_add_delta(blip_t *blip, clk_t when, int delta) {
+  uint64_t pos = blip->offset + (when - blip->base) * blip->factor;
+  const int16_t *kernel =
+      BLIP_KERNEL[(pos >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+  int32_t *out = &blip->buf[pos >> 32];
+  for (int i = 0; i < BLIP_TAPS; i++) {
+    out[i] += delta * kernel[i];
+  }
+}
@@ -0,0 +1,790 @@
+/**
+ * @file uapu.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "apu/uapu.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Frame counter sequence step actions
+ */
+#define SEQ_QUARTER 0x01u  // clock envelopes and the linear counter
+#define SEQ_HALF 0x02u     // clock length counters and sweeps
+#define SEQ_IRQ 0x04u      // raise the frame IRQ, unless inhibited
+#define SEQ_END 0x08u      // start the sequence over
+
+#define SEQ_STEPS 5
+
+/*
+ * The output level the loudest possible mix is scaled to
+ */
+#define MIX_SCALE 30000.0f
+
+/*
+ * Pulse periods below this, or sweeping above SWEEP_MAX, mute the channel
+ */
+#define PULSE_MIN_PERIOD 8
+#define SWEEP_MAX 0x7FFu
+
+/*
+ * Triangle periods below this are ultrasonic; rather than play them, the
+ * triangle holds its level
+ */
+#define TRI_MIN_PERIOD 2
+
+/*
+ * Where DMC samples start, and where their addresses wrap around to
+ */
+#define DMC_SAMPLE_BASE 0xC000u
+#define DMC_WRAP_ADDR 0x8000u
+
+typedef struct seq_step {
+  uint16_t at;  // CPU cycles into the sequence
+  byte_t does;  // SEQ_* bits
+} seq_step_t;
+
+/*
+ * The 4-step and 5-step sequences
+ */
+static const seq_step_t SEQUENCES[2][SEQ_STEPS] = {
+    {{7457, SEQ_QUARTER},
+     {14913, SEQ_QUARTER | SEQ_HALF},
+     {22371, SEQ_QUARTER},
+     {29829, SEQ_QUARTER | SEQ_HALF | SEQ_IRQ},
+     {29830, SEQ_END}},
+    {{7457, SEQ_QUARTER},
+     {14913, SEQ_QUARTER | SEQ_HALF},
+     {22371, SEQ_QUARTER},
+     {37281, SEQ_QUARTER | SEQ_HALF},
+     {37282, SEQ_END}}};
+
+/*
+ * What length counters are loaded with, by the top 5 bits of the write
+ */
+static const byte_t LENGTHS[32] = {10,  254, 20, 2,  40, 4,  80, 6,
+                                   160, 8,   60, 10, 14, 12, 26, 14,
+                                   12,  16,  24, 18, 48, 20, 96, 22,
+                                   192, 24,  72, 26, 16, 28, 32, 30};
+
+/*
+ * Pulse waveforms, one bit per sequencer step
+ */
+static const byte_t DUTIES[4] = {0x02, 0x06, 0x1E, 0xF9};
+
+static const byte_t TRI_LEVELS[32] = {15, 14, 13, 12, 11, 10, 9,  8,
+                                      7,  6,  5,  4,  3,  2,  1,  0,
+                                      0,  1,  2,  3,  4,  5,  6,  7,
+                                      8,  9,  10, 11, 12, 13, 14, 15};
+
+/*
+ * Noise and DMC timer periods (NTSC), in CPU cycles
+ */
+static const uint16_t NOISE_PERIODS[16] = {4,   8,   16,  32,  64,  96,
+                                           128, 160, 202, 254, 380, 508,
+                                           762, 1016, 2034, 4068};
+static const uint16_t DMC_PERIODS[16] = {428, 380, 340, 320, 286, 254,
+                                         226, 214, 190, 160, 142, 128,
+                                         106, 84,  72,  54};
+
+/* MIXING */
+
+/**
+ * @brief The mixed output of every channel at its current level, using the
+ * 2A03's (nonlinear) mixer.
+ */
+static int mixed_level(const uapu_t *apu) {
+  float out = 0;
+  int pulses = apu->pulse[0].out + apu->pulse[1].out;
+  if (pulses) {
+    out += 95.88f / (8128.0f / pulses + 100);
+  }
+  float tnd = apu->tri.out / 8227.0f + apu->noise.out / 12241.0f +
+              apu->dmc.out / 22638.0f;
+  if (tnd > 0) {
+    out += 159.79f / (1 / tnd + 100);
+  }
+  return (int)(out * MIX_SCALE);
+}
+
+/**
+ * @brief Hands the mixed output's change, if any, to synthesis, as having
+ * happened on CPU cycle `when`.
+ */
+static void mix(uapu_t *apu, clk_t when) {
+  int amp = mixed_level(apu);
+  if (amp != apu->amp) {
+    blip_add_delta(&apu->blip, when, amp - apu->amp);
+    apu->amp = amp;
+  }
+}
+
+/**
+ * @brief Sets a channel's level.
+ *
+ * @returns whether it changed.
+ */
+static inline bool set_level(byte_t *out, byte_t level) {
+  if (*out == level) {
+    return false;
+  }
+  *out = level;
+  return true;
+}
+
+/* UNITS */
+
+static byte_t envelope_level(const envelope_t *env) {
+  return env->constant ? env->volume : env->decay;
+}
+
+static void clock_envelope(envelope_t *env) {
+  if (env->start) {
+    env->start = false;
+    env->decay = 15;
+    env->divider = env->volume;
+  } else if (env->divider == 0) {
+    env->divider = env->volume;
+    if (env->decay > 0) {
+      env->decay--;
+    } else if (env->loop) {
+      env->decay = 15;
+    }
+  } else {
+    env->divider--;
+  }
+}
+
+static void clock_length(byte_t *length, bool halt) {
+  if (*length > 0 && !halt) {
+    (*length)--;
+  }
+}
+
+/**
+ * @brief The period pulse channel `which`'s sweep is heading for. Pulse 1
+ * negates in ones' complement, pulse 2 in two's.
+ */
+static int sweep_target(const pulse_t *p, int which) {
+  int change = p->period >> p->sweep_shift;
+  if (!p->sweep_negate) {
+    return p->period + change;
+  }
+  return p->period - change - (which == 0);
+}
+
+/**
+ * @brief Whether pulse channel `which` is silenced whatever its sequencer
+ * does. The sweep mutes it even while disabled.
+ */
+static bool pulse_muted(const pulse_t *p, int which) {
+  return p->length == 0 || p->period < PULSE_MIN_PERIOD ||
+         sweep_target(p, which) > (int)SWEEP_MAX ||
+         envelope_level(&p->env) == 0;
+}
+
+static byte_t pulse_level(const pulse_t *p, int which) {
+  if (pulse_muted(p, which) || !((DUTIES[p->duty] >> p->step) & 1)) {
+    return 0;
+  }
+  return envelope_level(&p->env);
+}
+
+static void clock_sweep(pulse_t *p, int which) {
+  int target = sweep_target(p, which);
+  if (p->sweep_divider == 0 && p->sweep_on && p->sweep_shift > 0 &&
+      p->period >= PULSE_MIN_PERIOD && target <= (int)SWEEP_MAX) {
+    p->period = target;
+  }
+  if (p->sweep_divider == 0 || p->sweep_reload) {
+    p->sweep_divider = p->sweep_period;
+    p->sweep_reload = false;
+  } else {
+    p->sweep_divider--;
+  }
+}
+
+static bool tri_running(const triangle_t *t) {
+  return t->length > 0 && t->linear > 0 && t->period >= TRI_MIN_PERIOD;
+}
+
+static bool noise_muted(const noise_t *n) {
+  return n->length == 0 || envelope_level(&n->env) == 0;
+}
+
+static byte_t noise_level(const noise_t *n) {
+  return noise_muted(n) || (n->lfsr & 1) ? 0 : envelope_level(&n->env);
+}
+
+/**
+ * @brief Fills the DMC's sample buffer from memory, if it is empty and the
+ * sample isn't over. The CPU stall this causes is not emulated.
+ */
+static void dmc_fetch(uapu_t *apu) {
+  dmc_t *d = &apu->dmc;
+  if (d->buffered || d->remaining == 0) {
+    return;
+  }
+  d->buffer = get_byte(apu->buslink, d->addr);
+  d->buffered = true;
+  d->addr = d->addr == 0xFFFF ? DMC_WRAP_ADDR : d->addr + 1;
+  if (--d->remaining == 0) {
+    if (d->loop) {
+      d->addr = d->sample_addr;
+      d->remaining = d->sample_len;
+    } else if (d->irq_on) {
+      apu->buslink.bus->irq |= IRQ_APU_DMC;
+    }
+  }
+}
+
+/**
+ * @brief Moves the DMC on to its next byte, which is due now: the one in
+ * the sample buffer, or silence if there is none.
+ */
+static void dmc_reload(uapu_t *apu) {
+  dmc_t *d = &apu->dmc;
+  d->bits = 8;
+  d->silent = !d->buffered;
+  if (d->buffered) {
+    d->shift = d->buffer;
+    d->buffered = false;
+    dmc_fetch(apu);
+  }
+}
+
+/* TIMERS */
+
+/**
+ * @brief Moves a timer that expires every `period` cycles on past `end`.
+ *
+ * @returns how many times it expired on the way.
+ */
+static uint64_t skip_timer(clk_t *next, clk_t period, clk_t end) {
+  if (*next >= end) {
+    return 0;
+  }
+  uint64_t n = (end - *next + period - 1) / period;
+  *next += n * period;
+  return n;
+}
+
+/*
+ * Each of these runs a channel's timer expiry, returning whether the
+ * channel's level changed.
+ */
+
+static bool step_pulse(uapu_t *apu, int which) {
+  pulse_t *p = &apu->pulse[which];
+  p->next += (p->period + 1) * 2;
+  p->step = (p->step - 1) & 7;
+  return set_level(&p->out, pulse_level(p, which));
+}
+
+static bool step_tri(uapu_t *apu) {
+  triangle_t *t = &apu->tri;
+  t->next += t->period + 1;
+  t->step = (t->step + 1) % 32;
+  return set_level(&t->out, TRI_LEVELS[t->step]);
+}
+
+static bool step_noise(uapu_t *apu) {
+  noise_t *n = &apu->noise;
+  n->next += NOISE_PERIODS[n->rate];
+  int tap = n->short_mode ? 6 : 1;
+  uint16_t feedback = (n->lfsr ^ (n->lfsr >> tap)) & 1;
+  n->lfsr = (n->lfsr >> 1) | (feedback << 14);
+  return set_level(&n->out, noise_level(n));
+}
+
+static bool step_dmc(uapu_t *apu) {
+  dmc_t *d = &apu->dmc;
+  byte_t out = d->out;
+  d->next += DMC_PERIODS[d->rate];
+  if (!d->silent) {
+    if (d->shift & 1) {
+      d->out += d->out <= 125 ? 2 : 0;
+    } else {
+      d->out -= d->out >= 2 ? 2 : 0;
+    }
+  }
+  d->shift >>= 1;
+  if (--d->bits == 0) {
+    dmc_reload(apu);
+  }
+  return d->out != out;
+}
+
+/**
+ * @brief Runs every channel's timers through the expiries before cycle
+ * `end`, in order, sending the mix to synthesis whenever it changes.
+ *
+ * A channel that can't change its level before `end` (e.g. a muted pulse,
+ * or a DMC with nothing to play) has its timer skipped ahead in one go.
+ * Only a register write or the frame counter can bring it back, and both
+ * end the run.
+ */
+static void run_channels(uapu_t *apu, clk_t end) {
+  for (int i = 0; i < 2; i++) {
+    pulse_t *p = &apu->pulse[i];
+    if (pulse_muted(p, i)) {
+      p->step -= skip_timer(&p->next, (p->period + 1) * 2, end);
+      p->step &= 7;
+    }
+  }
+  if (!tri_running(&apu->tri)) {
+    skip_timer(&apu->tri.next, apu->tri.period + 1, end);
+  }
+  if (noise_muted(&apu->noise)) {
+    // nobody can tell which part of the sequence noise is on
+    skip_timer(&apu->noise.next, NOISE_PERIODS[apu->noise.rate], end);
+  }
+  dmc_t *d = &apu->dmc;
+  if (d->silent && !d->buffered) {
+    uint64_t n = skip_timer(&d->next, DMC_PERIODS[d->rate], end);
+    d->bits = (d->bits + 7 - n % 8) % 8 + 1;
+  }
+
+  for (;;) {
+    clk_t when = apu->pulse[0].next;
+    when = apu->pulse[1].next < when ? apu->pulse[1].next : when;
+    when = apu->tri.next < when ? apu->tri.next : when;
+    when = apu->noise.next < when ? apu->noise.next : when;
+    when = d->next < when ? d->next : when;
+    if (when >= end) {
+      return;
+    }
+
+    bool changed = false;
+    for (int i = 0; i < 2; i++) {
+      if (apu->pulse[i].next == when) {
+        changed |= step_pulse(apu, i);
+      }
+    }
+    if (apu->tri.next == when) {
+      changed |= step_tri(apu);
+    }
+    if (apu->noise.next == when) {
+      changed |= step_noise(apu);
+    }
+    if (d->next == when) {
+      changed |= step_dmc(apu);
+    }
+    if (changed) {
+      mix(apu, when);
+    }
+  }
+}
+
+/**
+ * @brief Runs the DMC's timer through the expiries before cycle `end`
+ * without playing anything, for an APU with synthesis off. Only the bytes
+ * it fetches (and so when its IRQ fires) matter, so it goes from one
+ * byte to the next rather than one bit to the next.
+ */
+static void count_dmc(uapu_t *apu, clk_t end) {
+  dmc_t *d = &apu->dmc;
+  uint64_t n = skip_timer(&d->next, DMC_PERIODS[d->rate], end);
+  // once it falls silent with nothing buffered, it stays that way
+  while (n >= d->bits && (d->buffered || !d->silent)) {
+    n -= d->bits;
+    dmc_reload(apu);
+  }
+  d->bits = (d->bits + 7 - n % 8) % 8 + 1;
+}
+
+/**
+ * @brief Brings every channel's level up to date after its settings have
+ * changed (by a register write or the frame counter) at `apu->clock`. The
+ * triangle and the DMC only ever change level on their own timers.
+ */
+static void refresh(uapu_t *apu) {
+  if (!apu->ring) {
+    return;
+  }
+  bool changed = false;
+  for (int i = 0; i < 2; i++) {
+    changed |= set_level(&apu->pulse[i].out, pulse_level(&apu->pulse[i], i));
+  }
+  changed |= set_level(&apu->noise.out, noise_level(&apu->noise));
+  if (changed) {
+    mix(apu, apu->clock);
+  }
+}
+
+/* FRAME COUNTER */
+
+static void quarter_frame(uapu_t *apu) {
+  clock_envelope(&apu->pulse[0].env);
+  clock_envelope(&apu->pulse[1].env);
+  clock_envelope(&apu->noise.env);
+
+  triangle_t *t = &apu->tri;
+  if (t->linear_reload) {
+    t->linear = t->linear_period;
+  } else if (t->linear > 0) {
+    t->linear--;
+  }
+  if (!t->control) {
+    t->linear_reload = false;
+  }
+}
+
+static void half_frame(uapu_t *apu) {
+  for (int i = 0; i < 2; i++) {
+    clock_length(&apu->pulse[i].length, apu->pulse[i].env.loop);
+    clock_sweep(&apu->pulse[i], i);
+  }
+  clock_length(&apu->tri.length, apu->tri.control);
+  clock_length(&apu->noise.length, apu->noise.env.loop);
+}
+
+/**
+ * @brief Runs the frame counter's next step, which is due now.
+ */
+static void run_frame_step(uapu_t *apu) {
+  const seq_step_t *step = &SEQUENCES[apu->five_step][apu->frame_step];
+  if (step->does & SEQ_QUARTER) {
+    quarter_frame(apu);
+  }
+  if (step->does & SEQ_HALF) {
+    half_frame(apu);
+  }
+  if ((step->does & SEQ_IRQ) && !apu->irq_inhibit) {
+    apu->buslink.bus->irq |= IRQ_APU_FRAME;
+  }
+  if (step->does & SEQ_END) {
+    apu->frame_start += step->at;
+    apu->frame_step = 0;
+  } else {
+    apu->frame_step++;
+  }
+  refresh(apu);
+}
+
+/**
+ * @brief The cycle the frame counter's next step is due on.
+ */
+static clk_t frame_step_due(const uapu_t *apu) {
+  return apu->frame_start + SEQUENCES[apu->five_step][apu->frame_step].at;
+}
+
+/* REGISTERS */
+
+/**
+ * @brief Reads APU_STAT, which acknowledges the frame IRQ. The APU's other
+ * registers are write-only.
+ */
+byte_t apu_reg_read(uapu_t *apu, uaddr_t which) {
+  bus_t *bus = apu->buslink.bus;
+  if (which != APU_STAT_ADDR) {
+    return which >> 8;
+  }
+  apu_sync(apu);
+
+  byte_t stat = (apu->pulse[0].length > 0 ? CHAN_PULSE1 : 0) |
+                (apu->pulse[1].length > 0 ? CHAN_PULSE2 : 0) |
+                (apu->tri.length > 0 ? CHAN_TRI : 0) |
+                (apu->noise.length > 0 ? CHAN_NOISE : 0) |
+                (apu->dmc.remaining > 0 ? CHAN_DMC : 0) |
+                ((bus->irq & IRQ_APU_FRAME) ? STAT_FRAME_IRQ : 0) |
+                ((bus->irq & IRQ_APU_DMC) ? STAT_DMC_IRQ : 0);
+  bus->irq &= ~IRQ_APU_FRAME;
+  return stat;
+}
+
+static void envelope_write(envelope_t *env, byte_t what) {
+  env->loop = what & 0x20;
+  env->constant = what & 0x10;
+  env->volume = what & 0x0F;
+}
+
+static void pulse_write(uapu_t *apu, int which, uaddr_t reg, byte_t what) {
+  pulse_t *p = &apu->pulse[which];
+  switch (reg) {
+    case 0:
+      p->duty = what >> 6;
+      envelope_write(&p->env, what);
+      break;
+    case 1:
+      p->sweep_on = what & 0x80;
+      p->sweep_period = (what >> 4) & 0x07;
+      p->sweep_negate = what & 0x08;
+      p->sweep_shift = what & 0x07;
+      p->sweep_reload = true;
+      break;
+    case 2:
+      p->period = (p->period & 0x700) | what;
+      break;
+    case 3:
+      p->period = (p->period & 0xFF) | ((what & 0x07) << 8);
+      if (apu->enabled & (CHAN_PULSE1 << which)) {
+        p->length = LENGTHS[what >> 3];
+      }
+      p->step = 0;
+      p->env.start = true;
+      break;
+  }
+}
+
+static void tri_write(uapu_t *apu, uaddr_t reg, byte_t what) {
+  triangle_t *t = &apu->tri;
+  switch (reg) {
+    case 0:
+      t->control = what & 0x80;
+      t->linear_period = what & 0x7F;
+      break;
+    case 2:
+      t->period = (t->period & 0x700) | what;
+      break;
+    case 3:
+      t->period = (t->period & 0xFF) | ((what & 0x07) << 8);
+      if (apu->enabled & CHAN_TRI) {
+        t->length = LENGTHS[what >> 3];
+      }
+      t->linear_reload = true;
+      break;
+  }
+}
+
+static void noise_write(uapu_t *apu, uaddr_t reg, byte_t what) {
+  noise_t *n = &apu->noise;
+  switch (reg) {
+    case 0:
+      envelope_write(&n->env, what);
+      break;
+    case 2:
+      n->short_mode = what & 0x80;
+      n->rate = what & 0x0F;
+      break;
+    case 3:
+      if (apu->enabled & CHAN_NOISE) {
+        n->length = LENGTHS[what >> 3];
+      }
+      n->env.start = true;
+      break;
+  }
+}
+
+static void dmc_write(uapu_t *apu, uaddr_t reg, byte_t what) {
+  dmc_t *d = &apu->dmc;
+  switch (reg) {
+    case 0:
+      d->irq_on = what & 0x80;
+      d->loop = what & 0x40;
+      d->rate = what & 0x0F;
+      if (!d->irq_on) {
+        apu->buslink.bus->irq &= ~IRQ_APU_DMC;
+      }
+      break;
+    case 1:
+      if (set_level(&d->out, what & 0x7F) && apu->ring) {
+        mix(apu, apu->clock);
+      }
+      break;
+    case 2:
+      d->sample_addr = DMC_SAMPLE_BASE + what * 64;
+      break;
+    case 3:
+      d->sample_len = what * 16 + 1;
+      break;
+  }
+}
+
+/**
+ * @brief Writes one of the APU's registers, $4000-$4013, APU_STAT or
+ * APU_FRAME.
+ */
+void apu_reg_write(uapu_t *apu, uaddr_t which, byte_t what) {
+  bus_t *bus = apu->buslink.bus;
+  apu_sync(apu);
+
+  if (which < APU_TRI_ADDR) {
+    pulse_write(apu, (which - APU_PULSE1_ADDR) / 4, which % 4, what);
+  } else if (which < APU_NOISE_ADDR) {
+    tri_write(apu, which % 4, what);
+  } else if (which < APU_DMC_ADDR) {
+    noise_write(apu, which % 4, what);
+  } else if (which <= APU_DMC_END_ADDR) {
+    dmc_write(apu, which % 4, what);
+  } else if (which == APU_STAT_ADDR) {
+    apu->enabled = what & (CHAN_PULSE1 | CHAN_PULSE2 | CHAN_TRI | CHAN_NOISE);
+    for (int i = 0; i < 2; i++) {
+      if (!(what & (CHAN_PULSE1 << i))) {
+        apu->pulse[i].length = 0;
+      }
+    }
+    if (!(what & CHAN_TRI)) {
+      apu->tri.length = 0;
+    }
+    if (!(what & CHAN_NOISE)) {
+      apu->noise.length = 0;
+    }
+    dmc_t *d = &apu->dmc;
+    if (!(what & CHAN_DMC)) {
+      d->remaining = 0;
+    } else if (d->remaining == 0) {
+      d->addr = d->sample_addr;
+      d->remaining = d->sample_len;
+      dmc_fetch(apu);
+    }
+    bus->irq &= ~IRQ_APU_DMC;
+  } else if (which == APU_FRAME_ADDR) {
+    // the sequence restarts on the write itself, not 3-4 cycles after
+    apu->five_step = what & FRAME_FIVE_STEP;
+    apu->irq_inhibit = what & FRAME_IRQ_INHIBIT;
+    if (apu->irq_inhibit) {
+      bus->irq &= ~IRQ_APU_FRAME;
+    }
+    apu->frame_start = apu->clock;
+    apu->frame_step = 0;
+    if (apu->five_step) {
+      quarter_frame(apu);
+      half_frame(apu);
+    }
+  }
+  refresh(apu);
+
+  // the write may have brought an IRQ forward, e.g. by starting a short
+  // DMC sample, to before the CPU was next going to stop
+  if (bus->cpu) {
+    cpu_stop_by(bus->cpu, apu_next_event(apu));
+  }
+}
+
+/* SETUP */
+
+/**
+ * @brief Puts the APU in its power-up state, with synthesis off until
+ * apu_set_output() gives it somewhere to send samples.
+ */
+void init_apu(uapu_t *apu) {
+  memset(apu, 0, offsetof(uapu_t, buslink));
+  apu->noise.lfsr = 1;
+  apu->dmc.sample_addr = DMC_SAMPLE_BASE;
+  apu->dmc.sample_len = 1;
+  apu->dmc.bits = 8;
+  apu->dmc.silent = true;
+
+  apu->buslink = (buslink_t){DEV_APU, NULL};
+  apu_set_output(apu, NULL, APU_RATE_48K);
+}
+
+/**
+ * @brief Links the APU to the bus. Its registers are reached through the
+ * bus's I/O page, which it shares with OAM DMA and the controllers.
+ */
+void connect_apu(uapu_t *apu, bus_t *bus) {
+  link_device(&apu->buslink, bus);
+  bus->apu = apu;
+}
+
+/**
+ * @brief Sends the APU's samples to `ring` at `sample_rate` samples per
+ * second, e.g. APU_RATE_48K, or turns synthesis off if `ring` is NULL.
+ * Samples not yet read out of synthesis are dropped.
+ *
+ * @return 0, or -1 (leaving the output as it was) if `sample_rate` is
+ * above APU_RATE_MAX.
+ */
+int apu_set_output(uapu_t *apu, audio_ring_t *ring, uint32_t sample_rate) {
+  if (sample_rate > APU_RATE_MAX) {
+    return -1;
+  }
+  apu->ring = ring;
+  apu->sample_rate = sample_rate;
+  if (!ring) {
+    return 0;
+  }
+
+  // with synthesis off, the channels' timers stood still and their levels
+  // went stale; pick them up from here
+  for (int i = 0; i < 2; i++) {
+    pulse_t *p = &apu->pulse[i];
+    skip_timer(&p->next, (p->period + 1) * 2, apu->clock);
+    p->out = pulse_level(p, i);
+  }
+  skip_timer(&apu->tri.next, apu->tri.period + 1, apu->clock);
+  apu->tri.out = TRI_LEVELS[apu->tri.step];
+  skip_timer(&apu->noise.next, NOISE_PERIODS[apu->noise.rate], apu->clock);
+  apu->noise.out = noise_level(&apu->noise);
+  apu->amp = mixed_level(apu);
+  init_blip(&apu->blip, sample_rate, apu->clock);
+  return 0;
+}
+
+/* CATCHING UP */
+
+/**
+ * @brief Runs the channels up to cycle `end`, which must not be past the
+ * frame counter's next step, and sends the samples completed by then to
+ * the ring. With synthesis off only the DMC runs.
+ */
+static void run_until(uapu_t *apu, clk_t end) {
+  if (!apu->ring) {
+    count_dmc(apu, end);
+    apu->clock = end;
+    return;
+  }
+  run_channels(apu, end);
+  apu->clock = end;
+  blip_read(&apu->blip, end, apu->ring);
+}
+
+/**
+ * @brief Runs the APU until it reaches CPU cycle `cycle` (counting from
+ * init_apu()), and sends every sample completed by then to the ring. Does
+ * nothing if it is already there.
+ */
+void apu_catch_up(uapu_t *apu, clk_t cycle) {
+  if (apu->clock >= cycle) {
+    return;
+  }
+  // catching up to one cycle past a frame counter step is what runs it
+  for (clk_t due; (due = frame_step_due(apu)) < cycle;) {
+    run_until(apu, due);
+    run_frame_step(apu);
+  }
+  run_until(apu, cycle);
+}
+
+/**
+ * @brief Catches the APU up to the CPU's access in progress, so that an
+ * access that reads or changes the APU's state lands on the right cycle.
+ */
+void apu_sync(uapu_t *apu) {
+  ucpu_t *cpu = apu->buslink.bus->cpu;
+  if (cpu) {
+    apu_catch_up(apu, access_clock(cpu));
+  }
+}
+
+/**
+ * @brief The CPU cycle by which the APU must next be caught up, even if
+ * the CPU leaves it alone: when it next raises an IRQ, either the frame
+ * counter's or the DMC's at the end of a sample. Everything else it does
+ * can wait for the next catch-up.
+ */
+clk_t apu_next_event(const uapu_t *apu) {
+  clk_t due = UINT64_MAX;
+
+  if (!apu->five_step && !apu->irq_inhibit) {
+    const seq_step_t *seq = SEQUENCES[0];
+    due = apu->frame_start + seq[3].at + 1;
+    if (apu->frame_step > 3) {
+      due += seq[4].at;
+    }
+  }
+
+  // the last byte is fetched when the one before it starts playing
+  const dmc_t *d = &apu->dmc;
+  if (d->irq_on && !d->loop && d->remaining > 0) {
+    clk_t last = d->next + ((d->bits - 1) + (d->remaining - 1) * 8) *
+                               (clk_t)DMC_PERIODS[d->rate];
+    due = last + 1 < due ? last + 1 : due;
+  }
+  return due;
+}
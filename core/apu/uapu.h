@@ -0,0 +1,185 @@
+/**
+ * @file uapu.h
+ * @brief The audio processing unit: two pulse channels, a triangle, noise
+ * and the delta modulation channel (DMC), plus the frame counter that
+ * clocks their envelopes, sweeps and length counters.
+ *
+ * Like the PPU, the APU runs behind the CPU and is only caught up to it
+ * (see apu_catch_up()) when the CPU touches an APU register, or when the
+ * APU is due to raise an IRQ (see apu_next_event()). Catching up runs
+ * from one timer expiry to the next rather than cycle by cycle, and only
+ * a change in the mixed output reaches the synthesis buffer (see
+ * apu/blip.h), which resamples it into the ring of the caller's choosing.
+ *
+ * An APU with no ring has synthesis off. It keeps up only what the CPU can
+ * observe: the length counters (through APU_STAT), the frame counter and
+ * the DMC's progress through its sample, and with them both IRQs. The
+ * other channels' timers stand still and nothing is mixed, so it costs
+ * little more than having no APU at all. This is how it powers up.
+ *
+ * See spec here: https://www.nesdev.org/wiki/APU
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "apu/blip.h"
+#include "cpu/ucpu.h"
+#include "memory/bus.h"
+#include "memory/umem.h"
+
+#define APU_PULSE1_ADDR 0x4000u
+#define APU_PULSE2_ADDR 0x4004u
+#define APU_TRI_ADDR 0x4008u
+#define APU_NOISE_ADDR 0x400Cu
+#define APU_DMC_ADDR 0x4010u
+#define APU_DMC_END_ADDR 0x4013u
+#define APU_STAT_ADDR 0x4015u
+#define APU_FRAME_ADDR 0x4017u
+
+/*
+ * APU_STAT bits: which channels are enabled when written, which are still
+ * playing (and which IRQs are pending) when read
+ */
+#define CHAN_PULSE1 0x01u
+#define CHAN_PULSE2 0x02u
+#define CHAN_TRI 0x04u
+#define CHAN_NOISE 0x08u
+#define CHAN_DMC 0x10u
+#define STAT_FRAME_IRQ 0x40u
+#define STAT_DMC_IRQ 0x80u
+
+/*
+ * APU_FRAME bits
+ */
+#define FRAME_IRQ_INHIBIT 0x40u
+#define FRAME_FIVE_STEP 0x80u
+
+/*
+ * Sample rates that sound good; any rate up to APU_RATE_MAX works
+ */
+#define APU_RATE_44K 44100u
+#define APU_RATE_48K 48000u
+
+/*
+ * The synthesis buffer is read out at every frame counter step, so it must
+ * hold all the samples between the two furthest apart (in the 5-step
+ * sequence, 14910 cycles apart). That caps the sample rate at about 245 kHz.
+ */
+#define APU_MAX_SPAN 14910u
+#define APU_RATE_MAX \
+  ((uint32_t)((BLIP_BUF_SZ - 1) * (uint64_t)CPU_CLOCK_RATE / APU_MAX_SPAN))
+
+/*
+ * Each channel's timer is kept as the CPU cycle it next expires on,
+ * rather than as a count, so that nothing need run between expiries.
+ */
+
+typedef struct envelope {
+  bool start;
+  bool loop;      // also halts the length counter
+  bool constant;  // play `volume` as is, rather than the decay level
+  byte_t volume;  // the constant volume, or the decay's period
+  byte_t divider;
+  byte_t decay;
+} envelope_t;
+
+typedef struct pulse {
+  clk_t next;
+  uint16_t period;  // in APU cycles (two CPU cycles), less one
+  byte_t duty;
+  byte_t step;  // sequencer position, counting down
+  byte_t length;
+  envelope_t env;
+  bool sweep_on;
+  bool sweep_negate;
+  bool sweep_reload;
+  byte_t sweep_period;
+  byte_t sweep_shift;
+  byte_t sweep_divider;
+  byte_t out;  // the level it is currently playing
+} pulse_t;
+
+typedef struct triangle {
+  clk_t next;
+  uint16_t period;  // in CPU cycles, less one
+  byte_t step;      // position in the 32-step ramp
+  byte_t length;
+  bool control;  // halts the length counter, and keeps reloading linear
+  bool linear_reload;
+  byte_t linear_period;
+  byte_t linear;
+  byte_t out;
+} triangle_t;
+
+typedef struct noise {
+  clk_t next;
+  byte_t rate;  // index into the period table
+  bool short_mode;
+  uint16_t lfsr;
+  byte_t length;
+  envelope_t env;
+  byte_t out;
+} noise_t;
+
+typedef struct dmc {
+  clk_t next;
+  byte_t rate;  // index into the period table
+  bool irq_on;
+  bool loop;
+  uaddr_t sample_addr;  // where the sample starts
+  uint16_t sample_len;  // its length in bytes
+  uaddr_t addr;         // next byte to fetch
+  uint16_t remaining;   // bytes left to fetch
+  byte_t buffer;        // the fetched byte waiting to be played
+  bool buffered;
+  byte_t shift;  // the byte being played
+  byte_t bits;   // bits left in it, 1-8
+  bool silent;   // no byte was there to be played
+  byte_t out;    // the 7-bit output level
+} dmc_t;
+
+typedef struct uapu {
+  pulse_t pulse[2];
+  triangle_t tri;
+  noise_t noise;
+  dmc_t dmc;
+  byte_t enabled;  // CHAN_* bits last written to APU_STAT
+
+  /* FRAME COUNTER */
+
+  bool five_step;
+  bool irq_inhibit;
+  byte_t frame_step;  // next step of the sequence to run
+  clk_t frame_start;  // the cycle the current sequence started on
+
+  /* TIMING */
+
+  clk_t clock;  // CPU cycles the APU has been run for since init_apu()
+  int amp;      // the mixed output level last sent to synthesis
+
+  /* LINKS */
+
+  // not saved (see nes/savestate.h)
+  buslink_t buslink;
+  audio_ring_t *ring;    // where samples go; NULL for synthesis off
+  uint32_t sample_rate;  // of the samples that go there
+
+  /* DERIVED STATE */
+
+  blip_t blip;  // output changes not yet resampled
+
+} uapu_t;
+
+void init_apu(uapu_t *apu);
+void connect_apu(uapu_t *apu, bus_t *bus);
+int apu_set_output(uapu_t *apu, audio_ring_t *ring, uint32_t sample_rate);
+
+byte_t apu_reg_read(uapu_t *apu, uaddr_t which);
+void apu_reg_write(uapu_t *apu, uaddr_t which, byte_t what);
+
+void apu_catch_up(uapu_t *apu, clk_t cycle);
+void apu_sync(uapu_t *apu);
+clk_t apu_next_event(const uapu_t *apu);
@@ -0,0 +1,310 @@
+/**
+ * @file
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "cartridge/cartridge.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define INES_MAGIC "NES\x1A"
+
+/*
+ * Header flags we care about
+ */
+#define FLAG6_VERTICAL 0x01u
+#define FLAG6_BATTERY 0x02u
+#define FLAG6_TRAINER 0x04u
+#define FLAG6_FOUR_SCREEN 0x08u
+#define FLAG7_NES2_MASK 0x0Cu
+#define FLAG7_NES2 0x08u
+
+static const char *CART_ERR_DESCRIPTIONS[] = {
+    [CART_OK] = "no error",
+    [CART_ERR_OPEN] = "could not open or map the image",
+    [CART_ERR_FORMAT] = "not an iNES or NES 2.0 image",
+    [CART_ERR_SIZE] = "image size does not match its header",
+    [CART_ERR_MAPPER] = "unsupported mapper"};
+
+/**
+ * @brief Decodes a NES 2.0 ROM size field.
+ *
+ * Normally the size is a 12-bit count of `unit`s. If the most significant
+ * nibble is $F, the size is instead 2^E * (2M + 1) bytes, with E and M
+ * packed into the least significant byte.
+ */
+static size_t nes2_rom_size(byte_t lsb, byte_t msb, size_t unit) {
+  if (msb == 0xF) {
+    size_t exponent = lsb >> 2;
+    size_t multiplier = (lsb & 0x3) * 2 + 1;
+    if (exponent >= sizeof(size_t) * 8 - 2) {
+      return SIZE_MAX;  // can't possibly fit; let validation reject it
+    }
+    return ((size_t)1 << exponent) * multiplier;
+  }
+  return (((size_t)msb << 8) | lsb) * unit;
+}
+
+/**
+ * @brief Decodes a NES 2.0 RAM size field (a shift count, 0 meaning none).
+ */
+static size_t nes2_ram_size(byte_t shift) {
+  return shift ? (size_t)64 << shift : 0;
+}
+
+/**
+ * @brief Fills in everything the header and image size tell us.
+ *
+ * Banks inside the image are pointed at in place. RAM banks only get their
+ * sizes here; map_ram() allocates them.
+ */
+static cart_err_t parse_header(cartridge_t *cart) {
+  byte_t *image = cart->_data_ptr;
+  size_t image_sz = cart->cartridge_sz;
+  if (memcmp(image, INES_MAGIC, 4) != 0) {
+    return CART_ERR_FORMAT;
+  }
+
+  byte_t flags6 = image[6];
+  byte_t flags7 = image[7];
+  unsigned mapper = (flags6 >> 4) | (flags7 & 0xF0);
+  size_t prg_sz, chr_sz;
+
+  cart->nes2 = (flags7 & FLAG7_NES2_MASK) == FLAG7_NES2;
+  if (cart->nes2) {
+    mapper |= (image[8] & 0x0F) << 8;
+    cart->submapper = image[8] >> 4;
+    prg_sz = nes2_rom_size(image[4], image[9] & 0x0F, PRG_ROM_UNIT);
+    chr_sz = nes2_rom_size(image[5], image[9] >> 4, CHR_ROM_UNIT);
+    // volatile and battery-backed RAM share one bank
+    cart->prg_ram.size =
+        nes2_ram_size(image[10] & 0x0F) + nes2_ram_size(image[10] >> 4);
+    cart->chr.size =
+        nes2_ram_size(image[11] & 0x0F) + nes2_ram_size(image[11] >> 4);
+  } else {
+    // old dumps often have junk (e.g. "DiskDude!") in bytes 7-15, which
+    // garbles the mapper's high nibble
+    if (image[12] | image[13] | image[14] | image[15]) {
+      mapper &= 0x0F;
+    }
+    prg_sz = image[4] * PRG_ROM_UNIT;
+    chr_sz = image[5] * CHR_ROM_UNIT;
+    cart->prg_ram.size = (image[8] ? image[8] : 1) * DEFAULT_PRG_RAM_SZ;
+    cart->chr.size = 0;
+  }
+  cart->mapper = mapper;
+  cart->battery = flags6 & FLAG6_BATTERY;
+
+  if (flags6 & FLAG6_FOUR_SCREEN) {
+    cart->mirroring = MIRROR_FOUR_SCREEN;
+  } else {
+    cart->mirroring =
+        (flags6 & FLAG6_VERTICAL) ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+  }
+
+  // everything after the header: [trainer] PRG-ROM CHR-ROM [misc. ROMs]
+  size_t off = INES_HEADER_SZ;
+  if (flags6 & FLAG6_TRAINER) {
+    if (image_sz - off < INES_TRAINER_SZ) {
+      return CART_ERR_SIZE;
+    }
+    cart->trainer = (bank_t){image + off, INES_TRAINER_SZ};
+    off += INES_TRAINER_SZ;
+  }
+
+  if (prg_sz == 0 || image_sz - off < prg_sz) {
+    return CART_ERR_SIZE;
+  }
+  cart->prg_rom = (bank_t){image + off, prg_sz};
+  off += prg_sz;
+
+  if (image_sz - off < chr_sz) {
+    return CART_ERR_SIZE;
+  }
+  if (chr_sz > 0) {
+    cart->chr = (bank_t){image + off, chr_sz};
+    cart->chr_ram = false;
+  } else {
+    // no CHR-ROM means the board carries CHR-RAM instead
+    cart->chr_ram = true;
+    if (cart->chr.size == 0) {
+      cart->chr.size = DEFAULT_CHR_RAM_SZ;
+    }
+  }
+
+  return CART_OK;
+}
+
+/**
+ * @brief Maps the save file at `save` as PRG-RAM, creating or growing it
+ * as needed, so battery-backed saves persist without ever being copied.
+ *
+ * @returns NULL if the file could not be mapped.
+ */
+static byte_t *map_save_file(const char *save, size_t size) {
+  int savefd = open(save, O_RDWR | O_CREAT, 0644);
+  if (savefd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(savefd, &st) != 0 ||
+      ((size_t)st.st_size < size && ftruncate(savefd, size) != 0)) {
+    close(savefd);
+    return NULL;
+  }
+
+  byte_t *where =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, savefd, 0);
+  close(savefd);
+  return where == MAP_FAILED ? NULL : where;
+}
+
+/**
+ * @brief Allocates CHR-RAM and PRG-RAM, and loads the trainer into the
+ * latter.
+ */
+static cart_err_t map_ram(cartridge_t *cart, const char *save) {
+  if (cart->chr_ram) {
+    cart->chr.data = alloc_ram(cart->chr.size);
+    if (cart->chr.data == MAP_FAILED) {
+      cart->chr.data = NULL;
+      return CART_ERR_OPEN;
+    }
+  }
+
+  // the trainer lives in PRG-RAM, so there had better be some
+  size_t trainer_off = TRAINER_START - PRG_RAM_START;
+  if (cart->trainer.size > 0 &&
+      cart->prg_ram.size < trainer_off + INES_TRAINER_SZ) {
+    cart->prg_ram.size = DEFAULT_PRG_RAM_SZ;
+  }
+
+  if (cart->prg_ram.size > 0) {
+    byte_t *sram = NULL;
+    if (cart->battery && save != NULL) {
+      sram = map_save_file(save, cart->prg_ram.size);
+    }
+    cart->prg_ram.data = sram ? sram : alloc_ram(cart->prg_ram.size);
+    if (cart->prg_ram.data == MAP_FAILED) {
+      cart->prg_ram.data = NULL;
+      return CART_ERR_OPEN;
+    }
+  }
+
+  if (cart->trainer.size > 0) {
+    // the one copy we can't avoid: games expect to be able to write here
+    memcpy(cart->prg_ram.data + trainer_off, cart->trainer.data,
+           cart->trainer.size);
+  }
+
+  return CART_OK;
+}
+
+/**
+ * @brief Mounts the iNES or NES 2.0 image at `locale`.
+ *
+ * The image is mapped read-only and never copied; mounting only parses the
+ * header. If the cartridge has battery-backed PRG-RAM and `save` is not
+ * NULL, PRG-RAM is backed by the file at `save` so it persists across runs.
+ * Otherwise PRG-RAM is volatile.
+ *
+ * @param[out] cart Where the cartridge should be written.
+ *
+ * @returns CART_OK, or why the image could not be mounted. On failure
+ * nothing needs to be unmounted.
+ */
+cart_err_t mount(cartridge_t *cart, const char *locale, const char *save) {
+  memset(cart, 0, sizeof(*cart));
+
+  int romfd = open(locale, O_RDONLY);
+  if (romfd < 0) {
+    return CART_ERR_OPEN;
+  }
+
+  struct stat st;
+  if (fstat(romfd, &st) != 0) {
+    close(romfd);
+    return CART_ERR_OPEN;
+  }
+  if ((size_t)st.st_size < INES_HEADER_SZ) {
+    close(romfd);
+    return CART_ERR_FORMAT;
+  }
+
+  byte_t *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, romfd, 0);
+  close(romfd);
+  if (image == MAP_FAILED) {
+    return CART_ERR_OPEN;
+  }
+  cart->_data_ptr = image;
+  cart->cartridge_sz = st.st_size;
+
+  cart_err_t err = parse_header(cart);
+  if (err == CART_OK) {
+    err = map_ram(cart, save);
+  }
+  if (err != CART_OK) {
+    unmount(cart);
+  }
+  return err;
+}
+
+/**
+ * @brief Releases everything mount() mapped. Battery-backed PRG-RAM is
+ * flushed to its save file.
+ */
+void unmount(cartridge_t *cart) {
+  if (cart->chr_ram && cart->chr.data != NULL) {
+    munmap(cart->chr.data, cart->chr.size);
+  }
+  if (cart->prg_ram.data != NULL) {
+    munmap(cart->prg_ram.data, cart->prg_ram.size);
+  }
+  if (cart->_data_ptr != NULL) {
+    munmap(cart->_data_ptr, cart->cartridge_sz);
+  }
+  memset(cart, 0, sizeof(*cart));
+}
+
+/**
+ * @brief Describes why mount() failed.
+ */
+const char *describe_cart_err(cart_err_t err) {
+  return CART_ERR_DESCRIPTIONS[err];
+}
+
+/**
+ * @brief Slices `whole` into `bank_sz`-byte banks and returns one.
+ *
+ * Bank numbers wrap around, like they do on most boards (which simply
+ * ignore the bank number's high bits); negative numbers count back from
+ * the last bank. A `bank_sz` larger than `whole` returns all of it.
+ */
+static bank_t slice(bank_t whole, size_t bank_sz, int which) {
+  if (bank_sz >= whole.size) {
+    return whole;
+  }
+  size_t count = whole.size / bank_sz;
+  size_t idx = which < 0 ? count - ((size_t)(-which) % count)
+                         : (size_t)which % count;
+  return (bank_t){whole.data + (idx % count) * bank_sz, bank_sz};
+}
+
+/**
+ * @brief Describes PRG-ROM bank `which`, counting in `bank_sz`-byte banks.
+ */
+bank_t prg_bank(cartridge_t *cart, size_t bank_sz, int which) {
+  return slice(cart->prg_rom, bank_sz, which);
+}
+
+/**
+ * @brief Describes CHR bank `which`, counting in `bank_sz`-byte banks.
+ */
+bank_t chr_bank(cartridge_t *cart, size_t bank_sz, int which) {
+  return slice(cart->chr, bank_sz, which);
+}
@@ -1,26 +1,87 @@
 /**
  * @file
- * @brief
+ * @brief iNES and NES 2.0 cartridge images.
+ *
+ * See spec here: https://www.nesdev.org/wiki/INES and
+ * https://www.nesdev.org/wiki/NES_2.0
  *
  * @author Benedict Song
  */
 #ifndef _CARTRIDGE_INCLUDED
+#include <stdbool.h>
 #include <stdio.h>
 
+#include "memory/bus.h"
 #include "memory/umem.h"
 
-typedef enum { MAPPER_0, MAPPER_1, MAPPER_2 } mapper_t;
+#define INES_HEADER_SZ 16
+#define INES_TRAINER_SZ 512
+
+/*
+ * iNES headers count PRG-ROM in 16 KB units and CHR-ROM in 8 KB units.
+ */
+#define PRG_ROM_UNIT 0x4000u
+#define CHR_ROM_UNIT 0x2000u
+
+/*
+ * Sizes assumed when the header does not say otherwise.
+ */
+#define DEFAULT_PRG_RAM_SZ 0x2000u
+#define DEFAULT_CHR_RAM_SZ 0x2000u
+
+/*
+ * Where PRG-RAM and the trainer appear in the CPU's address space.
+ */
+#define PRG_RAM_START 0x6000u
+#define TRAINER_START 0x7000u
+
+/*
+ * Reasons mounting a cartridge can fail.
+ */
+typedef enum {
+  CART_OK = 0,
+  CART_ERR_OPEN,    // the image could not be opened or mapped
+  CART_ERR_FORMAT,  // the image is not an iNES/NES 2.0 file
+  CART_ERR_SIZE,    // the header disagrees with the image's size
+  CART_ERR_MAPPER   // the image needs a mapper we don't implement
+} cart_err_t;
+
+/*
+ * Describes one contiguous stretch of cartridge memory in the host's
+ * address space.
+ */
+typedef struct bank {
+  byte_t *data;
+  size_t size;
+} bank_t;
 
+/*
+ * A mounted cartridge. PRG-ROM, CHR-ROM and the trainer point straight into
+ * a read-only mapping of the image; nothing is copied out of it.
+ */
 typedef struct {
-  byte_t *_data_ptr;
-  size_t cartridge_sz;
-  mapper_t mapper;
+  byte_t *_data_ptr;    // the whole image, mapped read-only
+  size_t cartridge_sz;  // ditto
+
+  uint16_t mapper;    // iNES mapper number (see cartridge/mapper.h)
+  uint8_t submapper;  // NES 2.0 only; 0 otherwise
+  mirroring_t mirroring;
+  bool nes2;     // true if the header is in NES 2.0 format
+  bool battery;  // true if PRG-RAM is battery-backed
+
+  bank_t prg_rom;
+  bank_t chr;  // CHR-ROM, or CHR-RAM if chr_ram is set
+  bool chr_ram;
+  bank_t trainer;  // size 0 if there is none
+  bank_t prg_ram;  // backed by a .sav file next to the image if battery
 } cartridge_t;
 
-cartridge_t mount(const char *locale);
-void unmount(cartridge_t cartridge);
+cart_err_t mount(cartridge_t *cart, const char *locale, const char *save);
+void unmount(cartridge_t *cart);
+const char *describe_cart_err(cart_err_t err);
 
-byte_t ask(cartridge_t cartridge, uaddr_t which);
+bank_t prg_bank(cartridge_t *cart, size_t bank_sz, int which);
+bank_t chr_bank(cartridge_t *cart, size_t bank_sz, int which);
 
 #define _CARTRIDGE_INCLUDED
-#endif
\ No newline at end of file
+#endif
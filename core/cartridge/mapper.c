@@ -0,0 +1,167 @@
+/**
+ * @file
+ * @brief The mapper framework, and the discrete-logic boards (NROM, UxROM,
+ * CNROM) that need no more than a latch.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "cartridge/mapper.h"
+
+/*
+ * The most PRG-RAM that can be visible at once
+ */
+#define PRG_RAM_WINDOW (CART_ROM_START - PRG_RAM_START)
+
+/*
+ * Every mapper we know of, by iNES number
+ */
+static const mapper_ops_t *MAPPERS[] = {
+    [MAPPER_NROM] = &NROM_OPS, [MAPPER_MMC1] = &MMC1_OPS,
+    [MAPPER_UXROM] = &UXROM_OPS, [MAPPER_CNROM] = &CNROM_OPS,
+    [MAPPER_MMC3] = &MMC3_OPS};
+
+#define MAPPER_COUNT (sizeof(MAPPERS) / sizeof(MAPPERS[0]))
+
+/**
+ * @brief Reads from cartridge space nothing answers to (e.g. $6000-$7FFF on
+ * boards without PRG-RAM). Sees open bus.
+ */
+static byte_t cart_read(bus_t *bus, uaddr_t which) { return which >> 8; }
+
+/**
+ * @brief Forwards writes to cartridge space that aren't backed by RAM to
+ * the mapper. The PPU sees what the mapper maps, so it is caught up to the
+ * write first.
+ */
+static void cart_write(bus_t *bus, uaddr_t which, byte_t what) {
+  mapper_t *mapper = bus->mapper;
+  if (mapper->ops->write) {
+    if (bus->sync) {
+      bus->sync(bus);
+    }
+    mapper->ops->write(mapper, which, what);
+  }
+}
+
+/**
+ * @brief Plugs a mounted cartridge into the bus through its mapper, and
+ * puts the mapper in its power-on state.
+ *
+ * Reads from PRG-ROM and PRG-RAM go straight to memory. Writes to PRG-ROM
+ * (i.e. to mapper registers) reach the mapper's write hook.
+ *
+ * @param[out] mapper Where the mapper should be written. It must outlive
+ * the bus's use of it.
+ *
+ * @returns 0 on success, -1 if we don't implement the cartridge's mapper.
+ */
+int connect_mapper(mapper_t *mapper, cartridge_t *cart, bus_t *bus) {
+  if (cart->mapper >= MAPPER_COUNT || MAPPERS[cart->mapper] == NULL) {
+    return -1;
+  }
+  *mapper =
+      (mapper_t){.ops = MAPPERS[cart->mapper], .cart = cart, .bus = bus};
+  bus->cart = cart;
+  bus->mapper = mapper;
+
+  map_io(bus, PRG_RAM_START, UNES_MEM_CAP - PRG_RAM_START, cart_read,
+         cart_write);
+  if (cart->prg_ram.size > 0) {
+    size_t visible = cart->prg_ram.size < PRG_RAM_WINDOW ? cart->prg_ram.size
+                                                         : PRG_RAM_WINDOW;
+    map_memory(bus, PRG_RAM_START, PRG_RAM_WINDOW, cart->prg_ram.data,
+               visible, true);
+  }
+  // mappers that control mirroring override this in sync()
+  map_nametables(bus, cart->mirroring);
+
+  reset_mapper(mapper);
+  return 0;
+}
+
+/**
+ * @brief Puts the mapper's registers in their power-on state and maps the
+ * banks they select.
+ */
+void reset_mapper(mapper_t *mapper) {
+  mapper->regs = (mapper_regs_t){0};
+  if (mapper->ops->reset) {
+    mapper->ops->reset(mapper);
+  }
+  mapper->ops->sync(mapper);
+}
+
+/**
+ * @brief Maps PRG-ROM bank `which` (counting in `bank_sz`-byte banks; see
+ * prg_bank()) at `start` in the CPU's address space.
+ *
+ * Writes to the bank keep reaching the mapper.
+ */
+void map_prg(mapper_t *mapper, uaddr_t start, size_t bank_sz, int which) {
+  bank_t bank = prg_bank(mapper->cart, bank_sz, which);
+  map_memory(mapper->bus, start, bank_sz, bank.data, bank.size, false);
+}
+
+/**
+ * @brief Maps CHR bank `which` (counting in `bank_sz`-byte banks; see
+ * chr_bank()) at `start` in the PPU's address space.
+ */
+void map_chr(mapper_t *mapper, uaddr_t start, size_t bank_sz, int which) {
+  bank_t bank = chr_bank(mapper->cart, bank_sz, which);
+  map_ppu_memory(mapper->bus, start, bank_sz, bank.data, bank.size,
+                 mapper->cart->chr_ram);
+}
+
+/* NROM (MAPPER 0) */
+
+/*
+ * 16 or 32 KB of PRG-ROM (the former mirrored) and 8 KB of CHR, fixed.
+ */
+static void nrom_sync(mapper_t *mapper) {
+  map_prg(mapper, CART_ROM_START, 0x8000, 0);
+  map_chr(mapper, 0x0000, 0x2000, 0);
+}
+
+const mapper_ops_t NROM_OPS = {.name = "NROM", .sync = nrom_sync};
+
+/* UxROM (MAPPER 2) */
+
+/*
+ * A switchable 16 KB PRG-ROM bank at $8000, the last 16 KB fixed at $C000,
+ * and 8 KB of (usually) CHR-RAM.
+ */
+static void uxrom_sync(mapper_t *mapper) {
+  map_prg(mapper, 0x8000, 0x4000, mapper->regs.bank);
+  map_prg(mapper, 0xC000, 0x4000, -1);
+  map_chr(mapper, 0x0000, 0x2000, 0);
+}
+
+static void uxrom_write(mapper_t *mapper, uaddr_t which, byte_t what) {
+  if (which >= CART_ROM_START) {
+    mapper->regs.bank = what;
+    uxrom_sync(mapper);
+  }
+}
+
+const mapper_ops_t UXROM_OPS = {
+    .name = "UxROM", .write = uxrom_write, .sync = uxrom_sync};
+
+/* CNROM (MAPPER 3) */
+
+/*
+ * Fixed PRG-ROM like NROM, and a switchable 8 KB CHR-ROM bank.
+ */
+static void cnrom_sync(mapper_t *mapper) {
+  map_prg(mapper, CART_ROM_START, 0x8000, 0);
+  map_chr(mapper, 0x0000, 0x2000, mapper->regs.bank);
+}
+
+static void cnrom_write(mapper_t *mapper, uaddr_t which, byte_t what) {
+  if (which >= CART_ROM_START) {
+    mapper->regs.bank = what;
+    cnrom_sync(mapper);
+  }
+}
+
+const mapper_ops_t CNROM_OPS = {
+    .name = "CNROM", .write = cnrom_write, .sync = cnrom_sync};
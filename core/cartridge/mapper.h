@@ -0,0 +1,99 @@
+/**
+ * @file
+ * @brief Cartridge mappers (a.k.a. memory management controllers).
+ *
+ * A mapper decides which PRG and CHR banks appear where, and may raise IRQs.
+ * It only touches the bus's page tables when its registers change, so a
+ * bank switch costs one remap instead of a check on every access.
+ *
+ * See spec here: https://www.nesdev.org/wiki/Mapper
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdbool.h>
+
+#include "cartridge/cartridge.h"
+#include "memory/bus.h"
+#include "memory/umem.h"
+
+/*
+ * iNES numbers of the mappers we implement
+ */
+#define MAPPER_NROM 0
+#define MAPPER_MMC1 1
+#define MAPPER_UXROM 2
+#define MAPPER_CNROM 3
+#define MAPPER_MMC3 4
+
+/*
+ * Register files of the individual mappers. They hold everything a mapper
+ * knows and contain no pointers, so they can be copied around as-is.
+ */
+typedef struct mmc1_regs {
+  byte_t shift;  // serial shift register
+  byte_t count;  // bits shifted in so far
+  byte_t ctrl;
+  byte_t chr0;
+  byte_t chr1;
+  byte_t prg;
+  uint64_t last_write;  // the access_clock() of the last write taken
+} mmc1_regs_t;
+
+typedef struct mmc3_regs {
+  byte_t select;   // bank select ($8000)
+  byte_t bank[8];  // R0-R7, written through $8001
+  byte_t mirroring;
+  byte_t irq_latch;
+  byte_t irq_counter;
+  bool irq_enabled;
+  bool irq_reload;
+} mmc3_regs_t;
+
+typedef union mapper_regs {
+  byte_t bank;  // UxROM and CNROM have a single bank register
+  mmc1_regs_t mmc1;
+  mmc3_regs_t mmc3;
+} mapper_regs_t;
+
+struct mapper;
+
+/*
+ * What a mapper does. Every hook but sync() may be NULL.
+ */
+typedef struct mapper_ops {
+  const char *name;
+  // Puts the registers in their power-on state
+  void (*reset)(struct mapper *mapper);
+  // Handles CPU writes to $6000-$FFFF that aren't backed by RAM
+  void (*write)(struct mapper *mapper, uaddr_t which, byte_t what);
+  // Bank-switch notification: maps whatever banks the registers select
+  // onto the bus. Called whenever the registers change, including when
+  // they are restored from elsewhere.
+  void (*sync)(struct mapper *mapper);
+  // Clocked by the PPU once per rendered scanline
+  void (*scanline)(struct mapper *mapper);
+} mapper_ops_t;
+
+typedef struct mapper {
+  const mapper_ops_t *ops;
+  cartridge_t *cart;
+  bus_t *bus;
+  mapper_regs_t regs;
+} mapper_t;
+
+int connect_mapper(mapper_t *mapper, cartridge_t *cart, bus_t *bus);
+void reset_mapper(mapper_t *mapper);
+
+/* BANKING HELPERS, FOR IMPLEMENTATIONS */
+
+void map_prg(mapper_t *mapper, uaddr_t start, size_t bank_sz, int which);
+void map_chr(mapper_t *mapper, uaddr_t start, size_t bank_sz, int which);
+
+/* IMPLEMENTATIONS */
+
+extern const mapper_ops_t NROM_OPS;
+extern const mapper_ops_t MMC1_OPS;
+extern const mapper_ops_t UXROM_OPS;
+extern const mapper_ops_t CNROM_OPS;
+extern const mapper_ops_t MMC3_OPS;
@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @brief MMC1 (mapper 1): SxROM boards.
+ *
+ * Registers are loaded serially: five writes to $8000-$FFFF shift a bit
+ * each into a shift register, and the fifth lands the result in the
+ * register selected by bits 13-14 of its address.
+ *
+ * See spec here: https://www.nesdev.org/wiki/MMC1
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "cartridge/mapper.h"
+#include "cpu/ucpu.h"
+
+/*
+ * Control register fields
+ */
+#define CTRL_MIRRORING 0x03u
+#define CTRL_PRG_MODE 0x0Cu
+#define CTRL_CHR_4K 0x10u
+
+/*
+ * PRG banking modes (bits 2-3 of the control register)
+ */
+#define PRG_32K 0x00u     // $8000 32 KB, switchable (also 0x04)
+#define PRG_FIX_LO 0x08u  // $8000 fixed to the first bank, $C000 switchable
+#define PRG_FIX_HI 0x0Cu  // $8000 switchable, $C000 fixed to the last bank
+
+/*
+ * SUROM and friends carry 512 KB of PRG-ROM; the CHR registers' bit 4
+ * picks which 256 KB half is visible.
+ */
+#define PRG_OUTER_SZ 0x40000u
+#define OUTER_BANKS ((int)(PRG_OUTER_SZ / 0x4000))
+
+static void mmc1_reset(mapper_t *mapper) {
+  // the last PRG bank starts out fixed at $C000, so the reset vector is
+  // there for the program to find
+  mapper->regs.mmc1.ctrl = PRG_FIX_HI;
+}
+
+static void mmc1_sync(mapper_t *mapper) {
+  mmc1_regs_t *regs = &mapper->regs.mmc1;
+  cartridge_t *cart = mapper->cart;
+
+  static const mirroring_t MIRRORING[] = {
+      MIRROR_SINGLE_LOW, MIRROR_SINGLE_HIGH, MIRROR_VERTICAL,
+      MIRROR_HORIZONTAL};
+  if (cart->mirroring != MIRROR_FOUR_SCREEN) {
+    map_nametables(mapper->bus, MIRRORING[regs->ctrl & CTRL_MIRRORING]);
+  }
+
+  // 16 KB bank numbers, within the selected 256 KB outer bank
+  bool big = cart->prg_rom.size > PRG_OUTER_SZ;
+  int outer = (big && (regs->chr0 & 0x10)) ? OUTER_BANKS : 0;
+  int bank = outer + (regs->prg & 0x0F);
+  int last = big ? outer + OUTER_BANKS - 1 : -1;
+
+  switch (regs->ctrl & CTRL_PRG_MODE) {
+    case PRG_FIX_LO: {
+      map_prg(mapper, 0x8000, 0x4000, outer);
+      map_prg(mapper, 0xC000, 0x4000, bank);
+      break;
+    }
+
+    case PRG_FIX_HI: {
+      map_prg(mapper, 0x8000, 0x4000, bank);
+      map_prg(mapper, 0xC000, 0x4000, last);
+      break;
+    }
+
+    default: {  // 32 KB mode ignores the bank number's low bit
+      map_prg(mapper, 0x8000, 0x4000, bank & ~1);
+      map_prg(mapper, 0xC000, 0x4000, bank | 1);
+      break;
+    }
+  }
+
+  if (regs->ctrl & CTRL_CHR_4K) {
+    map_chr(mapper, 0x0000, 0x1000, regs->chr0);
+    map_chr(mapper, 0x1000, 0x1000, regs->chr1);
+  } else {
+    map_chr(mapper, 0x0000, 0x2000, regs->chr0 >> 1);
+  }
+}
+
+/*
+ * Consecutive writes on back-to-back cycles (which only RMW instructions
+ * produce, writing the byte back unmodified and then modified) are ignored
+ * by the real chip: only the first of them is taken. The fast core makes
+ * both of an RMW's writes at the same access_clock(), so a write on that
+ * cycle is ignored too. Without a CPU on the bus there is no clock to go
+ * by, and every write is taken.
+ *
+ * PRG-RAM is left enabled regardless of the PRG register's bit 4, as most
+ * emulators do: MMC1A boards lack the bit and several games never set it.
+ */
+static void mmc1_write(mapper_t *mapper, uaddr_t which, byte_t what) {
+  mmc1_regs_t *regs = &mapper->regs.mmc1;
+  if (which < CART_ROM_START) {
+    return;
+  }
+  ucpu_t *cpu = mapper->bus->cpu;
+  if (cpu) {
+    clk_t now = access_clock(cpu);
+    if (now - regs->last_write <= 1) {
+      return;
+    }
+    regs->last_write = now;
+  }
+
+  if (what & 0x80) {
+    // writing a 1 to bit 7 resets the shift register and fixes the last
+    // PRG bank at $C000
+    regs->shift = 0;
+    regs->count = 0;
+    regs->ctrl |= PRG_FIX_HI;
+    mmc1_sync(mapper);
+    return;
+  }
+
+  regs->shift |= (what & 1) << regs->count;
+  if (++regs->count < 5) {
+    return;
+  }
+
+  switch (which & 0xE000) {
+    case 0x8000: {
+      regs->ctrl = regs->shift;
+      break;
+    }
+
+    case 0xA000: {
+      regs->chr0 = regs->shift;
+      break;
+    }
+
+    case 0xC000: {
+      regs->chr1 = regs->shift;
+      break;
+    }
+
+    default: {  // $E000
+      regs->prg = regs->shift;
+      break;
+    }
+  }
+  regs->shift = 0;
+  regs->count = 0;
+  mmc1_sync(mapper);
+}
+
+const mapper_ops_t MMC1_OPS = {.name = "MMC1",
+                               .reset = mmc1_reset,
+                               .write = mmc1_write,
+                               .sync = mmc1_sync};
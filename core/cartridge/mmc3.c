@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief MMC3 (mapper 4): TxROM boards.
+ *
+ * Eight bank registers (R0-R7) select 2 and 1 KB CHR banks and 8 KB PRG
+ * banks, and a scanline counter clocked by the PPU raises IRQs.
+ *
+ * See spec here: https://www.nesdev.org/wiki/MMC3
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "cartridge/mapper.h"
+
+/*
+ * Bank select register fields
+ */
+#define SELECT_REG 0x07u
+#define SELECT_PRG_SWAP 0x40u  // swap $8000 and $C000
+#define SELECT_CHR_SWAP 0x80u  // swap $0000-$0FFF and $1000-$1FFF
+
+static void mmc3_sync(mapper_t *mapper) {
+  mmc3_regs_t *regs = &mapper->regs.mmc3;
+
+  if (mapper->cart->mirroring != MIRROR_FOUR_SCREEN) {
+    map_nametables(mapper->bus, (regs->mirroring & 1) ? MIRROR_HORIZONTAL
+                                                      : MIRROR_VERTICAL);
+  }
+
+  // R6 and the second-to-last bank trade places at $8000 and $C000
+  bool prg_swap = regs->select & SELECT_PRG_SWAP;
+  map_prg(mapper, prg_swap ? 0xC000 : 0x8000, 0x2000, regs->bank[6]);
+  map_prg(mapper, 0xA000, 0x2000, regs->bank[7]);
+  map_prg(mapper, prg_swap ? 0x8000 : 0xC000, 0x2000, -2);
+  map_prg(mapper, 0xE000, 0x2000, -1);
+
+  // R0-R1 select 2 KB banks (ignoring their low bit), R2-R5 1 KB banks
+  uaddr_t two_kb = (regs->select & SELECT_CHR_SWAP) ? 0x1000 : 0x0000;
+  uaddr_t one_kb = two_kb ^ 0x1000;
+  map_chr(mapper, two_kb, 0x0800, regs->bank[0] >> 1);
+  map_chr(mapper, two_kb + 0x0800, 0x0800, regs->bank[1] >> 1);
+  for (int reg = 2; reg < 6; reg++) {
+    map_chr(mapper, one_kb + (reg - 2) * 0x0400, 0x0400, regs->bank[reg]);
+  }
+}
+
+/*
+ * Registers are selected by address bits 13-14 and whether the address is
+ * even or odd.
+ *
+ * The PRG-RAM protect register ($A001) is ignored, as most emulators do:
+ * the MMC6 shares the mapper number but lays the register out differently.
+ */
+static void mmc3_write(mapper_t *mapper, uaddr_t which, byte_t what) {
+  mmc3_regs_t *regs = &mapper->regs.mmc3;
+  if (which < CART_ROM_START) {
+    return;
+  }
+
+  switch ((which & 0xE000) | (which & 1)) {
+    case 0x8000: {  // bank select
+      regs->select = what;
+      mmc3_sync(mapper);
+      break;
+    }
+
+    case 0x8001: {  // bank data
+      regs->bank[regs->select & SELECT_REG] = what;
+      mmc3_sync(mapper);
+      break;
+    }
+
+    case 0xA000: {  // mirroring
+      regs->mirroring = what;
+      mmc3_sync(mapper);
+      break;
+    }
+
+    case 0xC000: {  // IRQ latch
+      regs->irq_latch = what;
+      break;
+    }
+
+    case 0xC001: {  // IRQ reload
+      regs->irq_counter = 0;
+      regs->irq_reload = true;
+      break;
+    }
+
+    case 0xE000: {  // IRQ disable, which also acknowledges a pending IRQ
+      regs->irq_enabled = false;
+      mapper->bus->irq &= ~IRQ_MAPPER;
+      break;
+    }
+
+    case 0xE001: {  // IRQ enable
+      regs->irq_enabled = true;
+      break;
+    }
+
+    default:  // $A001: PRG-RAM protect
+      break;
+  }
+}
+
+/*
+ * The real counter is clocked by rising edges of PPU A12, which happen
+ * once per scanline when rendering with the usual pattern table layout
+ * (background at $0000, sprites at $1000).
+ */
+static void mmc3_scanline(mapper_t *mapper) {
+  mmc3_regs_t *regs = &mapper->regs.mmc3;
+
+  if (regs->irq_counter == 0 || regs->irq_reload) {
+    regs->irq_counter = regs->irq_latch;
+    regs->irq_reload = false;
+  } else {
+    regs->irq_counter--;
+  }
+
+  if (regs->irq_counter == 0 && regs->irq_enabled) {
+    mapper->bus->irq |= IRQ_MAPPER;
+  }
+}
+
+const mapper_ops_t MMC3_OPS = {.name = "MMC3",
+                               .write = mmc3_write,
+                               .sync = mmc3_sync,
+                               .scanline = mmc3_scanline};
@@ -11,101 +11,29 @@
 #include <string.h>
 
 #include "cpu/uerrno.h"
+#include "cpu/uopcodes.h"
 #include "memory/umem.h"
 
-#define DEFER(cpu, cycs)      \
-  {                           \
-    if (!cpu->deferred) {     \
-      cpu->cycs_left += cycs; \
-      cpu->deferred = true;   \
-      return 0;               \
-    }                         \
-  }
-
 #define SETS(where, what) (set_byte(cpu->buslink, where, what))
 #define GETS(where) (get_byte(cpu->buslink, where))
 
 /*
- * Mapping from opcode to canonical opcode
- */
-static const opcode_t OPCODE_TO_CANONICAL[] = {
-    O_BRK, O_ORA, O_DNE, O_DNE, O_NOP, O_ORA, O_ASL, O_DNE, O_PHP, O_ORA, O_ASL,
-    O_DNE, O_DNE, O_ORA, O_ASL, O_DNE, O_BPL, O_ORA, O_DNE, O_DNE, O_DNE, O_ORA,
-    O_ASL, O_DNE, O_CLC, O_ORA, O_DNE, O_DNE, O_DNE, O_ORA, O_ASL, O_DNE, O_JSR,
-    O_AND, O_DNE, O_DNE, O_BIT, O_AND, O_ROL, O_DNE, O_PLP, O_AND, O_ROL, O_DNE,
-    O_BIT, O_AND, O_ROL, O_DNE, O_BMI, O_AND, O_DNE, O_DNE, O_DNE, O_AND, O_ROL,
-    O_DNE, O_SEC, O_AND, O_DNE, O_DNE, O_DNE, O_AND, O_ROL, O_DNE, O_RTI, O_EOR,
-    O_DNE, O_DNE, O_DNE, O_EOR, O_LSR, O_DNE, O_PHA, O_EOR, O_LSR, O_DNE, O_JMP,
-    O_EOR, O_LSR, O_DNE, O_BVC, O_EOR, O_DNE, O_DNE, O_DNE, O_EOR, O_LSR, O_DNE,
-    O_CLI, O_EOR, O_DNE, O_DNE, O_DNE, O_EOR, O_LSR, O_DNE, O_RTS, O_ADC, O_DNE,
-    O_DNE, O_DNE, O_ADC, O_ROR, O_DNE, O_PLA, O_ADC, O_ROR, O_DNE, O_JMP, O_ADC,
-    O_ROR, O_DNE, O_BVC, O_ADC, O_DNE, O_DNE, O_DNE, O_ADC, O_ROR, O_DNE, O_SEI,
-    O_ADC, O_DNE, O_DNE, O_DNE, O_ADC, O_ROR, O_DNE, O_DNE, O_STA, O_DNE, O_DNE,
-    O_STY, O_STA, O_STX, O_DNE, O_DEY, O_DNE, O_TXA, O_DNE, O_STY, O_STA, O_STX,
-    O_DNE, O_BCC, O_STA, O_DNE, O_DNE, O_STY, O_STA, O_STX, O_DNE, O_TYA, O_STA,
-    O_TXS, O_DNE, O_DNE, O_STA, O_DNE, O_DNE, O_LDY, O_LDA, O_LDX, O_DNE, O_LDY,
-    O_LDA, O_LDX, O_DNE, O_TAY, O_LDA, O_TAX, O_DNE, O_LDY, O_LDA, O_LDX, O_DNE,
-    O_BCS, O_LDA, O_DNE, O_DNE, O_LDY, O_LDA, O_LDX, O_DNE, O_CLV, O_LDA, O_TSX,
-    O_DNE, O_LDY, O_LDA, O_LDX, O_DNE, O_CPY, O_CMP, O_DNE, O_DNE, O_CPY, O_CMP,
-    O_DEC, O_DNE, O_INY, O_CMP, O_DEX, O_DNE, O_CPY, O_CMP, O_DEC, O_DNE, O_BNE,
-    O_CMP, O_DNE, O_DNE, O_DNE, O_CMP, O_DEC, O_DNE, O_CLD, O_CMP, O_DNE, O_DNE,
-    O_DNE, O_CMP, O_DEC, O_DNE, O_CPX, O_SBC, O_DNE, O_DNE, O_CPX, O_SBC, O_INC,
-    O_DNE, O_INX, O_SBC, O_NOP, O_DNE, O_CPX, O_SBC, O_INC, O_DNE, O_BEQ, O_SBC,
-    O_DNE, O_DNE, O_DNE, O_SBC, O_INC, O_DNE, O_SED, O_SBC, O_DNE, O_DNE, O_DNE,
-    O_SBC, O_INC, O_DNE};
+ * Handlers, addressing modes and operations are small and called from
+ * exactly one kind of place; always fold them into their caller.
+ */
+#define UCPU_INLINE static inline __attribute__((always_inline))
 
 /*
- * Mapping from opcode to addressing mode
- */
-static const addr_mode_t OPCODE_TO_ADDRMODE[] = {
-    IMPL,  INDIR_X,    0,     0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      ACCUM, 0,    0,        ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0,
-    ABS,   INDIR_X,    0,     0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      ACCUM, 0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0,
-    IMPL,  INDIR_X,    0,     0,    0,        ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      ACCUM, 0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0,
-    IMPL,  INDIR_X,    0,     0,    0,        ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      ACCUM, 0,    INDIR,    ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0,
-    0,     INDIR_X,    0,     0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  0,          IMPL,  0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y,    0,     0,    ZPAGE_X,  ZPAGE_X,  ZPAGE_Y,  0,
-    IMPL,  ABS_Y,      IMPL,  0,    0,        ABS_X,    0,        0,
-    IMMED, INDIR_X,    IMMED, 0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      IMPL,  0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    ZPAGE_X,  ZPAGE_X,  ZPAGE_Y,  0,
-    IMPL,  ABS_Y_RO,   0,     IMPL, ABS_X_RO, ABS_X_RO, ABS_Y_RO, 0,
-    IMMED, INDIR_X,    0,     0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      IMPL,  0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0,
-    IMMED, INDIR_X,    0,     0,    ZPAGE,    ZPAGE,    ZPAGE,    0,
-    IMPL,  IMMED,      IMPL,  0,    ABS,      ABS,      ABS,      0,
-    REL,   INDIR_Y_RO, 0,     0,    0,        ZPAGE_X,  ZPAGE_X,  0,
-    IMPL,  ABS_Y_RO,   0,     0,    0,        ABS_X_RO, ABS_X,    0};
+ * Cycles a jammed CPU spends each time it lands on its JAM opcode again
+ */
+#define JAM_CYCS 2
 
 /*
- * Mapping from opcode to clock cycles taken
- */
-static const clk_t OPCODE_TO_CYCLES[] = {
-    7, 6, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0,
-    2, 4, 0, 0, 0, 4, 7, 0, 6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0, 6, 6, 0, 0, 0, 3, 5, 0,
-    3, 2, 2, 0, 3, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-    6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0,
-    2, 4, 0, 0, 0, 4, 7, 0, 0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
-    2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0, 2, 6, 2, 0, 3, 3, 3, 0,
-    2, 2, 2, 0, 4, 4, 4, 0, 2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
-    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0, 2, 5, 0, 0, 0, 4, 6, 0,
-    2, 4, 0, 0, 0, 4, 7, 0, 2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
-    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0};
+ * What ANE ($8B) and LXA ($AB) OR the accumulator with before masking it.
+ * It varies from chip to chip (and with temperature); this is the value
+ * most emulators and the Tom Harte tests agree on.
+ */
+#define UNSTABLE_MAGIC 0xEEu
 
 /**
  * @brief
@@ -193,9 +121,46 @@ void init_cpu(ucpu_t *cpu) {
   cpu->buslink = (buslink_t){DEV_CPU, NULL};
 
   // initialize state machine logic
-  cpu->accum = false;
   cpu->cycs_left = 0;
-  cpu->deferred = false;
+
+  // initialize the cycle-stepped core
+  cpu->core = CPU_DEFAULT_CORE;
+  cpu->op = 0;
+  cpu->tick = 0;
+  cpu->access = 0;
+  cpu->data = 0;
+  cpu->addr = 0;
+  cpu->ptr = 0;
+  cpu->vector = 0;
+
+  // initialize bookkeeping
+  cpu->clock = 0;
+  cpu->stop = 0;
+  cpu->instrs = 0;
+  cpu->err = ERR_NONE;
+  cpu->fault_pc = 0;
+  cpu->fault_op = 0;
+}
+
+/**
+ * @brief Pulls the CPU's reset line: execution resumes at the address in
+ * the reset vector, with IRQs masked.
+ *
+ * Like the real thing, reset goes through the motions of an interrupt
+ * without writing anything, so S drops by 3. It is also the only way out
+ * of a jam.
+ */
+void reset_cpu(ucpu_t *cpu) {
+  if (cpu_jammed(cpu)) {
+    cpu->err = ERR_NONE;
+  }
+  cpu->S -= 3;
+  set_flag(cpu, INTERRUPT, true);
+  cpu->PC = pack(GETS(RST_VECTOR + 1), GETS(RST_VECTOR));
+  cpu->cycs_left = 0;
+  cpu->tick = 0;
+  cpu->vector = 0;
+  cpu->clock += INTERRUPT_CYCS;
 }
 
 void push(ucpu_t *cpu, byte_t what) {
@@ -206,7 +171,7 @@ void push(ucpu_t *cpu, byte_t what) {
 
 byte_t pop(ucpu_t *cpu) {
   if (cpu->S == 0x00FF) {
-    UERRNO = ERR_STACK_UNDERFLOW;
+    cpu->err = ERR_STACK_UNDERFLOW;
   }
   cpu->S++;
   return GETS(cpu->S + STACK_OFFSET);
@@ -214,716 +179,1293 @@ byte_t pop(ucpu_t *cpu) {
 
 byte_t peek(ucpu_t *cpu) { return GETS(cpu->S + STACK_OFFSET + 1); }
 
-void cpu_nmi(ucpu_t *cpu) {
+/**
+ * @brief Enters the interrupt handler at `vector`, the way NMIs and IRQs
+ * do: PC and status are pushed (the latter with B clear), and further IRQs
+ * are masked.
+ */
+static void interrupt(ucpu_t *cpu, uaddr_t vector) {
+  push(cpu, high(cpu->PC));
+  push(cpu, low(cpu->PC));
+  push(cpu, (cpu->status & ~(1u << BREAK)) | (1u << FIVE));
+  set_flag(cpu, INTERRUPT, true);
+  cpu->PC = pack(GETS(vector + 1), GETS(vector));
+}
+
+/* ADDRESSING MODES */
+
+/*
+ * Each addressing mode resolves *where* an instruction's operand lives and
+ * advances PC past the instruction. Modes that can take extra cycles add
+ * them to `cycs`.
+ *
+ * The goal is to be able to do get_byte(cpu->buslink, operand) and
+ * set_byte(cpu->buslink, operand) and have it do the proper thing.
+ */
+#define ADDR_MODE(mode) UCPU_INLINE uaddr_t am_##mode(ucpu_t *cpu, clk_t *cycs)
+
+ADDR_MODE(IMPL) {
+  cpu->PC += 1;
+  return NULLPTR;
+}
+
+ADDR_MODE(ACCUM) {
+  cpu->PC += 1;
+  return NULLPTR;  // the operand is the accumulator itself
+}
+
+ADDR_MODE(IMMED) {
+  uaddr_t operand = cpu->PC + 1;  // assume program has been assembled
+                                  // properly and that we can do this safely
+  cpu->PC += 2;                   // remember to increment PC
+  return operand;
+}
+
+ADDR_MODE(REL) { return am_IMMED(cpu, cycs); }
+
+ADDR_MODE(ZPAGE) {
+  uaddr_t operand =
+      GETS(cpu->PC + 1);  // implicit conversion from byte_t -> uaddr_t
+  cpu->PC += 2;
+  return operand;
+}
+
+ADDR_MODE(ZPAGE_X) {
+  uaddr_t operand = (GETS(cpu->PC + 1) + cpu->X) % 256;
+  cpu->PC += 2;
+  return operand;
+}
+
+ADDR_MODE(ZPAGE_Y) {
+  uaddr_t operand = (GETS(cpu->PC + 1) + cpu->Y) % 256;
+  cpu->PC += 2;
+  return operand;
+}
+
+ADDR_MODE(ABS) {
+  uaddr_t operand = pack(GETS(cpu->PC + 2), GETS(cpu->PC + 1));
+  cpu->PC += 3;
+  return operand;
+}
+
+ADDR_MODE(INDIR) { return am_ABS(cpu, cycs); }
+
+ADDR_MODE(INDIR_X) {
+  uaddr_t before_indir = (GETS(cpu->PC + 1) + cpu->X) % 256;
+  cpu->PC += 2;
+  return pack(GETS((before_indir + 1) % 256), GETS(before_indir));
+}
+
+ADDR_MODE(ABS_X) {
+  uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->X;
+  uaddr_t operand = pack(GETS(cpu->PC + 2), indexed);
+  cpu->PC += 3;
+  return operand;
+}
+
+ADDR_MODE(ABS_X_RO) {  // read-only instructions potentially take an extra
+                       // cycle
+  uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->X;
+  uaddr_t operand = pack(GETS(cpu->PC + 2), indexed);
+  if (indexed > 255) {  // page crossing
+    (*cycs)++;
+  }
+  cpu->PC += 3;
+  return operand;
+}
+
+ADDR_MODE(ABS_Y) {
+  uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->Y;
+  uaddr_t operand = pack(GETS(cpu->PC + 2), indexed);
+  cpu->PC += 3;
+  return operand;
+}
+
+ADDR_MODE(ABS_Y_RO) {
+  uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->Y;
+  uaddr_t operand = pack(GETS(cpu->PC + 2), indexed);
+  if (indexed > 255) {  // page crossing
+    (*cycs)++;
+  }
+  cpu->PC += 3;
+  return operand;
+}
+
+ADDR_MODE(INDIR_Y) {
+  uaddr_t before_indir = GETS(cpu->PC + 1);
+  uaddr_t after_indir =
+      pack(GETS((before_indir + 1) % 256), GETS(before_indir));
+  cpu->PC += 2;
+  return after_indir + cpu->Y;
+}
+
+ADDR_MODE(INDIR_Y_RO) {
+  uaddr_t before_indir = GETS(cpu->PC + 1);
+  uaddr_t after_indir =
+      pack(GETS((before_indir + 1) % 256), GETS(before_indir));
+  uaddr_t operand = after_indir + cpu->Y;
+  if (compare_pages(after_indir, operand) != 0) {
+    (*cycs)++;
+  }
+  cpu->PC += 2;
+  return operand;
+}
+
+/* OPERATIONS */
+
+/*
+ * Each canonical instruction is written once, against an operand address
+ * that has already been resolved. `mode` is always a compile-time constant,
+ * so checks against it fold away inside every handler. Instructions that
+ * take extra cycles (i.e. taken branches) add them to `cycs`.
+ */
+#define OPERATION(mnem)                                                  \
+  UCPU_INLINE void do_##mnem(ucpu_t *cpu, uaddr_t operand, addr_mode_t mode, \
+                             clk_t *cycs)
+
+/*
+ * Read-modify-write instructions are written as what they do to the byte
+ * they modify, so that the cycle-stepped core can make the read and the
+ * write on cycles of their own. Each returns the modified byte.
+ */
+#define MODIFIER(mnem) UCPU_INLINE byte_t mod_##mnem(ucpu_t *cpu, byte_t val)
+
+/**
+ * @brief Writes back the byte an RMW instruction read, unmodified, as the
+ * real CPU does the cycle before writing the modified byte. Only registers
+ * can tell (e.g. MMC1 takes this write and ignores the next), so plain
+ * memory is spared it.
+ */
+UCPU_INLINE void rmw_write_back(ucpu_t *cpu, uaddr_t where, byte_t what) {
+  if (!cpu->buslink.bus->write_map[where / UCPU_PAGE_SZ]) {
+    SETS(where, what);
+  }
+}
+
+#define MODIFY_OPERATION(mnem)             \
+  OPERATION(mnem) {                        \
+    if (mode == ACCUM) {                   \
+      cpu->A = mod_##mnem(cpu, cpu->A);    \
+    } else {                               \
+      byte_t val = GETS(operand);          \
+      rmw_write_back(cpu, operand, val);   \
+      SETS(operand, mod_##mnem(cpu, val)); \
+    }                                      \
+  }
+
+/**
+ * @brief Shared logic of ADC and SBC.
+ */
+UCPU_INLINE void add_with_carry(ucpu_t *cpu, byte_t oper) {
+  // Apparently 6502 decimal mode is not supported on the NES?
+  // If there are problems with ADC maybe refer back here.
+  bool carry = get_flag(cpu, CARRY);
+  unsigned long addition = (unsigned long)cpu->A + oper + carry;
+  set_flag(cpu, CARRY, !!(addition & (1u << 8)));
+  // stolen from stackoverflow lmao
+  set_flag(cpu, OVERFLOW, ~(cpu->A ^ oper) & (cpu->A ^ addition) & 0x80);
+  cpu->A = (uregr_t)addition;
+  set_flag(cpu, ZERO, cpu->A == 0);
+  set_flag(cpu, NEGATIVE, !sign(cpu->A));
+}
+
+/**
+ * @brief Shared logic of CMP, CPX and CPY.
+ */
+UCPU_INLINE void compare(ucpu_t *cpu, uregr_t reg, byte_t oper) {
+  byte_t comparison = reg - oper;
+  set_flag(cpu, CARRY, reg >= oper);
+  set_flag(cpu, ZERO, comparison == 0);
+  set_flag(cpu, NEGATIVE, !sign(comparison));
+}
+
+/**
+ * @brief Sets the zero and negative flags according to `val`.
+ */
+UCPU_INLINE void set_zn(ucpu_t *cpu, byte_t val) {
+  set_flag(cpu, ZERO, val == 0);
+  set_flag(cpu, NEGATIVE, !sign(val));
+}
+
+/**
+ * @brief Shared logic of all conditional branches.
+ *
+ * Taken branches cost one extra cycle, or two if the branch target lies on
+ * a different page.
+ */
+UCPU_INLINE void branch(ucpu_t *cpu, uaddr_t operand, bool cond,
+                        clk_t *cycs) {
+  if (cond) {
+    offset_t off = (offset_t)GETS(operand);
+    *cycs += compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
+    cpu->PC += off;
+  }
+}
+
+OPERATION(ADC) { add_with_carry(cpu, GETS(operand)); }
+
+OPERATION(AND) {
+  cpu->A &= GETS(operand);
+  set_zn(cpu, cpu->A);
+}
+
+MODIFIER(ASL) {
+  byte_t res = val << 1;
+  set_flag(cpu, CARRY, !!(val >> 7));
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(ASL)
+
+OPERATION(BCC) { branch(cpu, operand, !get_flag(cpu, CARRY), cycs); }
+
+OPERATION(BCS) { branch(cpu, operand, get_flag(cpu, CARRY), cycs); }
+
+OPERATION(BEQ) { branch(cpu, operand, get_flag(cpu, ZERO), cycs); }
+
+OPERATION(BIT) {
+  byte_t mem = GETS(operand);
+  byte_t test = cpu->A & mem;
+  set_flag(cpu, ZERO, test == 0);
+  set_flag(cpu, OVERFLOW, get_nth_bit(mem, 6));
+  set_flag(cpu, NEGATIVE, get_nth_bit(mem, 7));
+}
+
+OPERATION(BMI) { branch(cpu, operand, get_flag(cpu, NEGATIVE), cycs); }
+
+OPERATION(BNE) { branch(cpu, operand, !get_flag(cpu, ZERO), cycs); }
+
+OPERATION(BPL) { branch(cpu, operand, !get_flag(cpu, NEGATIVE), cycs); }
+
+OPERATION(BRK) {
   push(cpu, high(cpu->PC + 1));
   push(cpu, low(cpu->PC + 1));
   bool original_brk = get_flag(cpu, BREAK);
   set_flag(cpu, BREAK, true);
   push(cpu, cpu->status);
   set_flag(cpu, BREAK, original_brk);
-  set_flag(cpu, INTERRUPT, true);  // I think?
-  cpu->PC = pack(GETS(NMI_VECTOR + 1), GETS(NMI_VECTOR));
+  set_flag(cpu, INTERRUPT, true);
+  cpu->PC = pack(GETS(BRK_VECTOR + 1), GETS(BRK_VECTOR));
+#ifdef DEBUG
+  printf("PC set to BRK vector %" PRIu16 "\n", cpu->PC);
+#endif
 }
 
-void cpu_irq(ucpu_t *cpu) {
-  if (get_flag(cpu, INTERRUPT))
-    return;  // ignore IRQs when interrupt disable is set
-  push(cpu, high(cpu->PC + 1));
-  push(cpu, low(cpu->PC + 1));
-  bool original_brk = get_flag(cpu, BREAK);
+OPERATION(BVC) { branch(cpu, operand, !get_flag(cpu, OVERFLOW), cycs); }
+
+OPERATION(BVS) { branch(cpu, operand, get_flag(cpu, OVERFLOW), cycs); }
+
+OPERATION(CLC) { set_flag(cpu, CARRY, false); }
+
+OPERATION(CLD) { set_flag(cpu, DECIMAL, false); }
+
+OPERATION(CLI) { set_flag(cpu, INTERRUPT, false); }
+
+OPERATION(CLV) { set_flag(cpu, OVERFLOW, false); }
+
+OPERATION(CMP) { compare(cpu, cpu->A, GETS(operand)); }
+
+OPERATION(CPX) { compare(cpu, cpu->X, GETS(operand)); }
+
+OPERATION(CPY) { compare(cpu, cpu->Y, GETS(operand)); }
+
+MODIFIER(DEC) {
+  byte_t res = val - 1;
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(DEC)
+
+OPERATION(DEX) {
+  cpu->X--;
+  set_zn(cpu, cpu->X);
+}
+
+OPERATION(DEY) {
+  cpu->Y--;
+  set_zn(cpu, cpu->Y);
+}
+
+OPERATION(EOR) {
+  cpu->A ^= GETS(operand);
+  set_zn(cpu, cpu->A);
+}
+
+MODIFIER(INC) {
+  byte_t res = val + 1;
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(INC)
+
+OPERATION(INX) {
+  cpu->X++;
+  set_zn(cpu, cpu->X);
+}
+
+OPERATION(INY) {
+  cpu->Y++;
+  set_zn(cpu, cpu->Y);
+}
+
+OPERATION(JMP) {
+  /*
+   * Taken from nesdev.org:
+   * An original 6502 has does not correctly fetch the
+   * target address if the indirect vector falls on a
+   * page boundary (e.g. $xxFF where xx is any value from
+   * $00 to $FF). In this case fetches the LSB from $xxFF
+   * as expected but takes the MSB from $xx00. This is
+   * fixed in some later chips like the 65SC02 so for
+   * compatibility always ensure the indirect vector is
+   * not at the end of the page.
+   */
+#ifdef DEBUG
+  printf("jump to %x\n", GETS(operand));
+#endif
+  if (mode == INDIR) {
+    // see http://www.6502.org/tutorials/6502opcodes.html#JMP
+    // ...'-_-...
+    uaddr_t operand_hi =
+        (operand & 0xFF00) + ((operand & 0xFF) + 1) % UCPU_PAGE_SZ;
+    cpu->PC = pack(GETS(operand_hi), GETS(operand));
+  } else {
+    cpu->PC = operand;
+  }
+}
+
+OPERATION(JSR) {
+  push(cpu, high(cpu->PC - 1));  // "-1" is NOT a typo.
+  push(cpu, low(cpu->PC - 1));
+  cpu->PC = operand;  // again, NOT a typo!!
+}
+
+OPERATION(LDA) {
+  cpu->A = GETS(operand);
+  set_zn(cpu, cpu->A);
+}
+
+OPERATION(LDX) {
+  cpu->X = GETS(operand);
+  set_zn(cpu, cpu->X);
+}
+
+OPERATION(LDY) {
+  cpu->Y = GETS(operand);
+  set_zn(cpu, cpu->Y);
+}
+
+MODIFIER(LSR) {
+  byte_t res = val >> 1;
+  set_flag(cpu, CARRY, val % 2);
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(LSR)
+
+OPERATION(NOP) {
+  if (mode != IMPL) {
+    GETS(operand);  // the read still happens, side effects and all
+  }
+}
+
+OPERATION(ORA) {
+  cpu->A |= GETS(operand);
+  set_zn(cpu, cpu->A);
+}
+
+OPERATION(PHA) { push(cpu, cpu->A); }
+
+OPERATION(PHP) {
+  // fifth bit always set before pushing
+  set_flag(cpu, FIVE, true);
+  // B always set when pushed via PHP
+  bool prev_brk = get_flag(cpu, BREAK);
   set_flag(cpu, BREAK, true);
   push(cpu, cpu->status);
-  set_flag(cpu, BREAK, original_brk);
-  set_flag(cpu, INTERRUPT, true);  // I think?
-  cpu->PC = pack(GETS(NMI_VECTOR + 1), GETS(NMI_VECTOR));
+  set_flag(cpu, BREAK, prev_brk);
+}
+
+OPERATION(PLA) {
+  cpu->A = pop(cpu);
+  set_zn(cpu, cpu->A);
 }
 
+OPERATION(PLP) {
+  bool prev_brk = get_flag(cpu, BREAK);
+  cpu->status = pop(cpu);
+  set_flag(cpu, FIVE, true);
+  set_flag(cpu, BREAK, prev_brk);  // ignore pulled BREAK flag
+}
+
+MODIFIER(ROL) {
+  uregr_t carry_r = (uregr_t)get_nth_bit(cpu->status, CARRY);
+  byte_t res = (val << 1) | carry_r;
+  set_flag(cpu, CARRY, get_nth_bit(val, 7));
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(ROL)
+
+MODIFIER(ROR) {
+  uregr_t carry = (uregr_t)get_nth_bit(cpu->status, CARRY);
+  byte_t res = (val >> 1) | (carry << 7);
+  set_flag(cpu, CARRY, get_nth_bit(val, 0));
+  set_zn(cpu, res);
+  return res;
+}
+
+MODIFY_OPERATION(ROR)
+
 /**
- * @brief
- *
- * @returns -1 if program terminates, 0 otherwise.
+ * @brief Pulls the status register the way RTI does.
  */
-int step(ucpu_t *cpu) {
-  // check if CPU is currently waiting on clock
-  if (cpu->cycs_left > 1) {
-    cpu->cycs_left--;  // indicate one more cycle has passed
-    return 0;
-  } else if (cpu->cycs_left == 0) {
-    // interpret the next instruction and reset the state machine
-    // get the current opcode
-    opcode_t op =
-        GETS(cpu->PC);  // asks the bus what byte is at position PC
-                        // and interprets this as the current instruction.
-#ifdef DEBUG
-    printf("op: %" PRIx8 " next: %" PRIx8 " %" PRIx8 " %" PRIx8 "\n",
-           GETS(cpu->PC), GETS(cpu->PC + 1), GETS(cpu->PC + 2),
-           GETS(cpu->PC + 3));
-    dump_cpu(stdout, cpu);
-#endif
-    // get the actual operation class
-    cpu->curr_canon = OPCODE_TO_CANONICAL[op];
-    if (cpu->curr_canon == O_DNE) {
-#ifdef DEBUG
-      fprintf(stderr, "Note: unrecognized instruction %x\n", op);
-      // At this point, instruction will almost certainly start
-      // diverging from a real emulator.
-      cpu->PC++;
-      fprintf(stderr, "PC: %" PRIx64 "\n", cpu->PC);
-      return 0;
-#elifdef CPU_TESTS
-      exit(3);
-#else
-      fprintf(stderr, "Unrecognized instruction %x, exiting!\n", op);
-      exit(3);
-#endif
-    }
-    // initialize number of cycles
-    cpu->cycs_left = OPCODE_TO_CYCLES[op] - 1;  // subtract 1 for current cycle
-
-    // get the addressing mode
-    cpu->curr_addr_mode = OPCODE_TO_ADDRMODE[op];
-
-    cpu->operand = NULLPTR;
-    cpu->accum = false;
-    cpu->indir = false;
-
-    // the goal is to be able to do get_byte(cpu->buslink, cpu->operand)
-    // and set_byte(cpu->buslink, cpu-<operand) and have it do the proper thing
-
-    // calculate everything
-    // note we also increment the PC here too
-    switch (cpu->curr_addr_mode) {
-      case REL:
-      case IMMED: {
-        cpu->operand = cpu->PC + 1;  // assume program has been assembled
-                                     // properly and that we can do this safely
-        cpu->PC += 2;                // remember to increment PC
-        break;
-      }
+UCPU_INLINE void pull_status(ucpu_t *cpu) {
+  ustat_t stat = pop(cpu);
+  bool orig_five = get_nth_bit(cpu->status, FIVE);
+  bool orig_brk = get_nth_bit(cpu->status, BREAK);
+  cpu->status = stat;
+  set_flag(cpu, BREAK, orig_brk);  // ignore pulled BREAK bit
+  set_flag(cpu, FIVE, orig_five);  // ditto
+}
 
-      case ZPAGE: {
-        cpu->operand =
-            GETS(cpu->PC + 1);  // implicit conversion from byte_t -> uaddr_t
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(RTI) {
+  pull_status(cpu);
+  uaddr_t low = pop(cpu);
+  uaddr_t high = pop(cpu);
+  cpu->PC = pack(high, low);
+}
 
-      case ZPAGE_X: {
-        cpu->operand = (GETS(cpu->PC + 1) + cpu->X) % 256;
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(RTS) {
+  byte_t low = pop(cpu);
+  byte_t high = pop(cpu);
+  cpu->PC = pack(high, low) + 1;
+}
 
-      case ZPAGE_Y: {
-        cpu->operand = (GETS(cpu->PC + 1) + cpu->Y) % 256;
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(SBC) { add_with_carry(cpu, ~GETS(operand)); }
 
-      case INDIR:
-        cpu->indir = true;
-      case ABS: {
-        cpu->operand = pack(GETS(cpu->PC + 2), GETS(cpu->PC + 1));
-        cpu->PC += 3;
-        break;
-      }
+OPERATION(SEC) { set_flag(cpu, CARRY, true); }
 
-      case INDIR_X: {
-        uaddr_t before_indir = (GETS(cpu->PC + 1) + cpu->X) % 256;
-        cpu->operand = pack(GETS((before_indir + 1) % 256), GETS(before_indir));
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(SED) { set_flag(cpu, DECIMAL, true); }
 
-      case ABS_X: {
-        uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->X;
-        cpu->operand = pack(GETS(cpu->PC + 2), indexed);
-        cpu->PC += 3;
-        break;
-      }
+OPERATION(SEI) { set_flag(cpu, INTERRUPT, true); }
 
-      case ABS_X_RO: {  // read-only instructions potentially take an extra
-                        // cycle
-        uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->X;
-        cpu->operand = pack(GETS(cpu->PC + 2), indexed);
-        if (indexed > 255) {  // page crossing
-          cpu->cycs_left++;
-        }
-        cpu->PC += 3;
-        break;
-      }
+OPERATION(STA) { SETS(operand, cpu->A); }
 
-      case INDIR_Y: {
-        uaddr_t before_indir = GETS(cpu->PC + 1);
-        uaddr_t after_indir =
-            pack(GETS((before_indir + 1) % 256), GETS(before_indir));
-        cpu->operand = after_indir + cpu->Y;
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(STX) { SETS(operand, cpu->X); }
 
-      case INDIR_Y_RO: {
-        uaddr_t before_indir = GETS(cpu->PC + 1);
-        uaddr_t after_indir =
-            pack(GETS((before_indir + 1) % 256), GETS(before_indir));
-        cpu->operand = after_indir + cpu->Y;
-        if (compare_pages(after_indir, cpu->operand) != 0) {
-          cpu->cycs_left++;
-        }
-        cpu->PC += 2;
-        break;
-      }
+OPERATION(STY) { SETS(operand, cpu->Y); }
 
-      case ABS_Y: {
-        uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->Y;
-        cpu->operand = pack(GETS(cpu->PC + 2), indexed);
-        cpu->PC += 3;
-        break;
-      }
+OPERATION(TAX) {
+  cpu->X = cpu->A;
+  set_zn(cpu, cpu->X);
+}
 
-      case ABS_Y_RO: {
-        uaddr_t indexed = (uaddr_t)GETS(cpu->PC + 1) + (uaddr_t)cpu->Y;
-        cpu->operand = pack(GETS(cpu->PC + 2), indexed);
-        if (indexed > 255) {  // page crossing
-          cpu->cycs_left++;
-        }
-        cpu->PC += 3;
-        break;
-      }
+OPERATION(TAY) {
+  cpu->Y = cpu->A;
+  set_zn(cpu, cpu->Y);
+}
 
-      case ACCUM: {
-        cpu->accum = true;
-        cpu->PC += 1;
-        break;
-      }
+OPERATION(TSX) {
+  cpu->X = cpu->S;
+  set_zn(cpu, cpu->X);
+}
 
-      default: {
-        cpu->PC += 1;
-      }
-    }
-    // wait the necessary number of cycles
-    return 0;
+OPERATION(TXA) {
+  cpu->A = cpu->X;
+  set_zn(cpu, cpu->A);
+}
+
+OPERATION(TXS) { cpu->S = cpu->X; }
+
+OPERATION(TYA) {
+  cpu->A = cpu->Y;
+  set_zn(cpu, cpu->A);
+}
+
+/* UNOFFICIAL OPERATIONS */
+
+/*
+ * Most unofficial opcodes are two official instructions sharing a single
+ * decode, and are written in terms of those (or of their modifiers).
+ */
+
+/**
+ * @brief Shared logic of SHA, SHX, SHY and TAS: stores `val` ANDed with one
+ * more than the high byte of the address before it was indexed. When the
+ * indexing crosses a page, the stored value also replaces the high byte of
+ * the address written to.
+ */
+UCPU_INLINE void store_and_high(ucpu_t *cpu, uaddr_t operand, byte_t index,
+                                byte_t val) {
+  uaddr_t base = operand - index;
+  byte_t res = val & (high(base) + 1);
+  if (high(base) != high(operand)) {
+    operand = pack(res, low(operand));
   }
-#ifdef DEBUG
-  printf("Executing...\n");
-#endif
-  // set clock to 0
-  cpu->cycs_left--;
-
-  // execute the instruction we were waiting on
-  // read the state machine!
-
-  // get the current opcode
-  opcode_t op = cpu->curr_canon;
-
-  // get the addressing mode
-  addr_mode_t addr_mode = cpu->curr_addr_mode;
-  uaddr_t operand = cpu->operand;
-  bool accum = cpu->accum;
-
-  switch (op) {
-    case O_ADC: {
-      // OVERFLOW BIT IS NOT SET PROPERLY
-      // Apparently 6502 decimal mode is not supported on the NES?
-      // If there are problems with ADC maybe refer back here.
-      byte_t oper = GETS(operand);
-      bool carry = get_flag(cpu, CARRY);
-      unsigned long addition = (unsigned long)cpu->A + oper + carry;
-      set_flag(cpu, CARRY, !!(addition & (1u << 8)));
-      // stolen from stackoverflow lmao
-      set_flag(cpu, OVERFLOW, ~(cpu->A ^ oper) & (cpu->A ^ addition) & 0x80);
-      cpu->A = (uregr_t)addition;
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+  SETS(operand, res);
+}
 
-    case O_AND: {
-      cpu->A &= GETS(operand);
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+OPERATION(ALR) {
+  do_AND(cpu, operand, mode, cycs);
+  do_LSR(cpu, NULLPTR, ACCUM, cycs);
+}
 
-    case O_ASL: {  // a bit messy...
-      byte_t val;
-      if (cpu->accum) {
-        val = cpu->A;
-        cpu->A = cpu->A << 1;
-        set_flag(cpu, CARRY, !!(val >> 7));
-        set_flag(cpu, ZERO, cpu->A == 0);
-        set_flag(cpu, NEGATIVE, !sign(cpu->A));
-        break;
-      }
-      val = GETS(operand);
-      SETS(operand, (val << 1));
-      set_flag(cpu, CARRY, !!(val >> 7));
-      set_flag(cpu, ZERO, GETS(operand) == 0);
-      set_flag(cpu, NEGATIVE, !sign(GETS(operand)));
-      break;
-    }
+OPERATION(ANC) {
+  do_AND(cpu, operand, mode, cycs);
+  set_flag(cpu, CARRY, get_flag(cpu, NEGATIVE));
+}
 
-    case O_BCC: {
-      // if carry bit clear... <==> cpu->C == 0??
-      if (!get_flag(cpu, CARRY) || cpu->deferred) {
-        offset_t off = (offset_t)get_byte(cpu->buslink, operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+OPERATION(ANE) {
+  cpu->A = (cpu->A | UNSTABLE_MAGIC) & cpu->X & GETS(operand);
+  set_zn(cpu, cpu->A);
+}
 
-    case O_BCS: {
-      if (get_flag(cpu, CARRY) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+OPERATION(ARR) {
+  cpu->A &= GETS(operand);
+  do_ROR(cpu, NULLPTR, ACCUM, cycs);
+  bool six = get_nth_bit(cpu->A, 6);
+  set_flag(cpu, CARRY, six);
+  set_flag(cpu, OVERFLOW, six ^ get_nth_bit(cpu->A, 5));
+}
 
-    case O_BEQ: {
-      if (get_flag(cpu, ZERO) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+OPERATION(AXS) {
+  uregr_t both = cpu->A & cpu->X;
+  byte_t val = GETS(operand);
+  compare(cpu, both, val);
+  cpu->X = both - val;
+}
 
-    case O_BIT: {
-      byte_t mem = GETS(operand);
-      byte_t test = cpu->A & mem;
-      set_flag(cpu, ZERO, test == 0);
-      set_flag(cpu, OVERFLOW, get_nth_bit(mem, 6));
-      set_flag(cpu, NEGATIVE, get_nth_bit(mem, 7));
-      break;
-    }
+MODIFIER(DCP) {
+  byte_t res = val - 1;
+  compare(cpu, cpu->A, res);
+  return res;
+}
 
-    case O_BMI: {
-      if (get_flag(cpu, NEGATIVE) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+MODIFY_OPERATION(DCP)
 
-    case O_BNE: {
-      if (!get_flag(cpu, ZERO) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+MODIFIER(ISC) {
+  byte_t res = val + 1;
+  add_with_carry(cpu, ~res);
+  return res;
+}
 
-    case O_BPL: {
-      if (!get_flag(cpu, NEGATIVE) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+MODIFY_OPERATION(ISC)
 
-    case O_BVC: {
-      if (!get_flag(cpu, OVERFLOW) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+OPERATION(LAS) {
+  cpu->S &= GETS(operand);
+  cpu->A = cpu->X = cpu->S;
+  set_zn(cpu, cpu->A);
+}
 
-    case O_BVS: {
-      if (get_flag(cpu, OVERFLOW) || cpu->deferred) {
-        offset_t off = (offset_t)GETS(operand);
-        clk_t cycs = compare_pages(cpu->PC, cpu->PC + off) == 0 ? 1 : 2;
-        DEFER(cpu, cycs);
-        cpu->PC += off;
-        cpu->deferred = false;
-      }
-      break;
-    }
+OPERATION(LAX) {
+  do_LDA(cpu, operand, mode, cycs);
+  cpu->X = cpu->A;
+}
 
-    case O_CLC: {
-      set_flag(cpu, CARRY, false);
-      break;
-    }
+OPERATION(LXA) {
+  cpu->A = cpu->X = (cpu->A | UNSTABLE_MAGIC) & GETS(operand);
+  set_zn(cpu, cpu->A);
+}
 
-    case O_CLD: {
-      set_flag(cpu, DECIMAL, false);
-      break;
-    }
+MODIFIER(RLA) {
+  byte_t res = mod_ROL(cpu, val);
+  cpu->A &= res;
+  set_zn(cpu, cpu->A);
+  return res;
+}
 
-    case O_CLI: {
-      set_flag(cpu, INTERRUPT, false);
-      break;
-    }
+MODIFY_OPERATION(RLA)
 
-    case O_CLV: {
-      set_flag(cpu, OVERFLOW, false);
-      break;
-    }
+MODIFIER(RRA) {
+  byte_t res = mod_ROR(cpu, val);
+  add_with_carry(cpu, res);
+  return res;
+}
 
-    case O_CMP: {
-      byte_t oper = GETS(operand);
-      byte_t comparison = cpu->A - oper;
-      set_flag(cpu, CARRY, cpu->A >= oper);
-      set_flag(cpu, ZERO, comparison == 0);
-      set_flag(cpu, NEGATIVE, !sign(comparison));
-      break;
-    }
+MODIFY_OPERATION(RRA)
 
-    case O_CPX: {
-      byte_t oper = GETS(operand);
-      byte_t comparison = cpu->X - oper;
-      set_flag(cpu, CARRY, cpu->X >= oper);
-      set_flag(cpu, ZERO, comparison == 0);
-      set_flag(cpu, NEGATIVE, !sign(comparison));
-      break;
-    }
+OPERATION(SAX) { SETS(operand, cpu->A & cpu->X); }
 
-    case O_CPY: {
-      byte_t oper = GETS(operand);
-      byte_t comparison = cpu->Y - oper;
-      set_flag(cpu, CARRY, cpu->Y >= oper);
-      set_flag(cpu, ZERO, comparison == 0);
-      set_flag(cpu, NEGATIVE, !sign(comparison));
-      break;
-    }
+OPERATION(SHA) { store_and_high(cpu, operand, cpu->Y, cpu->A & cpu->X); }
 
-    case O_DEC: {
-      SETS(operand, GETS(operand) - 1);
-      set_flag(cpu, ZERO, GETS(operand) == 0);
-      set_flag(cpu, NEGATIVE, !sign(GETS(operand)));
-      break;
-    }
+OPERATION(SHX) { store_and_high(cpu, operand, cpu->Y, cpu->X); }
 
-    case O_DEX: {
-      cpu->X--;
-      set_flag(cpu, ZERO, cpu->X == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->X));
-      break;
-    }
+OPERATION(SHY) { store_and_high(cpu, operand, cpu->X, cpu->Y); }
 
-    case O_DEY: {
-      cpu->Y--;
-      set_flag(cpu, ZERO, cpu->Y == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->Y));
-      break;
-    }
+MODIFIER(SLO) {
+  byte_t res = mod_ASL(cpu, val);
+  cpu->A |= res;
+  set_zn(cpu, cpu->A);
+  return res;
+}
 
-    case O_EOR: {
-      cpu->A ^= GETS(operand);
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+MODIFY_OPERATION(SLO)
 
-    case O_INC: {
-      SETS(operand, GETS(operand) + 1);
-      set_flag(cpu, ZERO, GETS(operand) == 0);
-      set_flag(cpu, NEGATIVE, !sign(GETS(operand)));
-      break;
-    }
+MODIFIER(SRE) {
+  byte_t res = mod_LSR(cpu, val);
+  cpu->A ^= res;
+  set_zn(cpu, cpu->A);
+  return res;
+}
 
-    case O_INX: {
-      cpu->X++;
-      set_flag(cpu, ZERO, cpu->X == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->X));
-      break;
-    }
+MODIFY_OPERATION(SRE)
 
-    case O_INY: {
-      cpu->Y++;
-      set_flag(cpu, ZERO, cpu->Y == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->Y));
-      break;
-    }
+OPERATION(TAS) {
+  cpu->S = cpu->A & cpu->X;
+  store_and_high(cpu, operand, cpu->Y, cpu->S);
+}
 
-    case O_JMP: {
-      /*
-       * Taken from nesdev.org:
-       * An original 6502 has does not correctly fetch the
-       * target address if the indirect vector falls on a
-       * page boundary (e.g. $xxFF where xx is any value from
-       * $00 to $FF). In this case fetches the LSB from $xxFF
-       * as expected but takes the MSB from $xx00. This is
-       * fixed in some later chips like the 65SC02 so for
-       * compatibility always ensure the indirect vector is
-       * not at the end of the page.
-       */
+/**
+ * @brief Locks the CPU up on the opcode just fetched, recording where.
+ * Kept out of line: it is only ever reached by a broken (or deliberately
+ * halting) program.
+ */
+static __attribute__((cold, noinline)) void jam(ucpu_t *cpu) {
+  cpu->PC--;  // stay put; every later dispatch lands here again
+  if (cpu->err != ERR_JAM) {
+    cpu->err = ERR_JAM;
+    cpu->fault_pc = cpu->PC;
+    cpu->fault_op = GETS(cpu->PC);
 #ifdef DEBUG
-      printf("jump to %x\n", GETS(operand));
+    fprintf(stderr, "CPU jammed on opcode %" PRIx8 " at PC %" PRIx16 "\n",
+            cpu->fault_op, cpu->fault_pc);
 #endif
-      if (cpu->indir) {
-        // see http://www.6502.org/tutorials/6502opcodes.html#JMP
-        // ...'-_-...
-        uaddr_t operand_hi =
-            (operand & 0xFF00) + ((operand & 0xFF) + 1) % UCPU_PAGE_SZ;
-        cpu->PC = pack(GETS(operand_hi), GETS(operand));
-      } else {
-        cpu->PC = operand;
-      }
-      break;
-    }
+  }
+}
 
-    case O_JSR: {
-      push(cpu, high(cpu->PC - 1));  // "-1" is NOT a typo.
-      push(cpu, low(cpu->PC - 1));
-      cpu->PC = operand;  // again, NOT a typo!!
-      break;
-    }
+OPERATION(JAM) {
+  jam(cpu);
+  *cycs = JAM_CYCS;
+}
 
-    case O_LDA: {
-      cpu->A = GETS(operand);
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+/* DISPATCH */
 
-    case O_LDX: {
-      cpu->X = GETS(operand);
-      set_flag(cpu, ZERO, cpu->X == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->X));
-      break;
-    }
+/*
+ * One handler per opcode, with its addressing mode and operation baked in.
+ *
+ * @returns the number of cycles the instruction took.
+ */
+#define HANDLER(code, mnem, mode, base, kind) \
+  UCPU_INLINE clk_t op_##code(ucpu_t *cpu) {  \
+    clk_t cycs = base;                        \
+    uaddr_t operand = am_##mode(cpu, &cycs);  \
+    do_##mnem(cpu, operand, mode, &cycs);     \
+    return cycs;                              \
+  }
+UCPU_OPCODES(HANDLER)
+#undef HANDLER
 
-    case O_LDY: {
-      cpu->Y = GETS(operand);
-      set_flag(cpu, ZERO, cpu->Y == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->Y));
-      break;
-    }
+typedef clk_t (*handler_t)(ucpu_t *cpu);
 
-    case O_LSR: {  // a bit messy...
-      set_flag(cpu, NEGATIVE, false);
-      if (cpu->accum) {
-        bool carry = cpu->A % 2;
-        cpu->A = cpu->A >> 1;
-        set_flag(cpu, CARRY, carry);
-        set_flag(cpu, ZERO, cpu->A == 0);
-        break;
-      }
-      bool carry = GETS(operand) % 2;
-      SETS(operand, GETS(operand) >> 1);
-      set_flag(cpu, CARRY, carry);
-      set_flag(cpu, ZERO, GETS(operand) == 0);
-      break;
-    }
+/*
+ * Mapping from opcode to its handler
+ */
+#define HANDLER_ENTRY(code, mnem, mode, base, kind) [code] = op_##code,
+static const handler_t OPCODE_TO_HANDLER[] = {UCPU_OPCODES(HANDLER_ENTRY)};
+#undef HANDLER_ENTRY
 
-    case O_ORA: {
-      cpu->A |= GETS(operand);
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+/**
+ * @brief Checks for an interrupt the CPU should take before its next
+ * instruction.
+ *
+ * NMIs are edge-triggered, so noticing one clears the bus's NMI line; IRQs
+ * are level-triggered, and are taken for as long as a device holds the
+ * line and the I flag is clear.
+ *
+ * @returns the vector of the interrupt to take, or 0 if there is none.
+ */
+UCPU_INLINE uaddr_t pending_interrupt(ucpu_t *cpu) {
+  bus_t *bus = cpu->buslink.bus;
+  if (__builtin_expect(!(bus->nmi | bus->irq), 1) || cpu_jammed(cpu)) {
+    return 0;
+  }
 
-    case O_PHA: {
-      push(cpu, cpu->A);
-      break;
-    }
+  if (bus->nmi) {
+    bus->nmi = false;
+    return NMI_VECTOR;
+  }
+  return get_flag(cpu, INTERRUPT) ? 0 : IRQ_VECTOR;
+}
 
-    case O_PHP: {
-      // fifth bit always set before pushing
-      set_flag(cpu, FIVE, true);
-      // B always set when pushed via PHP
-      bool prev_brk = get_flag(cpu, BREAK);
-      set_flag(cpu, BREAK, true);
-      push(cpu, cpu->status);
-      set_flag(cpu, BREAK, prev_brk);
-      break;
-    }
+/**
+ * @brief Takes a pending interrupt, if there is one. Called between
+ * instructions.
+ *
+ * @returns the number of cycles entering the handler took, or 0 if no
+ * interrupt was taken.
+ */
+UCPU_INLINE clk_t poll_interrupts(ucpu_t *cpu) {
+  uaddr_t vector = pending_interrupt(cpu);
+  if (__builtin_expect(!vector, 1)) {
+    return 0;
+  }
+  interrupt(cpu, vector);
+  return INTERRUPT_CYCS;
+}
 
-    case O_PLA: {
-      cpu->A = pop(cpu);
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+/**
+ * @brief Executes the whole instruction at PC, or enters the handler of a
+ * pending interrupt instead.
+ *
+ * @returns the number of cycles the instruction took.
+ */
+UCPU_INLINE clk_t dispatch(ucpu_t *cpu) {
+  clk_t cycs = poll_interrupts(cpu);
+  if (cycs) {
+    return cycs;
+  }
 
-    case O_PLP: {
-      bool prev_brk = get_flag(cpu, BREAK);
-      cpu->status = pop(cpu);
-      set_flag(cpu, FIVE, true);
-      set_flag(cpu, BREAK, prev_brk);  // ignore pulled BREAK flag
-      break;
-    }
+  byte_t op = GETS(cpu->PC);  // asks the bus what byte is at position PC
+                              // and interprets this as the current
+                              // instruction.
+#ifdef DEBUG
+  printf("op: %" PRIx8 " next: %" PRIx8 " %" PRIx8 " %" PRIx8 "\n", op,
+         GETS(cpu->PC + 1), GETS(cpu->PC + 2), GETS(cpu->PC + 3));
+  dump_cpu(stdout, cpu);
+#endif
+  return OPCODE_TO_HANDLER[op](cpu);
+}
 
-    case O_ROL: {
-      uregr_t carry_r = (uregr_t)get_nth_bit(cpu->status, CARRY);
-      if (cpu->accum) {
-        set_flag(cpu, CARRY, get_nth_bit(cpu->A, 7));
-        cpu->A <<= 1;  // you can do this?! :O
-        cpu->A |= carry_r;
-        set_flag(cpu, NEGATIVE, !sign(cpu->A));
-        set_flag(cpu, ZERO, cpu->A == 0);
-      } else {
-        set_flag(cpu, CARRY, get_nth_bit(GETS(operand), 7));
-        SETS(operand, (GETS(operand) << 1) | carry_r);
-        set_flag(cpu, NEGATIVE, !sign(GETS(operand)));
-        set_flag(cpu, ZERO, GETS(operand) == 0);
-      }
-      break;
-    }
+/* CYCLE-STEPPED CORE */
 
-    case O_ROR: {
-      uregr_t carry = (uregr_t)get_nth_bit(cpu->status, CARRY);
-      if (cpu->accum) {
-        set_flag(cpu, CARRY, get_nth_bit(cpu->A, 0));
-        cpu->A >>= 1;  // wheee
-        cpu->A |= (carry << 7);
-        set_flag(cpu, NEGATIVE, !sign(cpu->A));
-        set_flag(cpu, ZERO, cpu->A == 0);
-      } else {
-        set_flag(cpu, CARRY, get_nth_bit(GETS(operand), 0));
-        SETS(operand, (GETS(operand) >> 1) | (carry << 7));
-        set_flag(cpu, NEGATIVE, !sign(GETS(operand)));
-        set_flag(cpu, ZERO, GETS(operand) == 0);
-      }
-      break;
-    }
+/*
+ * The shapes an instruction's bus activity comes in (the last column of
+ * UCPU_OPCODES). Instructions with an operand in memory first form its
+ * address, the same way as every other instruction with their addressing
+ * mode, and then read it, write it, or read it and write it back twice.
+ */
+typedef enum {
+  KIND_READ,
+  KIND_WRITE,
+  KIND_MODIFY,
+  KIND_IMPLIED,  // no operand, or the accumulator
+  KIND_PUSH,     // PHA, PHP
+  KIND_PULL,     // PLA, PLP
+  KIND_BRANCH,
+  KIND_JUMP,    // JMP, either mode
+  KIND_CALL,    // JSR
+  KIND_RETURN,  // RTS
+  KIND_RETI,    // RTI
+  KIND_BREAK,   // BRK, and entering NMI and IRQ handlers
+  KIND_HALT     // JAM
+} micro_kind_t;
 
-    case O_RTI: {
-      ustat_t stat = pop(cpu);
-      bool orig_five = get_nth_bit(cpu->status, FIVE);
-      bool orig_brk = get_nth_bit(cpu->status, BREAK);
-      cpu->status = stat;
-      set_flag(cpu, BREAK, orig_brk);  // ignore pulled BREAK bit
-      set_flag(cpu, FIVE, orig_five);  // ditto
-      uaddr_t low = pop(cpu);
-      uaddr_t high = pop(cpu);
-      cpu->PC = pack(high, low);
-      break;
-    }
+/*
+ * The part of an instruction the cycle-stepped core leaves to the
+ * operations above, run on the cycle it happens on. Modifiers transform
+ * `val` and return the result; everything else makes its own access to
+ * `addr`, if it has one.
+ */
+typedef byte_t (*micro_fn_t)(ucpu_t *cpu, uaddr_t addr, byte_t val);
+
+typedef struct micro {
+  addr_mode_t mode;
+  micro_kind_t kind;
+  micro_fn_t exec;
+} micro_t;
+
+#define MICRO_OPERATION(code, mnem, mode)                             \
+  static byte_t micro_##code(ucpu_t *cpu, uaddr_t addr, byte_t val) { \
+    clk_t cycs = 0;                                                   \
+    do_##mnem(cpu, addr, mode, &cycs);                                \
+    return val;                                                       \
+  }
+#define MICRO_MODIFIER(code, mnem, mode)                              \
+  static byte_t micro_##code(ucpu_t *cpu, uaddr_t addr, byte_t val) { \
+    return mod_##mnem(cpu, val);                                      \
+  }
 
-    case O_RTS: {
-      byte_t low = pop(cpu);
-      byte_t high = pop(cpu);
-      cpu->PC = pack(high, low) + 1;
-      break;
-    }
+// only read-modify-write instructions need their modifier
+#define MICRO_READ MICRO_OPERATION
+#define MICRO_WRITE MICRO_OPERATION
+#define MICRO_MODIFY MICRO_MODIFIER
+#define MICRO_IMPLIED MICRO_OPERATION
+#define MICRO_PUSH MICRO_OPERATION
+#define MICRO_PULL MICRO_OPERATION
+#define MICRO_BRANCH MICRO_OPERATION
+#define MICRO_JUMP MICRO_OPERATION
+#define MICRO_CALL MICRO_OPERATION
+#define MICRO_RETURN MICRO_OPERATION
+#define MICRO_RETI MICRO_OPERATION
+#define MICRO_BREAK MICRO_OPERATION
+#define MICRO_HALT MICRO_OPERATION
+
+#define MICRO(code, mnem, mode, base, kind) MICRO_##kind(code, mnem, mode)
+UCPU_OPCODES(MICRO)
+#undef MICRO
 
-    case O_SBC: {  // surely the most beautiful code ever that surely works 100%
-                   // fine
-      byte_t oper = ~GETS(operand);
-      bool carry = get_flag(cpu, CARRY);
-      unsigned long addition = (unsigned long)cpu->A + oper + carry;
-      set_flag(cpu, CARRY, !!(addition & (1u << 8)));
-      // stolen from stackoverflow lmao
-      set_flag(cpu, OVERFLOW, ~(cpu->A ^ oper) & (cpu->A ^ addition) & 0x80);
-      cpu->A = (uregr_t)addition;
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+/*
+ * Mapping from opcode to its microcode
+ */
+#define MICRO_ENTRY(code, mnem, mode, base, kind) \
+  [code] = {mode, KIND_##kind, micro_##code},
+static const micro_t OPCODE_TO_MICRO[] = {UCPU_OPCODES(MICRO_ENTRY)};
+#undef MICRO_ENTRY
 
-    case O_SEC: {
-      set_flag(cpu, CARRY, true);
-      break;
-    }
+/**
+ * @brief The cycle after an indexed address is formed, when the CPU reads
+ * from it before the carry out of the low byte has reached the high byte.
+ * Read-only instructions keep that read as their own if there was no
+ * carry; every other instruction, and any that crossed a page, throws it
+ * away.
+ *
+ * @returns true if the read was the instruction's own, i.e. the cycle is
+ * left for the instruction's access.
+ */
+UCPU_INLINE bool fix_page(ucpu_t *cpu, bool read_only) {
+  if (read_only && high(cpu->ptr) == high(cpu->addr)) {
+    return true;
+  }
+  GETS(pack(high(cpu->ptr), low(cpu->addr)));
+  return false;
+}
 
-    case O_SED: {
-      set_flag(cpu, DECIMAL, true);
-      break;
-    }
+/**
+ * @brief Runs a cycle of forming the effective address in `mode`.
+ *
+ * @returns false if the cycle went to forming it, or true if it was
+ * already formed, leaving the cycle for the access itself.
+ */
+UCPU_INLINE bool form_address(ucpu_t *cpu, addr_mode_t mode) {
+  byte_t t = cpu->tick;
+  switch (mode) {
+    case IMMED:
+      cpu->addr = cpu->PC++;
+      return true;
+
+    case ZPAGE:
+      if (t == 2) {
+        cpu->addr = GETS(cpu->PC++);
+        return false;
+      }
+      return true;
+
+    case ZPAGE_X:
+    case ZPAGE_Y:
+      if (t == 2) {
+        cpu->addr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        GETS(cpu->addr);  // read while the index is added
+        cpu->addr = (cpu->addr + (mode == ZPAGE_X ? cpu->X : cpu->Y)) % 256;
+        return false;
+      }
+      return true;
+
+    case ABS:
+      if (t == 2) {
+        cpu->addr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        cpu->addr = pack(GETS(cpu->PC++), cpu->addr);
+        return false;
+      }
+      return true;
+
+    case ABS_X:
+    case ABS_X_RO:
+    case ABS_Y:
+    case ABS_Y_RO:
+      if (t == 2) {
+        cpu->ptr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        cpu->ptr = pack(GETS(cpu->PC++), cpu->ptr);
+        bool x = mode == ABS_X || mode == ABS_X_RO;
+        cpu->addr = cpu->ptr + (x ? cpu->X : cpu->Y);
+        return false;
+      } else if (t == 4) {
+        return fix_page(cpu, mode == ABS_X_RO || mode == ABS_Y_RO);
+      }
+      return true;
+
+    case INDIR_X:
+      if (t == 2) {
+        cpu->ptr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        GETS(cpu->ptr);  // read while the index is added
+        cpu->ptr = (cpu->ptr + cpu->X) % 256;
+        return false;
+      } else if (t == 4) {
+        cpu->addr = GETS(cpu->ptr);
+        return false;
+      } else if (t == 5) {
+        cpu->addr = pack(GETS((cpu->ptr + 1) % 256), cpu->addr);
+        return false;
+      }
+      return true;
+
+    case INDIR_Y:
+    case INDIR_Y_RO:
+      if (t == 2) {
+        cpu->ptr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        cpu->addr = GETS(cpu->ptr);
+        return false;
+      } else if (t == 4) {
+        cpu->ptr = pack(GETS((cpu->ptr + 1) % 256), cpu->addr);
+        cpu->addr = cpu->ptr + cpu->Y;
+        return false;
+      } else if (t == 5) {
+        return fix_page(cpu, mode == INDIR_Y_RO);
+      }
+      return true;
 
-    case O_SEI: {
+    default:
+      return true;
+  }
+}
+
+/**
+ * @brief Runs a cycle of accessing the operand, once its address is
+ * formed. Read-modify-write instructions read it, write it back unchanged
+ * while they modify it, and then write the result.
+ *
+ * @returns true if the instruction finished on this cycle.
+ */
+UCPU_INLINE bool access_operand(ucpu_t *cpu, const micro_t *m) {
+  cpu->access++;
+  if (m->kind != KIND_MODIFY) {
+    m->exec(cpu, cpu->addr, 0);
+    return true;
+  }
+
+  if (cpu->access == 1) {
+    cpu->data = GETS(cpu->addr);
+    return false;
+  } else if (cpu->access == 2) {
+    SETS(cpu->addr, cpu->data);
+    cpu->data = m->exec(cpu, cpu->addr, cpu->data);
+    return false;
+  }
+  SETS(cpu->addr, cpu->data);
+  return true;
+}
+
+/**
+ * @brief Whether the branch in flight is taken. Bits 7-6 of a branch's
+ * opcode select the flag it tests, and bit 5 the value it branches on.
+ */
+UCPU_INLINE bool branch_taken(ucpu_t *cpu) {
+  static const flag_t FLAGS[] = {NEGATIVE, OVERFLOW, CARRY, ZERO};
+  return get_flag(cpu, FLAGS[cpu->op >> 6]) == !!(cpu->op & 0x20);
+}
+
+/**
+ * @brief Runs a cycle of BRK, or of entering an interrupt handler, which
+ * is BRK with the opcode fetch thrown away and B pushed clear.
+ */
+static bool tick_break(ucpu_t *cpu) {
+  switch (cpu->tick) {
+    case 2:
+      GETS(cpu->PC);
+      if (cpu->vector) {
+        cpu->data = (cpu->status & ~(1u << BREAK)) | (1u << FIVE);
+      } else {
+        cpu->PC++;  // BRK skips a padding byte
+        cpu->vector = BRK_VECTOR;
+        cpu->data = cpu->status | (1u << BREAK);
+      }
+      return false;
+    case 3:
+      push(cpu, high(cpu->PC));
+      return false;
+    case 4:
+      push(cpu, low(cpu->PC));
+      return false;
+    case 5:
+      push(cpu, cpu->data);
       set_flag(cpu, INTERRUPT, true);
-      break;
-    }
+      return false;
+    case 6:
+      cpu->addr = GETS(cpu->vector);
+      return false;
+  }
+  cpu->PC = pack(GETS(cpu->vector + 1), cpu->addr);
+  cpu->vector = 0;
+  return true;
+}
 
-    case O_STA: {
-      SETS(operand, cpu->A);
-      break;
-    }
+/**
+ * @brief Runs one cycle, after the first, of the instruction in flight.
+ *
+ * @returns true if the instruction finished on this cycle.
+ */
+static bool tick(ucpu_t *cpu) {
+  const micro_t *m = &OPCODE_TO_MICRO[cpu->op];
+  byte_t t = ++cpu->tick;
+
+  switch (m->kind) {
+    case KIND_READ:
+    case KIND_WRITE:
+    case KIND_MODIFY:
+      if (!cpu->access && !form_address(cpu, m->mode)) {
+        return false;
+      }
+      return access_operand(cpu, m);
 
-    case O_STX: {
-      SETS(operand, cpu->X);
-      break;
-    }
+    case KIND_IMPLIED:
+      GETS(cpu->PC);  // the byte after the opcode is read and ignored
+      m->exec(cpu, NULLPTR, 0);
+      return true;
 
-    case O_STY: {
-      SETS(operand, cpu->Y);
-      break;
-    }
+    case KIND_PUSH:
+      if (t == 2) {
+        GETS(cpu->PC);
+        return false;
+      }
+      m->exec(cpu, NULLPTR, 0);
+      return true;
+
+    case KIND_PULL:
+      if (t == 2) {
+        GETS(cpu->PC);
+        return false;
+      } else if (t == 3) {
+        GETS(STACK_OFFSET + cpu->S);  // read while S is incremented
+        return false;
+      }
+      m->exec(cpu, NULLPTR, 0);
+      return true;
+
+    case KIND_BRANCH:
+      if (t == 2) {
+        cpu->data = GETS(cpu->PC++);
+        return !branch_taken(cpu);
+      } else if (t == 3) {
+        GETS(cpu->PC);
+        cpu->ptr = cpu->PC + (offset_t)cpu->data;
+        cpu->PC = pack(high(cpu->PC), low(cpu->ptr));
+        return cpu->PC == cpu->ptr;
+      }
+      GETS(cpu->PC);  // from the wrong page
+      cpu->PC = cpu->ptr;
+      return true;
+
+    case KIND_JUMP:
+      if (t == 2) {
+        cpu->ptr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        cpu->ptr = pack(GETS(cpu->PC++), cpu->ptr);
+        if (m->mode == ABS) {
+          cpu->PC = cpu->ptr;
+          return true;
+        }
+        return false;
+      } else if (t == 4) {
+        cpu->addr = GETS(cpu->ptr);
+        return false;
+      }
+      // the pointer's high byte never carries over (see JMP)
+      cpu->PC = pack(GETS(pack(high(cpu->ptr), (byte_t)(cpu->ptr + 1))),
+                     cpu->addr);
+      return true;
+
+    case KIND_CALL:
+      if (t == 2) {
+        cpu->addr = GETS(cpu->PC++);
+        return false;
+      } else if (t == 3) {
+        GETS(STACK_OFFSET + cpu->S);
+        return false;
+      } else if (t == 4) {
+        push(cpu, high(cpu->PC));
+        return false;
+      } else if (t == 5) {
+        push(cpu, low(cpu->PC));
+        return false;
+      }
+      cpu->PC = pack(GETS(cpu->PC), cpu->addr);
+      return true;
+
+    case KIND_RETURN:
+    case KIND_RETI:
+      if (t == 2) {
+        GETS(cpu->PC);
+        return false;
+      } else if (t == 3) {
+        GETS(STACK_OFFSET + cpu->S);
+        return false;
+      }
+      if (m->kind == KIND_RETI) {
+        t--;  // one cycle in for the status, so one behind from here on
+        if (t == 3) {
+          pull_status(cpu);
+          return false;
+        }
+      }
+      if (t == 4) {
+        cpu->addr = pop(cpu);
+        return false;
+      } else if (t == 5) {
+        cpu->PC = pack(pop(cpu), cpu->addr);
+        return m->kind == KIND_RETI;
+      }
+      GETS(cpu->PC++);  // RTS returns past the last byte of the JSR
+      return true;
 
-    case O_TAX: {
-      cpu->X = cpu->A;
-      set_flag(cpu, ZERO, cpu->X == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->X));
-      break;
-    }
+    case KIND_BREAK:
+      return tick_break(cpu);
 
-    case O_TAY: {
-      cpu->Y = cpu->A;
-      set_flag(cpu, ZERO, cpu->Y == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->Y));
-      break;
-    }
+    case KIND_HALT:
+    default:
+      m->exec(cpu, NULLPTR, 0);
+      return true;
+  }
+}
 
-    case O_TSX: {
-      cpu->X = cpu->S;
-      set_flag(cpu, ZERO, cpu->X == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->X));
-      break;
+/**
+ * @brief Runs one cycle on the cycle-stepped core. The first cycle of
+ * every instruction fetches its opcode, or, if an interrupt is pending,
+ * throws it away and starts entering the handler instead.
+ *
+ * @returns true if an instruction finished on this cycle, or if the CPU is
+ * jammed.
+ */
+static bool cycle(ucpu_t *cpu) {
+  if (cpu->tick) {
+    bool done = tick(cpu);
+    if (done) {
+      cpu->tick = 0;
     }
+    return done;
+  }
 
-    case O_TXA: {
-      cpu->A = cpu->X;
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+  if (cpu_jammed(cpu)) {
+    return true;
+  }
+  cpu->tick = 1;
+  cpu->access = 0;
+  cpu->vector = pending_interrupt(cpu);
+  if (cpu->vector) {
+    cpu->op = 0x00;  // run as BRK
+    GETS(cpu->PC);
+  } else {
+    cpu->op = GETS(cpu->PC++);
+  }
+  return false;
+}
 
-    case O_TXS: {
-      cpu->S = cpu->X;
-      break;
+/**
+ * @brief Advances the CPU by a single clock cycle.
+ *
+ * On the fast core, an instruction's logic runs in full on its first
+ * cycle, and the cycles after that are spent waiting on the clock. On the
+ * cycle-stepped core, each cycle makes that cycle's bus access. Either
+ * way, the clock only moves on once the cycle is over.
+ *
+ * @returns STEP_DONE if an instruction finished on this cycle, STEP_JAMMED
+ * if the CPU is jammed instead, and STEP_BUSY otherwise.
+ */
+int step(ucpu_t *cpu) {
+  bool done;
+  if (cpu->tick || (cpu->core == CPU_CYCLE && cpu->cycs_left == 0)) {
+    done = cycle(cpu);
+  } else {
+    if (cpu->cycs_left == 0) {
+      // interpret the next instruction and reset the state machine
+      cpu->cycs_left = dispatch(cpu);
     }
+    cpu->cycs_left--;  // indicate one more cycle has passed
+    done = cpu->cycs_left == 0;
+  }
+  cpu->clock++;
 
-    case O_TYA: {
-      cpu->A = cpu->Y;
-      set_flag(cpu, ZERO, cpu->A == 0);
-      set_flag(cpu, NEGATIVE, !sign(cpu->A));
-      break;
-    }
+  if (!done) {
+    return STEP_BUSY;
+  }
+  if (cpu_jammed(cpu)) {
+    return STEP_JAMMED;
+  }
+  cpu->instrs++;
+  return STEP_DONE;
+}
 
-    case O_BRK: {
-      push(cpu, high(cpu->PC + 1));
-      push(cpu, low(cpu->PC + 1));
-      bool original_brk = get_flag(cpu, BREAK);
-      set_flag(cpu, BREAK, true);
-      push(cpu, cpu->status);
-      set_flag(cpu, BREAK, original_brk);
-      set_flag(cpu, INTERRUPT, true);
-      cpu->PC = pack(GETS(BRK_VECTOR + 1), GETS(BRK_VECTOR));
-#ifdef DEBUG
-      printf("PC set to BRK vector %" PRIu16 "\n", cpu->PC);
-#endif
-      break;
+/**
+ * @brief Runs the CPU for at least `budget` cycles, executing whole
+ * instructions back-to-back rather than ticking once per cycle.
+ *
+ * An instruction left in flight by step() is finished first, so the two
+ * entry points can be mixed freely. A CPU on the cycle-stepped core is
+ * stepped through the whole budget instead, and never overshoots it.
+ *
+ * Building with UCPU_THREADED swaps the dispatch loop for a direct-threaded
+ * interpreter (computed goto): every handler ends in its own indirect jump,
+ * so the branch predictor keeps a separate history per opcode.
+ *
+ * A CPU that jams just spins on its JAM opcode for the rest of the budget;
+ * callers check cpu_jammed() afterwards rather than this loop checking
+ * after every instruction. The budget can be cut short while it runs, by
+ * cpu_stop_by().
+ *
+ * @returns the number of cycles executed past `budget`, or past where it
+ * was cut short to.
+ */
+clk_t run_cycles(ucpu_t *cpu, clk_t budget) {
+  cpu->stop = cpu->clock + budget;
+  while ((cpu->cycs_left > 0 || cpu->tick) && cpu->clock < cpu->stop) {
+    step(cpu);
+  }
+  if (cpu->core == CPU_CYCLE) {
+    while (cpu->clock < cpu->stop) {
+      step(cpu);
     }
+    return 0;
+  }
 
-    default: {
-      break;
-    }
+  // The clock moves on after every instruction rather than once at the end,
+  // so that chips caught up mid-batch (see access_clock()) see it move. An
+  // instruction's cycles are only added once it has run, after any stall it
+  // ran into (see cpu_stall()).
+  uint64_t instrs = 0;
+  clk_t cycs;
+#ifdef UCPU_THREADED
+#define LABEL_ENTRY(code, mnem, mode, base, kind) [code] = &&thread_##code,
+  static const void *const OPCODE_TO_LABEL[] = {UCPU_OPCODES(LABEL_ENTRY)};
+#undef LABEL_ENTRY
+
+  goto next;
+
+  // entering an interrupt handler counts as a step of its own, as it does
+  // for dispatch(), and the budget is checked again before the handler runs
+interrupted:
+  cpu->clock += cycs;
+  instrs++;
+next:
+  if (cpu->clock >= cpu->stop) goto done;
+  if ((cycs = poll_interrupts(cpu)) != 0) goto interrupted;
+  goto *OPCODE_TO_LABEL[GETS(cpu->PC)];
+
+#define THREAD(code, mnem, mode, base, kind)                \
+  thread_##code : cycs = op_##code(cpu);                    \
+  cpu->clock += cycs;                                       \
+  instrs++;                                                 \
+  if (cpu->clock >= cpu->stop) goto done;                   \
+  if ((cycs = poll_interrupts(cpu)) != 0) goto interrupted; \
+  goto *OPCODE_TO_LABEL[GETS(cpu->PC)];
+  UCPU_OPCODES(THREAD)
+#undef THREAD
+
+done:
+#else
+  while (cpu->clock < cpu->stop) {
+    cycs = dispatch(cpu);
+    cpu->clock += cycs;
+    instrs++;
   }
-  return -1;
+#endif
+  cpu->instrs += instrs;
+
+  return cpu->clock - cpu->stop;
 }
 
 void dump_cpu(FILE *out, ucpu_t *cpu) {
@@ -932,9 +1474,8 @@ void dump_cpu(FILE *out, ucpu_t *cpu) {
           " "
           "Y: %" PRIx8 " SP: %" PRIx8 " status: %" PRIx8
           " "
-          "remaining cycles: %" PRIx64 " deferred: %d\n",
-          cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->S, cpu->status, cpu->cycs_left,
-          cpu->deferred);
+          "remaining cycles: %" PRIx64 "\n",
+          cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->S, cpu->status, cpu->cycs_left);
 }
 
 // literally bc lldb is trash
@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "cpu/uerrno.h"
 #include "memory/bus.h"
 #include "memory/umem.h"
 
@@ -27,13 +28,11 @@
  * that ADC be run in immediate addressing mode, while $65 requires
  * that it be run in zero page mode.
  *
- * Instead of writing a 256-case switch statement filled with
- * mostly redundant code, we shall adopt the following strategy:
- * we will store global arrays mapping opcodes to one of their variants
- * (which is fixed across individual opcodes), and switch on those
- * opcodes instead: ex. the 0x65th byte in this array would be set
- * to 0x69. Then we will switch on these opcodes in a 56-case
- * switch statement.
+ * Each canonical instruction is written once, and one handler per opcode
+ * is generated (see cpu/uopcodes.h) that bakes the addressing mode into a
+ * call to it. Decoding an instruction is then a single lookup into a
+ * 256-entry table of handlers: no intermediate canonical opcode or
+ * addressing mode is stored between decoding and execution.
  */
 typedef enum opcodes {
   O_ADC,
@@ -99,7 +98,28 @@ typedef enum opcodes {
   O_TXS,
   O_TYA,
 
-  O_DNE
+  // unofficial
+  O_ALR,
+  O_ANC,
+  O_ANE,
+  O_ARR,
+  O_AXS,
+  O_DCP,
+  O_ISC,
+  O_LAS,
+  O_LAX,
+  O_LXA,
+
+  O_RLA,
+  O_RRA,
+  O_SAX,
+  O_SHA,
+  O_SHX,
+  O_SHY,
+  O_SLO,
+  O_SRE,
+  O_TAS,
+  O_JAM
 } opcode_t;
 
 /*
@@ -110,6 +130,12 @@ typedef enum opcodes {
 #define RST_VECTOR 0xFFFC
 #define NMI_VECTOR 0xFFFA
 
+/*
+ * Cycles spent pushing state and fetching the vector when an NMI or IRQ is
+ * taken
+ */
+#define INTERRUPT_CYCS 7
+
 #define STACK_OFFSET 0x0100
 
 /* GLOBALS */
@@ -153,13 +179,6 @@ typedef enum {
 
 /* TYPE DEFINITIONS */
 
-/*
- * As the 6502 processor supports a 16-bit memory space,
- * the special program counter (PC) register holds 16 bits.
- * All other registers are 8 bits wide.
- */
-typedef uint8_t uregr_t;  // Type of all other registers
-
 /*
  * Alternate 8-bit-wide type to represent offsets (which are
  * obviously signed).
@@ -172,6 +191,22 @@ typedef int8_t offset_t;
  */
 typedef uint64_t clk_t;
 
+/*
+ * Which core runs a CPU. The fast core runs each instruction's logic in one
+ * go and then waits out its cycles; the cycle-stepped core makes every bus
+ * access (dummy ones included) on the cycle the real chip does, for mapper
+ * IRQ counters and PPU register races that depend on it, at a fraction of
+ * the speed. Building with UCPU_CYCLE_DEFAULT makes it the default for
+ * every CPU.
+ */
+typedef enum { CPU_FAST, CPU_CYCLE } cpu_core_t;
+
+#ifdef UCPU_CYCLE_DEFAULT
+#define CPU_DEFAULT_CORE CPU_CYCLE
+#else
+#define CPU_DEFAULT_CORE CPU_FAST
+#endif
+
 typedef struct ucpu {
   /* REGISTERS */
 
@@ -188,36 +223,52 @@ typedef struct ucpu {
 
   /* STATE MACHINE LOGIC */
 
-  // These four fields allow the CPU to jump to the proper switch case
-  // and perform the proper logic when it's time to actually execute the
-  // instruction.
-  addr_mode_t curr_addr_mode;  // we might not need this one?
-  opcode_t curr_canon;         // need the canonical instruction
-  uaddr_t operand;             // store *where* the operand is
-                               // so we can fiddle with memory contents
-  bool accum;                  // we need to manually set this option
-  // since the operand is actually a register
-  bool indir;  // this is the only instruction where the operand
-               // is two bytes long
-
-  // This field is bookkeeping for when the emulator should execute
-  // the instruction it's waiting on. When it hits 1, it will execute the
-  // instruction.
+  // This field is bookkeeping for step() on the fast core, which executes
+  // an instruction in full on its first cycle and then waits out the rest.
+  // It holds the number of cycles left before the instruction is finished.
   clk_t cycs_left;
 
-  // This field is bookkeeping for branch instructions that defer
-  // execution by one cycle upon a successful branch.
-  // Upon a successful branch, step() will set this flag, increment
-  // cycs_left by 1, and return. When execution returns to the
-  // branch case, step() will perform the jump unconditionally.
-  // It will also reset deferred back to false.
-  bool deferred;
+  /* CYCLE-STEPPED CORE */
+
+  // Which core runs this CPU. Switching takes effect once the instruction
+  // in flight is finished. The rest of this section is the cycle-stepped
+  // core's progress through the instruction in flight.
+  cpu_core_t core;
+  byte_t op;       // the opcode in flight
+  byte_t tick;     // its cycle now running, from 1; 0 between instructions
+  byte_t access;   // its cycles spent on the operand; 0 while addressing
+  byte_t data;     // the byte being modified, or the status being pushed
+  uaddr_t addr;    // the effective address
+  uaddr_t ptr;     // the pointer or base address it is formed from
+  uaddr_t vector;  // the interrupt being entered, if any; 0 otherwise
+
+  /* BOOKKEEPING */
+
+  clk_t clock;      // Cycles elapsed since init_cpu(); see access_clock()
+  clk_t stop;       // The cycle run_cycles() is running to; see cpu_stop_by()
+  uint64_t instrs;  // Instructions retired since init_cpu()
+  uerrno_t err;     // The last error this CPU ran into, if any
+
+  /* FAULTS */
+
+  // Where the CPU jammed, if err is ERR_JAM. A jammed CPU sits on its JAM
+  // opcode, ignoring interrupts, until it is reset; only this CPU stops.
+  uaddr_t fault_pc;
+  byte_t fault_op;
 
 } ucpu_t;
 
+/*
+ * What step() returns
+ */
+#define STEP_BUSY 0       // the instruction in flight isn't done yet
+#define STEP_DONE (-1)    // an instruction finished on this cycle
+#define STEP_JAMMED (-2)  // the CPU is jammed (see ucpu_t's fault_pc)
+
 /* IMPORTANT CPU OPERATIONS */
 
 void init_cpu(ucpu_t *cpu);
+void reset_cpu(ucpu_t *cpu);
 
 void set_flag(ucpu_t *cpu, flag_t flag, bool value);
 bool get_flag(ucpu_t *cpu, flag_t flag);
@@ -226,6 +277,51 @@ void push(ucpu_t *cpu, byte_t what);
 byte_t pop(ucpu_t *cpu);
 
 int step(ucpu_t *cpu);
+clk_t run_cycles(ucpu_t *cpu, clk_t budget);
+
+/**
+ * @brief Whether the CPU is locked up on a JAM opcode.
+ */
+static inline bool cpu_jammed(const ucpu_t *cpu) {
+  return cpu->err == ERR_JAM;
+}
+
+/*
+ * How far into an instruction the fast core is assumed to be when it
+ * touches another chip's registers. Loads and stores (the usual way in)
+ * make their access on their last cycle, 3 cycles in for absolute
+ * addressing.
+ */
+#define REG_ACCESS_CYC 3
+
+/**
+ * @brief The cycle the bus access in progress lands on, for chips that run
+ * behind the CPU and have to be caught up to it first. The cycle-stepped
+ * core knows it exactly; the fast core's clock stays on an instruction's
+ * first cycle until the instruction is over, so it has to assume.
+ */
+static inline clk_t access_clock(const ucpu_t *cpu) {
+  return cpu->tick ? cpu->clock : cpu->clock + REG_ACCESS_CYC;
+}
+
+/**
+ * @brief Halts the CPU for `cycs` cycles (e.g. while OAM DMA has the bus)
+ * by charging them to its clock in one go. The instruction in flight
+ * carries on once they are over.
+ */
+static inline void cpu_stall(ucpu_t *cpu, clk_t cycs) { cpu->clock += cycs; }
+
+/**
+ * @brief Makes the run_cycles() in progress, if any, return by cycle
+ * `cycle` rather than run its whole budget; e.g. when a register write
+ * brings another chip's next event forward. Like any budget, it is only
+ * checked between instructions on the fast core.
+ */
+static inline void cpu_stop_by(ucpu_t *cpu, clk_t cycle) {
+  if (cycle < cpu->stop) {
+    cpu->stop = cycle;
+  }
+}
 
 /* DEBUG ROUTINES */
 
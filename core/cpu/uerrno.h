@@ -2,13 +2,19 @@
  * @file uerrno.h
  * @brief Error-handling routines for the 6502.
  *
+ * Errors are recorded per CPU, in ucpu_t's `err`, so that any number of
+ * CPUs can run at once on different threads.
+ *
  * @author Benedict Song <benedict04song@gmail.com>
  */
 #ifndef _UERRNO_INCLUDED
 
-typedef enum uerrno { ERR_STACK_OVERFLOW, ERR_STACK_UNDERFLOW } uerrno_t;
-
-extern uerrno_t UERRNO;
+typedef enum uerrno {
+  ERR_NONE = 0,
+  ERR_STACK_OVERFLOW,
+  ERR_STACK_UNDERFLOW,
+  ERR_JAM  // hit a JAM opcode; the CPU is halted until reset
+} uerrno_t;
 
 #define _UERRNO_INCLUDED
 #endif
\ No newline at end of file
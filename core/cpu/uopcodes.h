@@ -0,0 +1,285 @@
+/**
+ * @file uopcodes.h
+ * @brief The 6502 opcode matrix, as an X-macro.
+ *
+ * See spec here: https://www.nesdev.org/wiki/CPU_unofficial_opcodes
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+
+/*
+ * Every one of the 256 possible opcodes, listed as
+ *
+ *   X(opcode, canonical mnemonic, addressing mode, base cycles, kind)
+ *
+ * where the kind (see micro_kind_t in cpu/ucpu.c) is the shape of the
+ * instruction's bus activity, which the cycle-stepped core follows cycle
+ * by cycle. Expanding this list with different definitions of X lets the
+ * CPU build its dispatch tables (and anything else keyed on the opcode
+ * byte) from a single source of truth.
+ *
+ * Unofficial opcodes use the mnemonics from the nesdev wiki. The twelve
+ * that lock the processor up are listed as JAM; all of them are IMPL with
+ * no cycles of their own, since a jammed CPU never finishes an instruction.
+ *
+ * Base cycles do not include the extra cycle read-only instructions take
+ * when indexing crosses a page, nor the extra cycles of a taken branch.
+ */
+#define UCPU_OPCODES(X)                                                      \
+  X(0x00, BRK, IMPL, 7, BREAK)                                               \
+  X(0x01, ORA, INDIR_X, 6, READ)                                             \
+  X(0x02, JAM, IMPL, 0, HALT)                                                \
+  X(0x03, SLO, INDIR_X, 8, MODIFY)                                           \
+  X(0x04, NOP, ZPAGE, 3, READ)                                               \
+  X(0x05, ORA, ZPAGE, 3, READ)                                               \
+  X(0x06, ASL, ZPAGE, 5, MODIFY)                                             \
+  X(0x07, SLO, ZPAGE, 5, MODIFY)                                             \
+  X(0x08, PHP, IMPL, 3, PUSH)                                                \
+  X(0x09, ORA, IMMED, 2, READ)                                               \
+  X(0x0A, ASL, ACCUM, 2, IMPLIED)                                            \
+  X(0x0B, ANC, IMMED, 2, READ)                                               \
+  X(0x0C, NOP, ABS, 4, READ)                                                 \
+  X(0x0D, ORA, ABS, 4, READ)                                                 \
+  X(0x0E, ASL, ABS, 6, MODIFY)                                               \
+  X(0x0F, SLO, ABS, 6, MODIFY)                                               \
+  X(0x10, BPL, REL, 2, BRANCH)                                               \
+  X(0x11, ORA, INDIR_Y_RO, 5, READ)                                          \
+  X(0x12, JAM, IMPL, 0, HALT)                                                \
+  X(0x13, SLO, INDIR_Y, 8, MODIFY)                                           \
+  X(0x14, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0x15, ORA, ZPAGE_X, 4, READ)                                             \
+  X(0x16, ASL, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x17, SLO, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x18, CLC, IMPL, 2, IMPLIED)                                             \
+  X(0x19, ORA, ABS_Y_RO, 4, READ)                                            \
+  X(0x1A, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0x1B, SLO, ABS_Y, 7, MODIFY)                                             \
+  X(0x1C, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0x1D, ORA, ABS_X_RO, 4, READ)                                            \
+  X(0x1E, ASL, ABS_X, 7, MODIFY)                                             \
+  X(0x1F, SLO, ABS_X, 7, MODIFY)                                             \
+  X(0x20, JSR, ABS, 6, CALL)                                                 \
+  X(0x21, AND, INDIR_X, 6, READ)                                             \
+  X(0x22, JAM, IMPL, 0, HALT)                                                \
+  X(0x23, RLA, INDIR_X, 8, MODIFY)                                           \
+  X(0x24, BIT, ZPAGE, 3, READ)                                               \
+  X(0x25, AND, ZPAGE, 3, READ)                                               \
+  X(0x26, ROL, ZPAGE, 5, MODIFY)                                             \
+  X(0x27, RLA, ZPAGE, 5, MODIFY)                                             \
+  X(0x28, PLP, IMPL, 4, PULL)                                                \
+  X(0x29, AND, IMMED, 2, READ)                                               \
+  X(0x2A, ROL, ACCUM, 2, IMPLIED)                                            \
+  X(0x2B, ANC, IMMED, 2, READ)                                               \
+  X(0x2C, BIT, ABS, 4, READ)                                                 \
+  X(0x2D, AND, ABS, 4, READ)                                                 \
+  X(0x2E, ROL, ABS, 6, MODIFY)                                               \
+  X(0x2F, RLA, ABS, 6, MODIFY)                                               \
+  X(0x30, BMI, REL, 2, BRANCH)                                               \
+  X(0x31, AND, INDIR_Y_RO, 5, READ)                                          \
+  X(0x32, JAM, IMPL, 0, HALT)                                                \
+  X(0x33, RLA, INDIR_Y, 8, MODIFY)                                           \
+  X(0x34, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0x35, AND, ZPAGE_X, 4, READ)                                             \
+  X(0x36, ROL, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x37, RLA, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x38, SEC, IMPL, 2, IMPLIED)                                             \
+  X(0x39, AND, ABS_Y_RO, 4, READ)                                            \
+  X(0x3A, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0x3B, RLA, ABS_Y, 7, MODIFY)                                             \
+  X(0x3C, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0x3D, AND, ABS_X_RO, 4, READ)                                            \
+  X(0x3E, ROL, ABS_X, 7, MODIFY)                                             \
+  X(0x3F, RLA, ABS_X, 7, MODIFY)                                             \
+  X(0x40, RTI, IMPL, 6, RETI)                                                \
+  X(0x41, EOR, INDIR_X, 6, READ)                                             \
+  X(0x42, JAM, IMPL, 0, HALT)                                                \
+  X(0x43, SRE, INDIR_X, 8, MODIFY)                                           \
+  X(0x44, NOP, ZPAGE, 3, READ)                                               \
+  X(0x45, EOR, ZPAGE, 3, READ)                                               \
+  X(0x46, LSR, ZPAGE, 5, MODIFY)                                             \
+  X(0x47, SRE, ZPAGE, 5, MODIFY)                                             \
+  X(0x48, PHA, IMPL, 3, PUSH)                                                \
+  X(0x49, EOR, IMMED, 2, READ)                                               \
+  X(0x4A, LSR, ACCUM, 2, IMPLIED)                                            \
+  X(0x4B, ALR, IMMED, 2, READ)                                               \
+  X(0x4C, JMP, ABS, 3, JUMP)                                                 \
+  X(0x4D, EOR, ABS, 4, READ)                                                 \
+  X(0x4E, LSR, ABS, 6, MODIFY)                                               \
+  X(0x4F, SRE, ABS, 6, MODIFY)                                               \
+  X(0x50, BVC, REL, 2, BRANCH)                                               \
+  X(0x51, EOR, INDIR_Y_RO, 5, READ)                                          \
+  X(0x52, JAM, IMPL, 0, HALT)                                                \
+  X(0x53, SRE, INDIR_Y, 8, MODIFY)                                           \
+  X(0x54, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0x55, EOR, ZPAGE_X, 4, READ)                                             \
+  X(0x56, LSR, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x57, SRE, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x58, CLI, IMPL, 2, IMPLIED)                                             \
+  X(0x59, EOR, ABS_Y_RO, 4, READ)                                            \
+  X(0x5A, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0x5B, SRE, ABS_Y, 7, MODIFY)                                             \
+  X(0x5C, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0x5D, EOR, ABS_X_RO, 4, READ)                                            \
+  X(0x5E, LSR, ABS_X, 7, MODIFY)                                             \
+  X(0x5F, SRE, ABS_X, 7, MODIFY)                                             \
+  X(0x60, RTS, IMPL, 6, RETURN)                                              \
+  X(0x61, ADC, INDIR_X, 6, READ)                                             \
+  X(0x62, JAM, IMPL, 0, HALT)                                                \
+  X(0x63, RRA, INDIR_X, 8, MODIFY)                                           \
+  X(0x64, NOP, ZPAGE, 3, READ)                                               \
+  X(0x65, ADC, ZPAGE, 3, READ)                                               \
+  X(0x66, ROR, ZPAGE, 5, MODIFY)                                             \
+  X(0x67, RRA, ZPAGE, 5, MODIFY)                                             \
+  X(0x68, PLA, IMPL, 4, PULL)                                                \
+  X(0x69, ADC, IMMED, 2, READ)                                               \
+  X(0x6A, ROR, ACCUM, 2, IMPLIED)                                            \
+  X(0x6B, ARR, IMMED, 2, READ)                                               \
+  X(0x6C, JMP, INDIR, 5, JUMP)                                               \
+  X(0x6D, ADC, ABS, 4, READ)                                                 \
+  X(0x6E, ROR, ABS, 6, MODIFY)                                               \
+  X(0x6F, RRA, ABS, 6, MODIFY)                                               \
+  X(0x70, BVS, REL, 2, BRANCH)                                               \
+  X(0x71, ADC, INDIR_Y_RO, 5, READ)                                          \
+  X(0x72, JAM, IMPL, 0, HALT)                                                \
+  X(0x73, RRA, INDIR_Y, 8, MODIFY)                                           \
+  X(0x74, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0x75, ADC, ZPAGE_X, 4, READ)                                             \
+  X(0x76, ROR, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x77, RRA, ZPAGE_X, 6, MODIFY)                                           \
+  X(0x78, SEI, IMPL, 2, IMPLIED)                                             \
+  X(0x79, ADC, ABS_Y_RO, 4, READ)                                            \
+  X(0x7A, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0x7B, RRA, ABS_Y, 7, MODIFY)                                             \
+  X(0x7C, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0x7D, ADC, ABS_X_RO, 4, READ)                                            \
+  X(0x7E, ROR, ABS_X, 7, MODIFY)                                             \
+  X(0x7F, RRA, ABS_X, 7, MODIFY)                                             \
+  X(0x80, NOP, IMMED, 2, READ)                                               \
+  X(0x81, STA, INDIR_X, 6, WRITE)                                            \
+  X(0x82, NOP, IMMED, 2, READ)                                               \
+  X(0x83, SAX, INDIR_X, 6, WRITE)                                            \
+  X(0x84, STY, ZPAGE, 3, WRITE)                                              \
+  X(0x85, STA, ZPAGE, 3, WRITE)                                              \
+  X(0x86, STX, ZPAGE, 3, WRITE)                                              \
+  X(0x87, SAX, ZPAGE, 3, WRITE)                                              \
+  X(0x88, DEY, IMPL, 2, IMPLIED)                                             \
+  X(0x89, NOP, IMMED, 2, READ)                                               \
+  X(0x8A, TXA, IMPL, 2, IMPLIED)                                             \
+  X(0x8B, ANE, IMMED, 2, READ)                                               \
+  X(0x8C, STY, ABS, 4, WRITE)                                                \
+  X(0x8D, STA, ABS, 4, WRITE)                                                \
+  X(0x8E, STX, ABS, 4, WRITE)                                                \
+  X(0x8F, SAX, ABS, 4, WRITE)                                                \
+  X(0x90, BCC, REL, 2, BRANCH)                                               \
+  X(0x91, STA, INDIR_Y, 6, WRITE)                                            \
+  X(0x92, JAM, IMPL, 0, HALT)                                                \
+  X(0x93, SHA, INDIR_Y, 6, WRITE)                                            \
+  X(0x94, STY, ZPAGE_X, 4, WRITE)                                            \
+  X(0x95, STA, ZPAGE_X, 4, WRITE)                                            \
+  X(0x96, STX, ZPAGE_Y, 4, WRITE)                                            \
+  X(0x97, SAX, ZPAGE_Y, 4, WRITE)                                            \
+  X(0x98, TYA, IMPL, 2, IMPLIED)                                             \
+  X(0x99, STA, ABS_Y, 5, WRITE)                                              \
+  X(0x9A, TXS, IMPL, 2, IMPLIED)                                             \
+  X(0x9B, TAS, ABS_Y, 5, WRITE)                                              \
+  X(0x9C, SHY, ABS_X, 5, WRITE)                                              \
+  X(0x9D, STA, ABS_X, 5, WRITE)                                              \
+  X(0x9E, SHX, ABS_Y, 5, WRITE)                                              \
+  X(0x9F, SHA, ABS_Y, 5, WRITE)                                              \
+  X(0xA0, LDY, IMMED, 2, READ)                                               \
+  X(0xA1, LDA, INDIR_X, 6, READ)                                             \
+  X(0xA2, LDX, IMMED, 2, READ)                                               \
+  X(0xA3, LAX, INDIR_X, 6, READ)                                             \
+  X(0xA4, LDY, ZPAGE, 3, READ)                                               \
+  X(0xA5, LDA, ZPAGE, 3, READ)                                               \
+  X(0xA6, LDX, ZPAGE, 3, READ)                                               \
+  X(0xA7, LAX, ZPAGE, 3, READ)                                               \
+  X(0xA8, TAY, IMPL, 2, IMPLIED)                                             \
+  X(0xA9, LDA, IMMED, 2, READ)                                               \
+  X(0xAA, TAX, IMPL, 2, IMPLIED)                                             \
+  X(0xAB, LXA, IMMED, 2, READ)                                               \
+  X(0xAC, LDY, ABS, 4, READ)                                                 \
+  X(0xAD, LDA, ABS, 4, READ)                                                 \
+  X(0xAE, LDX, ABS, 4, READ)                                                 \
+  X(0xAF, LAX, ABS, 4, READ)                                                 \
+  X(0xB0, BCS, REL, 2, BRANCH)                                               \
+  X(0xB1, LDA, INDIR_Y_RO, 5, READ)                                          \
+  X(0xB2, JAM, IMPL, 0, HALT)                                                \
+  X(0xB3, LAX, INDIR_Y_RO, 5, READ)                                          \
+  X(0xB4, LDY, ZPAGE_X, 4, READ)                                             \
+  X(0xB5, LDA, ZPAGE_X, 4, READ)                                             \
+  X(0xB6, LDX, ZPAGE_Y, 4, READ)                                             \
+  X(0xB7, LAX, ZPAGE_Y, 4, READ)                                             \
+  X(0xB8, CLV, IMPL, 2, IMPLIED)                                             \
+  X(0xB9, LDA, ABS_Y_RO, 4, READ)                                            \
+  X(0xBA, TSX, IMPL, 2, IMPLIED)                                             \
+  X(0xBB, LAS, ABS_Y_RO, 4, READ)                                            \
+  X(0xBC, LDY, ABS_X_RO, 4, READ)                                            \
+  X(0xBD, LDA, ABS_X_RO, 4, READ)                                            \
+  X(0xBE, LDX, ABS_Y_RO, 4, READ)                                            \
+  X(0xBF, LAX, ABS_Y_RO, 4, READ)                                            \
+  X(0xC0, CPY, IMMED, 2, READ)                                               \
+  X(0xC1, CMP, INDIR_X, 6, READ)                                             \
+  X(0xC2, NOP, IMMED, 2, READ)                                               \
+  X(0xC3, DCP, INDIR_X, 8, MODIFY)                                           \
+  X(0xC4, CPY, ZPAGE, 3, READ)                                               \
+  X(0xC5, CMP, ZPAGE, 3, READ)                                               \
+  X(0xC6, DEC, ZPAGE, 5, MODIFY)                                             \
+  X(0xC7, DCP, ZPAGE, 5, MODIFY)                                             \
+  X(0xC8, INY, IMPL, 2, IMPLIED)                                             \
+  X(0xC9, CMP, IMMED, 2, READ)                                               \
+  X(0xCA, DEX, IMPL, 2, IMPLIED)                                             \
+  X(0xCB, AXS, IMMED, 2, READ)                                               \
+  X(0xCC, CPY, ABS, 4, READ)                                                 \
+  X(0xCD, CMP, ABS, 4, READ)                                                 \
+  X(0xCE, DEC, ABS, 6, MODIFY)                                               \
+  X(0xCF, DCP, ABS, 6, MODIFY)                                               \
+  X(0xD0, BNE, REL, 2, BRANCH)                                               \
+  X(0xD1, CMP, INDIR_Y_RO, 5, READ)                                          \
+  X(0xD2, JAM, IMPL, 0, HALT)                                                \
+  X(0xD3, DCP, INDIR_Y, 8, MODIFY)                                           \
+  X(0xD4, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0xD5, CMP, ZPAGE_X, 4, READ)                                             \
+  X(0xD6, DEC, ZPAGE_X, 6, MODIFY)                                           \
+  X(0xD7, DCP, ZPAGE_X, 6, MODIFY)                                           \
+  X(0xD8, CLD, IMPL, 2, IMPLIED)                                             \
+  X(0xD9, CMP, ABS_Y_RO, 4, READ)                                            \
+  X(0xDA, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0xDB, DCP, ABS_Y, 7, MODIFY)                                             \
+  X(0xDC, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0xDD, CMP, ABS_X_RO, 4, READ)                                            \
+  X(0xDE, DEC, ABS_X, 7, MODIFY)                                             \
+  X(0xDF, DCP, ABS_X, 7, MODIFY)                                             \
+  X(0xE0, CPX, IMMED, 2, READ)                                               \
+  X(0xE1, SBC, INDIR_X, 6, READ)                                             \
+  X(0xE2, NOP, IMMED, 2, READ)                                               \
+  X(0xE3, ISC, INDIR_X, 8, MODIFY)                                           \
+  X(0xE4, CPX, ZPAGE, 3, READ)                                               \
+  X(0xE5, SBC, ZPAGE, 3, READ)                                               \
+  X(0xE6, INC, ZPAGE, 5, MODIFY)                                             \
+  X(0xE7, ISC, ZPAGE, 5, MODIFY)                                             \
+  X(0xE8, INX, IMPL, 2, IMPLIED)                                             \
+  X(0xE9, SBC, IMMED, 2, READ)                                               \
+  X(0xEA, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0xEB, SBC, IMMED, 2, READ)                                               \
+  X(0xEC, CPX, ABS, 4, READ)                                                 \
+  X(0xED, SBC, ABS, 4, READ)                                                 \
+  X(0xEE, INC, ABS, 6, MODIFY)                                               \
+  X(0xEF, ISC, ABS, 6, MODIFY)                                               \
+  X(0xF0, BEQ, REL, 2, BRANCH)                                               \
+  X(0xF1, SBC, INDIR_Y_RO, 5, READ)                                          \
+  X(0xF2, JAM, IMPL, 0, HALT)                                                \
+  X(0xF3, ISC, INDIR_Y, 8, MODIFY)                                           \
+  X(0xF4, NOP, ZPAGE_X, 4, READ)                                             \
+  X(0xF5, SBC, ZPAGE_X, 4, READ)                                             \
+  X(0xF6, INC, ZPAGE_X, 6, MODIFY)                                           \
+  X(0xF7, ISC, ZPAGE_X, 6, MODIFY)                                           \
+  X(0xF8, SED, IMPL, 2, IMPLIED)                                             \
+  X(0xF9, SBC, ABS_Y_RO, 4, READ)                                            \
+  X(0xFA, NOP, IMPL, 2, IMPLIED)                                             \
+  X(0xFB, ISC, ABS_Y, 7, MODIFY)                                             \
+  X(0xFC, NOP, ABS_X_RO, 4, READ)                                            \
+  X(0xFD, SBC, ABS_X_RO, 4, READ)                                            \
+  X(0xFE, INC, ABS_X, 7, MODIFY)                                             \
+  X(0xFF, ISC, ABS_X, 7, MODIFY)
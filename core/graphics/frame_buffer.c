@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "graphics/frame_buffer.h"
+
+#include <string.h>
+
+/**
+ * @brief Clears all three frames to black and hands out one to each side.
+ *
+ * @note Must finish before either thread touches the buffer.
+ */
+void init_frame_buffer(frame_buffer_t *fb) {
+  memset(fb->frames, 0, sizeof(fb->frames));
+  fb->back = 0;
+  fb->front = 1;
+  atomic_init(&fb->middle, 2);
+}
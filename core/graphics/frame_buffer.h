@@ -0,0 +1,95 @@
+/**
+ * @file graphics/frame_buffer.h
+ * @brief Interface for a lock-free triple buffer of frames.
+ *
+ * The emulation thread always owns one frame (the back frame) to draw into
+ * and the display thread another (the front frame). The third is handed
+ * back and forth through a single atomic index: publishing swaps the back
+ * frame in, and the display thread swaps it out again once it wants the
+ * new frame. Neither side ever waits on the other or copies a frame, and a
+ * display that falls behind just skips frames.
+ *
+ * Exactly one thread may draw and publish, and exactly one may read.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#ifndef _FRAME_BUFFER_INCLUDED
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "graphics/gfxprimitives.h"
+#include "graphics/pixels.h"
+#include "memory/umem.h"
+
+#define FRAME_PX (NES_PX_WIDTH * NES_PX_HEIGHT)
+
+/*
+ * The shared index holds the frame in the middle of the handoff, plus a bit
+ * set while it is a frame the reader hasn't seen
+ */
+#define FRAME_INDEX 0x03u
+#define FRAME_FRESH 0x04u
+
+/**
+ * @brief A single frame, row by row.
+ */
+typedef struct px_buffer {
+  pixel_t buf[FRAME_PX];
+} px_buffer_t;
+
+/**
+ * @brief Three frames shared between a drawing and a displaying thread.
+ */
+typedef struct frame_buffer {
+  px_buffer_t frames[3];
+  // each on its own cache line, so the two sides don't contend
+  alignas(CACHE_LINE_SZ) atomic_uint middle;
+  alignas(CACHE_LINE_SZ) unsigned back;  // owned by the drawing thread
+  alignas(CACHE_LINE_SZ) unsigned front;  // owned by the displaying thread
+} frame_buffer_t;
+
+void init_frame_buffer(frame_buffer_t *fb);
+
+/**
+ * @brief The frame to draw into. Only valid until the next publish_frame().
+ */
+static inline pixel_t *back_frame(frame_buffer_t *fb) {
+  return fb->frames[fb->back].buf;
+}
+
+/**
+ * @brief Hands the back frame, now complete, to the displaying thread and
+ * takes a frame to draw the next one into.
+ */
+static inline void publish_frame(frame_buffer_t *fb) {
+  // release the pixels drawn; acquire whatever the reader did with the one
+  // we get back
+  fb->back = atomic_exchange_explicit(&fb->middle, fb->back | FRAME_FRESH,
+                                      memory_order_acq_rel) &
+             FRAME_INDEX;
+}
+
+/**
+ * @brief The latest complete frame, without copying it. The frame stays
+ * untouched until the next call to latest_frame().
+ *
+ * @param[out] fresh Set to whether the frame is new since the last call;
+ * may be NULL.
+ */
+static inline const pixel_t *latest_frame(frame_buffer_t *fb, bool *fresh) {
+  bool swap =
+      atomic_load_explicit(&fb->middle, memory_order_relaxed) & FRAME_FRESH;
+  if (swap) {
+    fb->front = atomic_exchange_explicit(&fb->middle, fb->front,
+                                         memory_order_acq_rel) &
+                FRAME_INDEX;
+  }
+  if (fresh) {
+    *fresh = swap;
+  }
+  return fb->frames[fb->front].buf;
+}
+
+#define _FRAME_BUFFER_INCLUDED
+#endif
@@ -0,0 +1,254 @@
+/**
+ * @file
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "graphics/framedump.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * NTSC frame rate, 39375000 / 655171 (about 60.0988) frames per second
+ */
+#define Y4M_HEADER "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n"
+#define Y4M_FRAME "FRAME\n"
+
+/*
+ * PNG image data is a filter byte plus 3 bytes per pixel for each row,
+ * split into stored deflate blocks of at most 65535 bytes
+ */
+#define PNG_ROW_SZ (1 + 3 * NES_PX_WIDTH)
+#define PNG_DATA_SZ (PNG_ROW_SZ * NES_PX_HEIGHT)
+#define PNG_STORED_MAX 65535u
+#define PNG_SZ (PNG_DATA_SZ + (PNG_DATA_SZ / PNG_STORED_MAX + 1) * 5 + 128)
+
+_Static_assert(PNG_SZ <= DUMP_MAX_SZ, "a PNG frame must fit in the buffer");
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P',  'N',  'G',
+                                         '\r', '\n', 0x1A, '\n'};
+
+/**
+ * @brief Writes all of `buf`, retrying short and interrupted writes.
+ *
+ * @return 0 on success, or -1 with errno set.
+ */
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static uint8_t *put_be32(uint8_t *at, uint32_t what) {
+  at[0] = what >> 24;
+  at[1] = what >> 16;
+  at[2] = what >> 8;
+  at[3] = what;
+  return at + 4;
+}
+
+/* RAW AND Y4M */
+
+static size_t encode_rgba(const pixel_t *frame, uint8_t *out) {
+  for (size_t i = 0; i < FRAME_PX; i++) {
+    *out++ = get_red(frame[i]);
+    *out++ = get_green(frame[i]);
+    *out++ = get_blue(frame[i]);
+    *out++ = 0xFF;
+  }
+  return 4 * FRAME_PX;
+}
+
+/**
+ * @brief Converts a frame to planar Y'CbCr, BT.601 limited range, in
+ * 8.8 fixed point.
+ */
+static size_t encode_y4m(const pixel_t *frame, uint8_t *out) {
+  memcpy(out, Y4M_FRAME, sizeof(Y4M_FRAME) - 1);
+  uint8_t *y = out + sizeof(Y4M_FRAME) - 1;
+  uint8_t *cb = y + FRAME_PX;
+  uint8_t *cr = cb + FRAME_PX;
+  for (size_t i = 0; i < FRAME_PX; i++) {
+    int r = get_red(frame[i]), g = get_green(frame[i]), b = get_blue(frame[i]);
+    y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    cb[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    cr[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+  return sizeof(Y4M_FRAME) - 1 + 3 * FRAME_PX;
+}
+
+/* PNG */
+
+/**
+ * @brief CRC-32 (as in zlib), a nibble at a time.
+ */
+static uint32_t crc32(const uint8_t *buf, size_t len) {
+  static const uint32_t NIBBLE_CRC[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < len; i++) {
+    c ^= buf[i];
+    c = NIBBLE_CRC[c & 0x0F] ^ (c >> 4);
+    c = NIBBLE_CRC[c & 0x0F] ^ (c >> 4);
+  }
+  return c ^ 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Wraps the `len` bytes already at `at + 8` into a chunk of type
+ * `type`.
+ *
+ * @return Where the next chunk goes.
+ */
+static uint8_t *put_chunk(uint8_t *at, const char *type, size_t len) {
+  put_be32(at, len);
+  memcpy(at + 4, type, 4);
+  // the CRC covers the type as well as the data
+  return put_be32(at + 8 + len, crc32(at + 4, len + 4));
+}
+
+/**
+ * @brief Encodes a frame as an 8-bit RGB PNG. The image data is wrapped in
+ * stored (uncompressed) deflate blocks: the output is about as big as the
+ * raw frame, but encoding is a single pass with nothing to search.
+ */
+static size_t encode_png(const pixel_t *frame, uint8_t *out) {
+  uint8_t *at = out;
+  memcpy(at, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+  at += sizeof(PNG_SIGNATURE);
+
+  uint8_t *ihdr = at + 8;
+  ihdr = put_be32(ihdr, NES_PX_WIDTH);
+  ihdr = put_be32(ihdr, NES_PX_HEIGHT);
+  memcpy(ihdr, (uint8_t[]){8, 2, 0, 0, 0}, 5);  // 8 bits, RGB, no interlace
+  at = put_chunk(at, "IHDR", 13);
+
+  uint8_t *data = at + 8;
+  uint8_t *z = data;
+  *z++ = 0x78;  // deflate, 32K window
+  *z++ = 0x01;  // no preset dictionary, fastest; checksums 0x7801 % 31 == 0
+
+  // adler-32 of the rows; a row is too short for the sums to overflow, so
+  // they only need reducing once per row
+  uint32_t s1 = 1, s2 = 0;
+  size_t left = PNG_DATA_SZ;
+  size_t in_block = 0;
+  for (size_t y = 0; y < NES_PX_HEIGHT; y++) {
+    uint8_t row[PNG_ROW_SZ];
+    row[0] = 0;  // no filter
+    for (size_t x = 0; x < NES_PX_WIDTH; x++) {
+      pixel_t px = frame[y * NES_PX_WIDTH + x];
+      row[1 + 3 * x] = get_red(px);
+      row[2 + 3 * x] = get_green(px);
+      row[3 + 3 * x] = get_blue(px);
+    }
+    for (size_t i = 0; i < PNG_ROW_SZ; i++) {
+      s1 += row[i];
+      s2 += s1;
+    }
+    s1 %= 65521;
+    s2 %= 65521;
+
+    // split the row across as many stored blocks as it straddles
+    for (size_t i = 0; i < PNG_ROW_SZ;) {
+      if (in_block == 0) {
+        in_block = left < PNG_STORED_MAX ? left : PNG_STORED_MAX;
+        *z++ = in_block == left;  // BFINAL on the last block, BTYPE 00
+        *z++ = in_block;
+        *z++ = in_block >> 8;
+        *z++ = ~in_block;
+        *z++ = ~in_block >> 8;
+      }
+      size_t n = PNG_ROW_SZ - i;
+      n = n < in_block ? n : in_block;
+      memcpy(z, row + i, n);
+      z += n;
+      i += n;
+      in_block -= n;
+      left -= n;
+    }
+  }
+  z = put_be32(z, (s2 << 16) | s1);
+  at = put_chunk(at, "IDAT", z - data);
+
+  at = put_chunk(at, "IEND", 0);
+  return at - out;
+}
+
+/**
+ * @brief Starts a stream of frames to `fd`, which stays owned by the
+ * caller. One frame is written, then `skip` are dropped, and so on.
+ */
+void init_frame_dump(frame_dump_t *dump, int fd, dump_fmt_t fmt,
+                     unsigned skip) {
+  dump->fd = fd;
+  dump->fmt = fmt;
+  dump->skip = skip;
+  dump->frames = 0;
+  dump->started = false;
+}
+
+/**
+ * @brief Offers a complete frame (e.g. from latest_frame()) to the stream,
+ * which writes it unless it is due to be skipped.
+ *
+ * @return 0 on success, or -1 with errno set if the write failed.
+ */
+int dump_frame(frame_dump_t *dump, const pixel_t *frame) {
+  if (dump->frames++ % ((uint64_t)dump->skip + 1) != 0) {
+    return 0;
+  }
+
+  if (!dump->started) {
+    dump->started = true;
+    if (dump->fmt == DUMP_Y4M &&
+        write_all(dump->fd, (const uint8_t *)Y4M_HEADER,
+                  sizeof(Y4M_HEADER) - 1) != 0) {
+      return -1;
+    }
+  }
+
+  size_t len = 0;
+  switch (dump->fmt) {
+    case DUMP_RGBA:
+      len = encode_rgba(frame, dump->out);
+      break;
+    case DUMP_Y4M:
+      len = encode_y4m(frame, dump->out);
+      break;
+    case DUMP_PNG:
+      len = encode_png(frame, dump->out);
+      break;
+  }
+  return write_all(dump->fd, dump->out, len);
+}
+
+/**
+ * @brief Looks up a format by name: "rgba", "y4m" or "png".
+ *
+ * @return 0 on success, or -1 if there is no such format.
+ */
+int parse_dump_fmt(const char *name, dump_fmt_t *fmt) {
+  static const char *NAMES[] = {
+      [DUMP_RGBA] = "rgba", [DUMP_Y4M] = "y4m", [DUMP_PNG] = "png"};
+  for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+    if (strcmp(name, NAMES[i]) == 0) {
+      *fmt = (dump_fmt_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
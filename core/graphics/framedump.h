@@ -0,0 +1,44 @@
+/**
+ * @file graphics/framedump.h
+ * @brief Interface for a headless backend that streams frames to a file
+ * descriptor, e.g. a pipe into a video encoder.
+ *
+ * Frames can be written as raw RGBA (8 bits per channel, no header), as a
+ * YUV4MPEG2 stream (4:4:4, BT.601 limited range), or as a sequence of PNG
+ * images (stored uncompressed, so they cost next to nothing to produce).
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#ifndef _FRAMEDUMP_INCLUDED
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graphics/frame_buffer.h"
+
+typedef enum dump_fmt { DUMP_RGBA, DUMP_Y4M, DUMP_PNG } dump_fmt_t;
+
+/*
+ * The largest frame any format produces: raw RGBA
+ */
+#define DUMP_MAX_SZ (4 * FRAME_PX)
+
+/**
+ * @brief A stream of frames and where it goes.
+ */
+typedef struct frame_dump {
+  int fd;
+  dump_fmt_t fmt;
+  unsigned skip;    // frames dropped after each one written
+  uint64_t frames;  // frames offered so far, written or not
+  bool started;     // whether the stream header (if any) is out
+  uint8_t out[DUMP_MAX_SZ];  // the frame being encoded
+} frame_dump_t;
+
+void init_frame_dump(frame_dump_t *dump, int fd, dump_fmt_t fmt,
+                     unsigned skip);
+int dump_frame(frame_dump_t *dump, const pixel_t *frame);
+int parse_dump_fmt(const char *name, dump_fmt_t *fmt);
+
+#define _FRAMEDUMP_INCLUDED
+#endif
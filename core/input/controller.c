@@ -0,0 +1,63 @@
+/**
+ * @file controller.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "input/controller.h"
+
+#include <string.h>
+
+/**
+ * @brief Plugs in two controllers with nothing held and no script.
+ */
+void init_controllers(controllers_t *ctl) { memset(ctl, 0, sizeof(*ctl)); }
+
+/**
+ * @brief Plugs the controllers into the bus. They are reached through the
+ * bus's I/O page, which they share with the APU and OAM DMA.
+ */
+void connect_controllers(controllers_t *ctl, bus_t *bus) {
+  bus->controllers = ctl;
+}
+
+/**
+ * @brief Plays `script` from the next frame on: `frames` frames of
+ * CONTROLLER_PORTS bytes each (port 0's buttons, then port 1's). The
+ * caller keeps it alive until it has been played, or until another script
+ * (or NULL, to stop playing) replaces it. Stopping lets go of all buttons.
+ */
+void controller_feed(controllers_t *ctl, const byte_t *script, size_t frames) {
+  ctl->script = script;
+  ctl->script_len = frames;
+  ctl->script_pos = 0;
+  if (!script) {
+    memset(ctl->buttons, 0, sizeof(ctl->buttons));
+  }
+}
+
+/**
+ * @brief Reads the next button off controller port `which`. Only the bits
+ * in CONTROLLER_DATA_MASK are driven; the bus fills in the others.
+ */
+byte_t controller_reg_read(controllers_t *ctl, uaddr_t which) {
+  int port = which - CONTROLLER_PORT1_ADDR;
+  if (ctl->strobe) {
+    // the shift register keeps reloading, so reads never get past A
+    return ctl->buttons[port] & 1;
+  }
+  byte_t bit = ctl->shift[port] & 1;
+  ctl->shift[port] = (ctl->shift[port] >> 1) | 0x80;  // 1s once empty
+  return bit;
+}
+
+/**
+ * @brief Writes the strobe. The shift registers are loaded while it is
+ * high, and so hold the buttons as they were when it went low.
+ */
+void controller_reg_write(controllers_t *ctl, uaddr_t which, byte_t what) {
+  if (ctl->strobe || (what & 1)) {
+    memcpy(ctl->shift, ctl->buttons, sizeof(ctl->shift));
+  }
+  ctl->strobe = what & 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file controller.h
+ * @brief Standard controllers in both ports, read serially through $4016
+ * and $4017.
+ *
+ * Writing 1 to bit 0 of $4016 (the strobe) makes both controllers keep
+ * reloading their shift registers from the buttons held; writing 0 lets
+ * them shift. Each read then returns the next button in bit 0, in the
+ * order of the BUTTON_* bits, and 1s once all eight are out. Bits 5-7 of
+ * the read are open bus.
+ *
+ * Which buttons are held is just a byte per port, which the host sets
+ * between frames. Scripted runs can instead hand over a whole run's worth
+ * of input up front (see controller_feed()), which run_frame() steps
+ * through a frame at a time; that way feeding a frame of input costs a
+ * couple of loads, not a call back out to the host.
+ *
+ * See spec here: https://www.nesdev.org/wiki/Standard_controller
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory/bus.h"
+#include "memory/umem.h"
+
+#define CONTROLLER_STROBE_ADDR 0x4016u
+#define CONTROLLER_PORT1_ADDR 0x4016u
+#define CONTROLLER_PORT2_ADDR 0x4017u
+
+#define CONTROLLER_PORTS 2
+
+/*
+ * The bits of a reading that controllers drive; the rest are open bus
+ */
+#define CONTROLLER_DATA_MASK 0x1Fu
+
+/*
+ * Buttons, in the order they are shifted out
+ */
+#define BUTTON_A 0x01u
+#define BUTTON_B 0x02u
+#define BUTTON_SELECT 0x04u
+#define BUTTON_START 0x08u
+#define BUTTON_UP 0x10u
+#define BUTTON_DOWN 0x20u
+#define BUTTON_LEFT 0x40u
+#define BUTTON_RIGHT 0x80u
+
+typedef struct controllers {
+  byte_t buttons[CONTROLLER_PORTS];  // BUTTON_* bits held down
+  byte_t shift[CONTROLLER_PORTS];    // buttons not yet read, LSB next
+  bool strobe;
+
+  /* LINKS */
+
+  // not saved (see nes/savestate.h)
+  const byte_t *script;  // CONTROLLER_PORTS bytes a frame; NULL for none
+  size_t script_len;     // in frames
+  size_t script_pos;     // the next frame to play
+} controllers_t;
+
+void init_controllers(controllers_t *ctl);
+void connect_controllers(controllers_t *ctl, bus_t *bus);
+void controller_feed(controllers_t *ctl, const byte_t *script, size_t frames);
+
+byte_t controller_reg_read(controllers_t *ctl, uaddr_t which);
+void controller_reg_write(controllers_t *ctl, uaddr_t which, byte_t what);
+
+/**
+ * @brief Holds down the BUTTON_* bits in `buttons` on controller `port`
+ * (0 or 1), and lets go of the rest. A script being played overrides this
+ * at the next frame.
+ */
+static inline void controller_set(controllers_t *ctl, unsigned port,
+                                  byte_t buttons) {
+  ctl->buttons[port] = buttons;
+}
+
+/**
+ * @brief Plays the script's next frame, if there is one; called by
+ * run_frame() before every frame. Once the script runs out all buttons are
+ * let go of and the script is dropped.
+ */
+static inline void controller_next_frame(controllers_t *ctl) {
+  if (!ctl->script) {
+    return;
+  }
+  if (ctl->script_pos == ctl->script_len) {
+    controller_feed(ctl, NULL, 0);
+    return;
+  }
+  const byte_t *frame = ctl->script + ctl->script_pos++ * CONTROLLER_PORTS;
+  for (int i = 0; i < CONTROLLER_PORTS; i++) {
+    ctl->buttons[i] = frame[i];
+  }
+}
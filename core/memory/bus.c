@@ -3,136 +3,228 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#include "apu/uapu.h"
+#include "cpu/ucpu.h"
+#include "input/controller.h"
 #include "memory/umem.h"
+#include "ppu/uppu.h"
 
 /**
- * @brief
+ * @brief Reads from a page with nothing behind it.
  *
- * @note This should be a singleton.
+ * Nothing drives the data bus, so the CPU sees whatever was last on it,
+ * which is usually the high byte of the address it just fetched.
+ */
+static byte_t open_bus_read(bus_t *bus, uaddr_t which) { return which >> 8; }
+
+/**
+ * @brief Writes to a page with nothing behind it; the write is dropped.
+ */
+static void open_bus_write(bus_t *bus, uaddr_t which, byte_t what) {}
+
+#ifndef CPU_TESTS
+// the I/O page is only mapped outside of the CPU tests' flat RAM
+
+/**
+ * @brief Reads the APU and I/O registers at $4000-$401F. All but APU_STAT
+ * and the controller ports are write-only, and read as open bus.
+ */
+static byte_t io_reg_read(bus_t *bus, uaddr_t which) {
+  switch (which) {
+    case APU_STAT_ADDR: {
+      if (bus->apu) {
+        return apu_reg_read(bus->apu, which);
+      }
+      break;
+    }
+
+    case CONTROLLER_PORT1_ADDR:
+    case CONTROLLER_PORT2_ADDR: {
+      if (bus->controllers) {
+        return (open_bus_read(bus, which) & ~CONTROLLER_DATA_MASK) |
+               controller_reg_read(bus->controllers, which);
+      }
+      break;
+    }
+  }
+  return open_bus_read(bus, which);
+}
+
+/**
+ * @brief Runs OAM DMA from CPU page `page` ($XX00-$XXFF) in one go: the
+ * page is block-copied into OAM, and the CPU is charged the whole stall at
+ * once rather than making 256 reads and writes.
+ */
+static void oam_dma(bus_t *bus, byte_t page) {
+  ucpu_t *cpu = bus->cpu;
+  if (!bus->ppu || !cpu) {
+    return;
+  }
+
+  const byte_t *src = bus->read_map[page];
+  byte_t buf[UCPU_PAGE_SZ];
+  if (!src) {
+    // a page of registers, which have to be read one at a time
+    for (size_t i = 0; i < UCPU_PAGE_SZ; i++) {
+      buf[i] = get_byte(cpu->buslink, page * UCPU_PAGE_SZ + i);
+    }
+    src = buf;
+  }
+  ppu_oam_dma(bus->ppu, src);
+  cpu_stall(cpu, OAM_DMA_CYCS + (access_clock(cpu) & 1));
+}
+
+/**
+ * @brief Writes the APU and I/O registers at $4000-$401F.
+ */
+static void io_reg_write(bus_t *bus, uaddr_t which, byte_t what) {
+  switch (which) {
+    case OAM_DMA_ADDR: {
+      oam_dma(bus, what);
+      break;
+    }
+
+    case CONTROLLER_STROBE_ADDR: {
+      if (bus->controllers) {
+        controller_reg_write(bus->controllers, which, what);
+      }
+      break;
+    }
+
+    case APU_STAT_ADDR:
+    case APU_FRAME_ADDR: {
+      if (bus->apu) {
+        apu_reg_write(bus->apu, which, what);
+      }
+      break;
+    }
+
+    default: {
+      if (which <= APU_DMC_END_ADDR && bus->apu) {
+        apu_reg_write(bus->apu, which, what);
+      }
+      break;
+    }
+  }
+}
+
+#endif
+
+/**
+ * @brief Creates a bus with its own RAM. Each console needs a bus of its
+ * own; nothing is shared between buses.
  */
 bus_t new_bus() {
-  bus_t bus = {NULL, NULL};
+  bus_t bus = {0};
+  map_io(&bus, 0, UNES_MEM_CAP, open_bus_read, open_bus_write);
+  bus.ppu_ram = alloc_ram(UPPU_VRAM_CAP);
+  map_nametables(&bus, MIRROR_HORIZONTAL);
 #ifdef CPU_TESTS
+  // Tom Harte's tests treat the whole address space as flat RAM
   bus.cpu_ram = alloc_ram(TH_UNITTEST_MEM_CAP);
+  map_memory(&bus, 0, TH_UNITTEST_MEM_CAP, bus.cpu_ram, TH_UNITTEST_MEM_CAP,
+             true);
+#else
+  bus.cpu_ram = alloc_ram(UCPU_MEM_CAP);
+  // the PPU's registers at $2000-$3FFF are open bus until connect_ppu()
+  map_memory(&bus, 0, UCPU_MIRROR_RANGE, bus.cpu_ram, UCPU_MEM_CAP, true);
+  map_io(&bus, UCPU_PPU_REG_RANGE, UCPU_PAGE_SZ, io_reg_read, io_reg_write);
 #endif
-  // not implemented
   return bus;
 }
 
+/**
+ * @brief Releases the RAM new_bus() allocated.
+ */
+void free_bus(bus_t *bus) {
+#ifdef CPU_TESTS
+  munmap(bus->cpu_ram, TH_UNITTEST_MEM_CAP);
+#else
+  munmap(bus->cpu_ram, UCPU_MEM_CAP);
+#endif
+  munmap(bus->ppu_ram, UPPU_VRAM_CAP);
+  bus->cpu_ram = NULL;
+  bus->ppu_ram = NULL;
+}
+
 /**
  * @brief Connects a device to the bus.
  *
  * A device should pass in a reference to its buslink, as well as
- * the (singleton) bus to which it wants to link itself.
+ * the bus to which it wants to link itself.
  */
 void link_device(buslink_t *link, bus_t *bus) { link->bus = bus; }
 
 /**
- * @brief Sets the byte at *emulated* address `which` to what.
+ * @brief Backs the pages in [start, start + len) directly with `mem`.
+ *
+ * `mem` is mirrored every `mem_len` bytes across the range. Both `start`
+ * and `len` must be multiples of UCPU_PAGE_SZ, and `mem_len` must be a
+ * multiple of UCPU_PAGE_SZ that divides `len`.
+ *
+ * If `writable` is false only reads are backed by `mem`, and writes keep
+ * going to whichever handler was last installed with map_io().
  */
-void set_byte(buslink_t link, uaddr_t which, byte_t what) {
-  bus_t *bus = link.bus;
-  switch (link.device) {
-    case DEV_CPU: {
-#ifdef DEBUG
-      printf("Address %" PRIu16 " set to %" PRIu8 ".\n", which, what);
-#endif
-#ifdef CPU_TESTS
-      bus->cpu_ram[which] = what;
-#else
-      if (which < UCPU_MIRROR_RANGE) {
-        bus->cpu_ram[which % UCPU_MEM_CAP] = what;
-      } else if (which < UCPU_PPU_REG_RANGE) {
-        uppu_t *ppu = bus->ppu;
-
-        // writing anything to the PPU registers (even to STATUS)
-        // fills the 8-bit latch. when reading a write-only
-        // register, the value of the latch is returned.
-        // latch delay is unimplemented.
-        bus->p_latch = what;
-
-        // handle mirroring
-        uaddr_t request = (which % 8) + PPU_CTRL_ADDR;
-
-        switch (request) {
-          case PPU_CTRL_ADDR: {
-            ppu->PPU_CTRL = (ustat_t)what;
-            break;
-          }
-
-          case PPU_MASK_ADDR: {
-            ppu->PPU_MASK = (ustat_t)what;
-            break;
-          }
-
-          case PPU_OAMA_ADDR: {
-            ppu->OAM_ADDR = what;
-            break;
-          }
-
-          case PPU_OAMD_ADDR: {
-            ppu->OAM_DATA = what;
-            break;
-          }
-
-          case PPU_SCRL_ADDR: {
-            ppu->PPU_SCRL = what;
-            // toggle the write latch
-            ppu->w = !ppu->w;
-            break;
-          }
-
-          case PPU_ADDR_ADDR: {
-            ppu->PPU_ADDR = what;
-            // toggle the write latch
-            ppu->w = !ppu->w;
-            break;
-          }
-
-          case PPU_DATA_ADDR: {
-            ppu->OAM_DATA = what;
-            break;
-          }
-
-          case OAM_DMA_ADDR: {
-            // unimplemented for now...
-            break;
-          }
-
-          default:  // do nothing
-        }
-      } else {
-      }
+void map_memory(bus_t *bus, uaddr_t start, size_t len, byte_t *mem,
+                size_t mem_len, bool writable) {
+  size_t first = start / UCPU_PAGE_SZ;
+  for (size_t off = 0; off < len; off += UCPU_PAGE_SZ) {
+    byte_t *page = mem + (off % mem_len);
+    bus->read_map[first + off / UCPU_PAGE_SZ] = page;
+    bus->write_map[first + off / UCPU_PAGE_SZ] = writable ? page : NULL;
+  }
+}
 
-      break;
-#endif
-    }
+/**
+ * @brief Routes all accesses to the pages in [start, start + len) through
+ * the given handlers.
+ *
+ * Both `start` and `len` must be multiples of UCPU_PAGE_SZ.
+ */
+void map_io(bus_t *bus, uaddr_t start, size_t len, bus_reader_t reader,
+            bus_writer_t writer) {
+  size_t first = start / UCPU_PAGE_SZ;
+  for (size_t page = first; page < first + len / UCPU_PAGE_SZ; page++) {
+    bus->read_map[page] = NULL;
+    bus->write_map[page] = NULL;
+    bus->read_fns[page] = reader;
+    bus->write_fns[page] = writer;
   }
 }
 
 /**
- * @brief Gets the byte at *emulated* address `which`.
+ * @brief Backs the PPU pages in [start, start + len) directly with `mem`.
+ *
+ * Same as map_memory(), but for the PPU's address space; both `start` and
+ * `len` must be multiples of UPPU_PAGE_SZ. If `writable` is false, writes to
+ * the range are dropped. Caches of PPU memory (e.g. the PPU's decoded
+ * pattern tables) notice the change through ppu_map_gen.
  */
-byte_t get_byte(buslink_t link, uaddr_t which) {
-  bus_t *bus = link.bus;
-  switch (link.device) {
-    case DEV_CPU: {
-#ifdef DEBUG
-      printf("Read %" PRIu8 " at address %" PRIu16 ".\n", bus->cpu_ram[which],
-             which);
-#endif
-#ifdef CPU_TESTS
-      if (which > CART_ROM_START) {
-        return bus->cartridge[(which - CART_ROM_START) % MAPPER_0_RANGE];
-      }
-      return bus->cpu_ram[which];
-#endif
-      if (which < UCPU_MIRROR_RANGE) {
-        return bus->cpu_ram[which % UCPU_MEM_CAP];
-      } else if (which < UCPU_PPU_REG_RANGE) {
-      } else {
-      }
-      break;
-    }
+void map_ppu_memory(bus_t *bus, uaddr_t start, size_t len, byte_t *mem,
+                    size_t mem_len, bool writable) {
+  size_t first = start / UPPU_PAGE_SZ;
+  bus->ppu_map_gen++;
+  for (size_t off = 0; off < len; off += UPPU_PAGE_SZ) {
+    byte_t *page = mem + (off % mem_len);
+    bus->ppu_read_map[first + off / UPPU_PAGE_SZ] = page;
+    bus->ppu_write_map[first + off / UPPU_PAGE_SZ] = writable ? page : NULL;
+  }
+}
+
+/**
+ * @brief Lays the four nametables at $2000-$2FFF (and their mirror at
+ * $3000-$3EFF) out over nametable RAM.
+ */
+void map_nametables(bus_t *bus, mirroring_t mirroring) {
+  // which 1 KB of nametable RAM backs each of the four nametables
+  static const uint8_t LAYOUTS[][4] = {
+      [MIRROR_HORIZONTAL] = {0, 0, 1, 1}, [MIRROR_VERTICAL] = {0, 1, 0, 1},
+      [MIRROR_SINGLE_LOW] = {0, 0, 0, 0}, [MIRROR_SINGLE_HIGH] = {1, 1, 1, 1},
+      [MIRROR_FOUR_SCREEN] = {0, 1, 2, 3}};
+
+  for (size_t nt = 0; nt < 8; nt++) {
+    byte_t *page = bus->ppu_ram + LAYOUTS[mirroring][nt % 4] * UPPU_PAGE_SZ;
+    bus->ppu_read_map[UPPU_NAMETABLE_START / UPPU_PAGE_SZ + nt] = page;
+    bus->ppu_write_map[UPPU_NAMETABLE_START / UPPU_PAGE_SZ + nt] = page;
   }
-}
\ No newline at end of file
+}
@@ -1,18 +1,113 @@
 #pragma once
+#ifdef DEBUG
+#include <inttypes.h>
+#include <stdio.h>
+#endif
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "memory/bustrace.h"
 #include "memory/umem.h"
 
+/*
+ * The CPU's address space, carved into UCPU_PAGE_SZ-byte pages.
+ */
+#define UCPU_PAGE_COUNT (UNES_MEM_CAP / UCPU_PAGE_SZ)
+
+/*
+ * The PPU's address space, carved into 1 KB pages: the granularity at which
+ * mappers switch CHR banks and nametables are mirrored.
+ */
+#define UPPU_PAGE_SZ 0x400u
+#define UPPU_PAGE_COUNT (UPPU_MEM_CAP / UPPU_PAGE_SZ)
+
+/*
+ * Where the nametables start in the PPU's address space.
+ */
+#define UPPU_NAMETABLE_START 0x2000u
+
+/*
+ * How the four logical nametables are laid out over the console's (and,
+ * for four-screen carts, the cartridge's) nametable RAM.
+ */
+typedef enum {
+  MIRROR_HORIZONTAL,
+  MIRROR_VERTICAL,
+  MIRROR_SINGLE_LOW,
+  MIRROR_SINGLE_HIGH,
+  MIRROR_FOUR_SCREEN
+} mirroring_t;
+
+/*
+ * Devices that can pull the CPU's IRQ line. The line stays asserted for as
+ * long as any of them holds it.
+ */
+#define IRQ_MAPPER 0x01u
+#define IRQ_APU_FRAME 0x02u
+#define IRQ_APU_DMC 0x04u
+
+struct bus;
+
+/*
+ * Handlers for pages that are not plain memory (i.e. I/O registers, mapper
+ * registers). `which` is the full emulated address being accessed.
+ */
+typedef byte_t (*bus_reader_t)(struct bus *bus, uaddr_t which);
+typedef void (*bus_writer_t)(struct bus *bus, uaddr_t which, byte_t what);
+
 /*
  * The "bus" itself. Exists as a way to programmatically enable connections
  * between different devices, including exposing PPU registers to the CPU,
  * enabling hardware interrupts, etc.
+ *
+ * Every page of the CPU's address space is either backed directly by a
+ * host pointer or routed to a handler. Reads and writes are looked up
+ * separately, so e.g. PRG-ROM pages can be read directly while writes to
+ * them reach the mapper. The maps are rebuilt whenever the memory behind
+ * a page changes (e.g. when a mapper bank-switches), never checked on
+ * access.
  */
 typedef struct bus {
+  /* PAGE TABLES */
+
+  byte_t *read_map[UCPU_PAGE_COUNT];   // NULL if reads go to read_fns
+  byte_t *write_map[UCPU_PAGE_COUNT];  // NULL if writes go to write_fns
+  bus_reader_t read_fns[UCPU_PAGE_COUNT];
+  bus_writer_t write_fns[UCPU_PAGE_COUNT];
+
+  // Same as above, for the PPU's address space. Writes to pages with no
+  // entry in ppu_write_map (e.g. CHR-ROM) are dropped.
+  byte_t *ppu_read_map[UPPU_PAGE_COUNT];
+  byte_t *ppu_write_map[UPPU_PAGE_COUNT];
+  uint32_t ppu_map_gen;  // bumped whenever map_ppu_memory() runs
+
+  /* INTERRUPT LINES */
+
+  bool nmi;     // set on an NMI edge; cleared once the CPU takes it
+  ustat_t irq;  // one IRQ_* bit per device holding the line
+
+  /* CATCH-UP */
+
+  // Brings the chips that run behind the CPU up to its access in progress.
+  // Handlers call it before an access that changes what those chips will
+  // do, e.g. a CHR bank switch. NULL if nothing runs behind the CPU.
+  void (*sync)(struct bus *bus);
+
+  /* DEVICES */
+
   ram_t cpu_ram;
-  ram_t ppu_ram;  // will add more later
+  ram_t ppu_ram;  // nametable RAM
   void *cpu;
   void *ppu;
-  byte_t *cartridge;  // assume mapper 0 for now
+  void *apu;
+  void *controllers;
+  void *cart;
+  void *mapper;
   ustat_t p_latch;
+
+#ifdef UNES_BUS_TRACE
+  bus_trace_t *trace;  // where accesses are recorded; NULL to record none
+#endif
 } bus_t;
 
 /*
@@ -22,8 +117,6 @@ typedef enum device { DEV_CPU, DEV_PPU, DEV_APU, DEV_ROM } device_t;
 
 /*
  * Represents a device-specific "link" onto the bus.
- * Depending on this link, byte setting and getting may produce different
- * behavior.
  */
 typedef struct buslink {
   device_t device;
@@ -31,8 +124,60 @@ typedef struct buslink {
 } buslink_t;
 
 bus_t new_bus();
+void free_bus(bus_t *bus);
 
 void link_device(buslink_t *link, bus_t *bus);
 
-void set_byte(buslink_t link, uaddr_t which, byte_t what);
-byte_t get_byte(buslink_t link, uaddr_t which);
\ No newline at end of file
+void map_memory(bus_t *bus, uaddr_t start, size_t len, byte_t *mem,
+                size_t mem_len, bool writable);
+void map_io(bus_t *bus, uaddr_t start, size_t len, bus_reader_t reader,
+            bus_writer_t writer);
+
+void map_ppu_memory(bus_t *bus, uaddr_t start, size_t len, byte_t *mem,
+                    size_t mem_len, bool writable);
+void map_nametables(bus_t *bus, mirroring_t mirroring);
+
+/*
+ * Byte getting and setting are by far the most frequent operations in the
+ * emulator, so they are defined here to be inlined into every caller.
+ */
+
+/**
+ * @brief Sets the byte at *emulated* address `which` to what.
+ */
+static inline void set_byte(buslink_t link, uaddr_t which, byte_t what) {
+  bus_t *bus = link.bus;
+#ifdef DEBUG
+  printf("Address %" PRIu16 " set to %" PRIu8 ".\n", which, what);
+#endif
+#ifdef UNES_BUS_TRACE
+  if (bus->trace) {
+    bus_trace_record(bus->trace, link.device, which, what, true);
+  }
+#endif
+  byte_t *page = bus->write_map[which / UCPU_PAGE_SZ];
+  if (page) {
+    page[which % UCPU_PAGE_SZ] = what;
+  } else {
+    bus->write_fns[which / UCPU_PAGE_SZ](bus, which, what);
+  }
+}
+
+/**
+ * @brief Gets the byte at *emulated* address `which`.
+ */
+static inline byte_t get_byte(buslink_t link, uaddr_t which) {
+  bus_t *bus = link.bus;
+  byte_t *page = bus->read_map[which / UCPU_PAGE_SZ];
+  byte_t what = page ? page[which % UCPU_PAGE_SZ]
+                     : bus->read_fns[which / UCPU_PAGE_SZ](bus, which);
+#ifdef UNES_BUS_TRACE
+  if (bus->trace) {
+    bus_trace_record(bus->trace, link.device, which, what, false);
+  }
+#endif
+#ifdef DEBUG
+  printf("Read %" PRIu8 " at address %" PRIu16 ".\n", what, which);
+#endif
+  return what;
+}
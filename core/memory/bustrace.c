@@ -0,0 +1,55 @@
+/**
+ * @file bustrace.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "memory/bustrace.h"
+
+#include <sys/mman.h>
+
+/**
+ * @brief Allocates a trace holding the last `cap` accesses, rounded up to a
+ * power of two. Nothing is allocated after this, so tracing never does.
+ *
+ * @returns 0 on success, or -1 if the ring couldn't be allocated.
+ */
+int init_bus_trace(bus_trace_t *trace, size_t cap) {
+  size_t sz = 1;
+  while (sz < cap) sz <<= 1;
+
+  trace->ring = (bus_access_t *)alloc_ram(sz * sizeof(bus_access_t));
+  if ((void *)trace->ring == MAP_FAILED) {
+    trace->ring = NULL;
+    return -1;
+  }
+  trace->mask = sz - 1;
+  trace->count = 0;
+  return 0;
+}
+
+/**
+ * @brief Releases the ring init_bus_trace() allocated.
+ */
+void free_bus_trace(bus_trace_t *trace) {
+  if (trace->ring) {
+    munmap(trace->ring, (trace->mask + 1) * sizeof(bus_access_t));
+  }
+  trace->ring = NULL;
+}
+
+/**
+ * @brief Copies out the last `n` accesses still in the ring (or as many as
+ * it holds), oldest first.
+ *
+ * @returns how many accesses were copied.
+ */
+size_t bus_trace_last(const bus_trace_t *trace, bus_access_t *out,
+                      size_t n) {
+  size_t held = bus_trace_wrapped(trace) ? trace->mask + 1 : trace->count;
+  n = n < held ? n : held;
+  for (uint64_t i = trace->count - n; i < trace->count; i++) {
+    *out++ = trace->ring[i & trace->mask];
+  }
+  return n;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file bustrace.h
+ * @brief A record of every access made through the CPU's bus.
+ *
+ * Building with UNES_BUS_TRACE makes get_byte() and set_byte() append each
+ * access to the ring of the bus's trace, if it has one, e.g. to check dummy
+ * reads and writes against Tom Harte's per-cycle tests. Without the flag
+ * the hooks, and the bus's trace pointer, are compiled out entirely.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory/umem.h"
+
+/*
+ * bus_access_t flag bits; the rest of the byte holds the device_t that
+ * made the access
+ */
+#define ACCESS_WRITE 0x80u
+#define ACCESS_DEVICE 0x7Fu
+
+typedef struct bus_access {
+  uaddr_t addr;
+  byte_t val;
+  byte_t flags;
+} bus_access_t;
+
+/*
+ * A ring of the most recent accesses. Once it is full, every access
+ * overwrites the oldest one.
+ */
+typedef struct bus_trace {
+  bus_access_t *ring;  // `mask + 1` entries, a power of two
+  size_t mask;
+  uint64_t count;  // accesses recorded since the last clear
+} bus_trace_t;
+
+int init_bus_trace(bus_trace_t *trace, size_t cap);
+void free_bus_trace(bus_trace_t *trace);
+size_t bus_trace_last(const bus_trace_t *trace, bus_access_t *out, size_t n);
+
+/**
+ * @brief Appends an access to the trace.
+ */
+static inline void bus_trace_record(bus_trace_t *trace, int device,
+                                    uaddr_t addr, byte_t val, bool write) {
+  trace->ring[trace->count++ & trace->mask] =
+      (bus_access_t){addr, val, (write ? ACCESS_WRITE : 0) | device};
+}
+
+/**
+ * @brief Forgets everything recorded so far.
+ */
+static inline void bus_trace_clear(bus_trace_t *trace) { trace->count = 0; }
+
+/**
+ * @brief Whether accesses have been lost since the last clear, i.e. more
+ * were made than the ring holds.
+ */
+static inline bool bus_trace_wrapped(const bus_trace_t *trace) {
+  return trace->count > trace->mask + 1;
+}
@@ -9,8 +9,6 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
-#include "ppu/uppu.h"
-
 /*
  * The NES possesses 256 pages X 256 bytes of memory.
  */
@@ -21,20 +19,38 @@
  */
 #define UCPU_MEM_CAP (2048)
 
+/*
+ * The PPU addresses 16 KB: pattern tables, nametables and palettes.
+ */
+#define UPPU_MEM_CAP (16 * 1024)
+
+/*
+ * The console holds 2 KB of nametable RAM; four-screen cartridges bring
+ * another 2 KB, which we always allocate.
+ */
+#define UPPU_VRAM_CAP (4 * 1024)
+
 /*
  */
 #define UCPU_MIRROR_RANGE 0x2000u
 
 #define UCPU_PAGE_SZ 0x100u
 
-// TODO: move to mappers and generalize
+/*
+ * Where cartridge PRG-ROM starts in the CPU's address space.
+ */
 #define CART_ROM_START 0x8000u
-#define MAPPER_0_RANGE 0x4000u
 
 /*
  */
 #define UCPU_PPU_REG_RANGE 0x4000u
 
+/*
+ * Host cache line size. State that different threads write goes on
+ * separate lines, so they don't contend for them.
+ */
+#define CACHE_LINE_SZ 64
+
 /*
  * Macro for Tom Harte CPU unit tests.
  */
@@ -51,6 +67,12 @@
  */
 typedef uint16_t uaddr_t;  // Memory address type/PC register type
 
+/*
+ * All other registers, of the CPU and of every other device, are 8 bits
+ * wide.
+ */
+typedef uint8_t uregr_t;
+
 /*
  * Many components of the NES support an 8-flag "status" group
  * or latch. They can be considered as being packed into a single
@@ -0,0 +1,340 @@
+/**
+ * @file movie.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "nes/movie.h"
+
+#include <string.h>
+
+#include "nes/savestate.h"
+
+/*
+ * Magic, version, keyframe interval, ROM hash and start state length
+ */
+#define MOVIE_HEADER_SZ 28
+
+/*
+ * The most a record can take: a 10-byte varint and two hashes
+ */
+#define MAX_RECORD_SZ 32
+
+/*
+ * 64-bit FNV-1a
+ */
+#define FNV_OFFSET 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+static const char *MOVIE_ERR_DESCRIPTIONS[] = {
+    [MOVIE_OK] = "no error",
+    [MOVIE_ERR_FORMAT] = "not a movie, or a damaged one",
+    [MOVIE_ERR_FULL] = "out of room to record the movie",
+    [MOVIE_ERR_ROM] = "movie is for a different ROM",
+    [MOVIE_ERR_STATE] = "movie starts from a state this build can't load",
+    [MOVIE_ERR_DESYNC] = "playback went out of sync with the movie"};
+
+/* ENCODING */
+
+static byte_t *put_le32(byte_t *out, uint32_t what) {
+  for (int i = 0; i < 4; i++) {
+    *out++ = what >> (8 * i);
+  }
+  return out;
+}
+
+static byte_t *put_le64(byte_t *out, uint64_t what) {
+  for (int i = 0; i < 8; i++) {
+    *out++ = what >> (8 * i);
+  }
+  return out;
+}
+
+static uint64_t get_le(const byte_t *in, int n) {
+  uint64_t x = 0;
+  for (int i = 0; i < n; i++) {
+    x |= (uint64_t)in[i] << (8 * i);
+  }
+  return x;
+}
+
+static byte_t *put_varint(byte_t *out, uint64_t what) {
+  while (what >= 0x80) {
+    *out++ = (what & 0x7F) | 0x80;
+    what >>= 7;
+  }
+  *out++ = what;
+  return out;
+}
+
+/**
+ * @brief Reads the varint at mv->pos, and moves past it.
+ *
+ * @return false if it runs off the end of the movie, or out of bits.
+ */
+static bool get_varint(movie_t *mv, uint64_t *what) {
+  uint64_t x = 0;
+  for (int shift = 0; shift < 64 && mv->pos < mv->len; shift += 7) {
+    byte_t b = mv->buf[mv->pos++];
+    x |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *what = x;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t fnv1a(uint64_t h, const byte_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ buf[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+/* HASHES */
+
+/**
+ * @brief A hash of the whole ROM image, header and all.
+ */
+uint64_t rom_hash(const cartridge_t *cart) {
+  return fnv1a(FNV_OFFSET, cart->_data_ptr, cart->cartridge_sz);
+}
+
+/**
+ * @brief A hash of the console's CPU RAM and the cartridge's PRG-RAM.
+ */
+uint64_t ram_hash(const unes_t *nes) {
+  uint64_t h = fnv1a(FNV_OFFSET, nes->bus.cpu_ram, UCPU_MEM_CAP);
+  return fnv1a(h, nes->cart.prg_ram.data, nes->cart.prg_ram.size);
+}
+
+/**
+ * @brief A hash of the frame last drawn to the console's screen, which
+ * must be set, and read by nothing else (it is taken as a display would
+ * take it). The pixels are hashed as the host stores them, so frame hashes
+ * (unlike the rest of a movie) only compare between hosts of the same byte
+ * order.
+ */
+static uint64_t frame_hash(const unes_t *nes) {
+  const pixel_t *px = latest_frame(nes->ppu.screen, NULL);
+  return fnv1a(FNV_OFFSET, (const byte_t *)px, FRAME_PX * sizeof(pixel_t));
+}
+
+/* RECORDING */
+
+/**
+ * @brief Writes out the run of frames recorded so far, if there is one.
+ */
+static movie_err_t flush_run(movie_t *mv) {
+  if (mv->run_len == 0) {
+    return MOVIE_OK;
+  }
+  if (mv->cap - mv->len < MAX_RECORD_SZ) {
+    return MOVIE_ERR_FULL;
+  }
+  byte_t *at = put_varint(mv->buf + mv->len, mv->run_len << 1);
+  memcpy(at, mv->run, CONTROLLER_PORTS);
+  mv->len = at + CONTROLLER_PORTS - mv->buf;
+  mv->run_len = 0;
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Writes a keyframe of `nes` as it is now.
+ */
+static movie_err_t put_key(movie_t *mv, const unes_t *nes) {
+  if (mv->cap - mv->len < MAX_RECORD_SZ) {
+    return MOVIE_ERR_FULL;
+  }
+  byte_t what = KEY_RAM | (nes->ppu.screen ? KEY_FRAME : 0);
+  byte_t *at = put_varint(mv->buf + mv->len, (what << 1) | 1);
+  at = put_le64(at, ram_hash(nes));
+  if (what & KEY_FRAME) {
+    at = put_le64(at, frame_hash(nes));
+  }
+  mv->len = at - mv->buf;
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Starts recording a movie of `nes` into `buf`, which the caller
+ * keeps until the movie is finished.
+ *
+ * @param key_interval Frames between keyframes, or 0 for none.
+ * @param from_state Whether the movie starts from a savestate of `nes` as
+ * it is now. If not, it starts from power-on, and `nes` must not have run
+ * since it was powered on.
+ *
+ * @return MOVIE_OK, or MOVIE_ERR_FULL if `cap` bytes aren't enough for the
+ * header.
+ */
+movie_err_t movie_record(movie_t *mv, const unes_t *nes, void *buf,
+                         size_t cap, unsigned key_interval, bool from_state) {
+  memset(mv, 0, sizeof(*mv));
+  size_t state_len = from_state ? state_size(nes) : 0;
+  if (cap < MOVIE_HEADER_SZ + state_len) {
+    return MOVIE_ERR_FULL;
+  }
+  mv->buf = buf;
+  mv->cap = cap;
+  mv->rom = rom_hash(&nes->cart);
+  mv->key_interval = key_interval;
+
+  byte_t *at = mv->buf;
+  memcpy(at, MOVIE_MAGIC, 8);
+  at = put_le32(at + 8, MOVIE_VERSION);
+  at = put_le32(at, key_interval);
+  at = put_le64(at, mv->rom);
+  at = put_le32(at, state_len);
+  at += save_state(nes, at, state_len);
+  mv->len = mv->start = at - mv->buf;
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Records the frame `nes` just ran, with the buttons that were held
+ * for it, and a keyframe if one is due. Meant to be called after every
+ * run_frame().
+ *
+ * @return MOVIE_OK, or MOVIE_ERR_FULL if the buffer ran out; the frame is
+ * lost if so.
+ */
+movie_err_t movie_record_frame(movie_t *mv, const unes_t *nes) {
+  const byte_t *held = nes->controllers.buttons;
+  if (mv->run_len > 0 && memcmp(held, mv->run, CONTROLLER_PORTS) != 0) {
+    movie_err_t err = flush_run(mv);
+    if (err != MOVIE_OK) {
+      return err;
+    }
+  }
+  memcpy(mv->run, held, CONTROLLER_PORTS);
+  mv->run_len++;
+  mv->frames++;
+
+  if (mv->key_interval && mv->frames % mv->key_interval == 0) {
+    movie_err_t err = flush_run(mv);
+    return err == MOVIE_OK ? put_key(mv, nes) : err;
+  }
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Writes out what is left of a recording. The movie is then the
+ * first mv->len bytes of the buffer.
+ */
+movie_err_t movie_finish(movie_t *mv) { return flush_run(mv); }
+
+/* PLAYBACK */
+
+/**
+ * @brief Opens the movie in `buf` for playback. The caller keeps `buf`
+ * until it is done with the movie.
+ *
+ * @return MOVIE_OK, or MOVIE_ERR_FORMAT if the header is no good.
+ */
+movie_err_t movie_open(movie_t *mv, const void *buf, size_t len) {
+  memset(mv, 0, sizeof(*mv));
+  const byte_t *in = buf;
+  if (len < MOVIE_HEADER_SZ || memcmp(in, MOVIE_MAGIC, 8) != 0 ||
+      get_le(in + 8, 4) != MOVIE_VERSION) {
+    return MOVIE_ERR_FORMAT;
+  }
+  uint64_t state_len = get_le(in + 24, 4);
+  if (len - MOVIE_HEADER_SZ < state_len) {
+    return MOVIE_ERR_FORMAT;
+  }
+
+  mv->buf = (byte_t *)in;  // only ever read from
+  mv->len = len;
+  mv->key_interval = get_le(in + 12, 4);
+  mv->rom = get_le(in + 16, 8);
+  mv->start = mv->pos = MOVIE_HEADER_SZ + state_len;
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Puts `nes` where the movie starts, ready for movie_play(). `nes`
+ * must be powered on with the movie's ROM and, if the movie starts from
+ * power-on, must not have run since.
+ *
+ * @return MOVIE_OK, or why the movie can't be played on `nes`; `nes` is
+ * left untouched if so.
+ */
+movie_err_t movie_start(movie_t *mv, unes_t *nes) {
+  if (rom_hash(&nes->cart) != mv->rom) {
+    return MOVIE_ERR_ROM;
+  }
+  size_t state_len = mv->start - MOVIE_HEADER_SZ;
+  if (state_len > 0 &&
+      load_state(nes, mv->buf + MOVIE_HEADER_SZ, state_len) != SAVE_OK) {
+    return MOVIE_ERR_STATE;
+  }
+  controller_feed(&nes->controllers, NULL, 0);
+  mv->pos = mv->start;
+  mv->frames = 0;
+  return MOVIE_OK;
+}
+
+/**
+ * @brief Plays the rest of the movie on `nes`, as fast as it will run.
+ * Held buttons are set once per run of frames rather than every frame.
+ *
+ * @param verify Whether to check `nes` against the movie's keyframes. Frame
+ * hashes are only checked if `nes` has a screen.
+ *
+ * @return MOVIE_OK once the movie is over, or MOVIE_ERR_DESYNC as soon as
+ * a keyframe disagrees (with mv->bad_frame set to the frames played by
+ * then), or MOVIE_ERR_FORMAT if the movie is damaged.
+ */
+movie_err_t movie_play(movie_t *mv, unes_t *nes, bool verify) {
+  while (mv->pos < mv->len) {
+    uint64_t tag;
+    if (!get_varint(mv, &tag)) {
+      return MOVIE_ERR_FORMAT;
+    }
+
+    if (!(tag & 1)) {
+      if (mv->len - mv->pos < CONTROLLER_PORTS) {
+        return MOVIE_ERR_FORMAT;
+      }
+      for (unsigned i = 0; i < CONTROLLER_PORTS; i++) {
+        controller_set(&nes->controllers, i, mv->buf[mv->pos++]);
+      }
+      for (uint64_t n = tag >> 1; n > 0; n--) {
+        run_frame(nes);
+      }
+      mv->frames += tag >> 1;
+      continue;
+    }
+
+    uint64_t what = tag >> 1;
+    size_t need = (what & KEY_RAM ? 8 : 0) + (what & KEY_FRAME ? 8 : 0);
+    if ((what & ~(uint64_t)(KEY_RAM | KEY_FRAME)) ||
+        mv->len - mv->pos < need) {
+      return MOVIE_ERR_FORMAT;
+    }
+    const byte_t *at = mv->buf + mv->pos;
+    mv->pos += need;
+    if (!verify) {
+      continue;
+    }
+    bool ok = true;
+    if (what & KEY_RAM) {
+      ok = get_le(at, 8) == ram_hash(nes);
+      at += 8;
+    }
+    if ((what & KEY_FRAME) && nes->ppu.screen) {
+      ok = ok && get_le(at, 8) == frame_hash(nes);
+    }
+    if (!ok) {
+      mv->bad_frame = mv->frames;
+      return MOVIE_ERR_DESYNC;
+    }
+  }
+  return MOVIE_OK;
+}
+
+const char *describe_movie_err(movie_err_t err) {
+  return MOVIE_ERR_DESCRIPTIONS[err];
+}
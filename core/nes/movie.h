@@ -0,0 +1,89 @@
+/**
+ * @file movie.h
+ * @brief Input movies: a run's controller input, recorded a frame at a
+ * time, that plays the run back exactly.
+ *
+ * A movie is a header followed by a stream of records:
+ *
+ *   header:  "uNESmovi", version (u32), keyframe interval (u32),
+ *            ROM hash (u64), start state length (u32), then the state
+ *   record:  tag (varint), then
+ *            - a run, if bit 0 of the tag is clear: the rest of the tag
+ *              is a number of frames, and CONTROLLER_PORTS bytes follow,
+ *              the buttons held for all of them
+ *            - a keyframe, if it is set: the rest of the tag is KEY_*
+ *              bits, and a hash (u64) follows for each bit set
+ *
+ * Varints are LEB128 and fixed-size fields are little-endian. Held buttons
+ * cost one record however long they stay held, so a movie typically takes
+ * a few bytes a second. A keyframe holds hashes of the console as it was
+ * after the frames recorded before it. When played back with verification,
+ * they pinpoint where a build stops reproducing the run to within one
+ * keyframe interval.
+ *
+ * A movie starts either from power-on, and then plays back on any build,
+ * or from a savestate, and then only on builds that can load the state
+ * (see nes/savestate.h).
+ *
+ * Everything is kept in a buffer the caller owns; nothing is allocated.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes/unes.h"
+
+#define MOVIE_MAGIC "uNESmovi"
+#define MOVIE_VERSION 1u
+
+/*
+ * What a keyframe holds a hash of
+ */
+#define KEY_RAM 0x01u    // CPU RAM and PRG-RAM
+#define KEY_FRAME 0x02u  // the frame last drawn; only if there is a screen
+
+/*
+ * Reasons recording or playing back a movie can fail.
+ */
+typedef enum {
+  MOVIE_OK = 0,
+  MOVIE_ERR_FORMAT,  // not a movie this build can read, or a truncated one
+  MOVIE_ERR_FULL,    // the buffer ran out while recording
+  MOVIE_ERR_ROM,     // recorded on a different ROM
+  MOVIE_ERR_STATE,   // its start state can't be loaded by this build
+  MOVIE_ERR_DESYNC   // a keyframe didn't match; see movie_t.bad_frame
+} movie_err_t;
+
+typedef struct movie {
+  byte_t *buf;  // the movie, which the caller owns
+  size_t cap;   // bytes that can be recorded into it
+  size_t len;   // bytes recorded, or to be played
+  size_t pos;   // the next record to play
+
+  size_t start;           // where the records start, after the header
+  uint64_t rom;           // rom_hash() of the ROM it was recorded on
+  unsigned key_interval;  // frames between keyframes; 0 for none
+  uint64_t frames;        // recorded or played so far
+  uint64_t bad_frame;     // frames played when a keyframe disagreed
+
+  // recording: the run not yet written out
+  byte_t run[CONTROLLER_PORTS];
+  uint64_t run_len;
+} movie_t;
+
+const char *describe_movie_err(movie_err_t err);
+
+movie_err_t movie_record(movie_t *mv, const unes_t *nes, void *buf,
+                         size_t cap, unsigned key_interval, bool from_state);
+movie_err_t movie_record_frame(movie_t *mv, const unes_t *nes);
+movie_err_t movie_finish(movie_t *mv);
+
+movie_err_t movie_open(movie_t *mv, const void *buf, size_t len);
+movie_err_t movie_start(movie_t *mv, unes_t *nes);
+movie_err_t movie_play(movie_t *mv, unes_t *nes, bool verify);
+
+uint64_t rom_hash(const cartridge_t *cart);
+uint64_t ram_hash(const unes_t *nes);
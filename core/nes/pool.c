@@ -0,0 +1,300 @@
+/**
+ * @file pool.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "nes/pool.h"
+
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * What deque_take() and deque_steal() return when they come up empty
+ */
+#define NO_TASK (-1L)
+
+/* THE DEQUES */
+
+/*
+ * Chase-Lev work-stealing deques, with the memory orderings from Le et
+ * al., "Correct and Efficient Work-Stealing for Weak Memory Models" (2013).
+ * Every console is in at most one deque at a time, so a deque as big as
+ * the pool never fills up and never needs to grow.
+ */
+
+static void deque_push(pool_t *pool, pool_deque_t *d, uint32_t task) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  atomic_store_explicit(&d->tasks[b & pool->deque_mask], task,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Takes the newest task off the owner's end of `d`.
+ */
+static long deque_take(pool_t *pool, pool_deque_t *d) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+  long task = NO_TASK;
+  if (t <= b) {
+    task = atomic_load_explicit(&d->tasks[b & pool->deque_mask],
+                                memory_order_relaxed);
+    if (t == b) {
+      // the last task; race any thieves for it
+      if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                   memory_order_seq_cst,
+                                                   memory_order_relaxed)) {
+        task = NO_TASK;
+      }
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+/**
+ * @brief Steals the oldest task off the other end of `d`.
+ */
+static long deque_steal(pool_t *pool, pool_deque_t *d) {
+  long t = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (t >= b) {
+    return NO_TASK;
+  }
+  long task = atomic_load_explicit(&d->tasks[t & pool->deque_mask],
+                                   memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return NO_TASK;  // lost the race; the caller just looks again
+  }
+  return task;
+}
+
+/* THE WORKERS */
+
+/**
+ * @brief Runs consoles until every one of them has run its frames.
+ */
+static void work(pool_t *pool, unsigned me) {
+  pool_deque_t *mine = &pool->deques[me];
+  unsigned victim = me;
+
+  while (atomic_load_explicit(&pool->pending, memory_order_acquire) > 0) {
+    long task = deque_take(pool, mine);
+    for (unsigned i = 1; task == NO_TASK && i < pool->nthreads; i++) {
+      victim = (victim + 1) % pool->nthreads;
+      if (victim != me) {
+        task = deque_steal(pool, &pool->deques[victim]);
+      }
+    }
+    if (task == NO_TASK) {
+      sched_yield();  // everything left is being run elsewhere
+      continue;
+    }
+
+    pool_slot_t *slot = &pool->slots[task];
+    run_frame(&slot->nes);
+    if (pool->hook) {
+      pool->hook(&slot->nes, task, pool->hook_arg);
+    }
+    if (--slot->frames_left > 0) {
+      deque_push(pool, mine, task);
+    } else {
+      atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_release);
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  pool_t *pool = arg;
+
+  pthread_mutex_lock(&pool->mtx);
+  unsigned me = ++pool->started;  // 0 is the thread calling run_pool()
+  uint64_t seen = 0;
+  for (;;) {
+    while (pool->generation == seen && !pool->stopping) {
+      pthread_cond_wait(&pool->start, &pool->mtx);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->mtx);
+
+    work(pool, me);
+
+    pthread_mutex_lock(&pool->mtx);
+    if (++pool->idle == pool->nthreads - 1) {
+      pthread_cond_signal(&pool->finished);
+    }
+  }
+  pthread_mutex_unlock(&pool->mtx);
+  return NULL;
+}
+
+/* THE POOL */
+
+/**
+ * @brief Sets up a pool of `count` powered-off consoles, and `nthreads`
+ * threads to run them on (counting the one that calls run_pool()). If
+ * `nthreads` is 0, there is one per online CPU.
+ *
+ * @return 0, or -1 if memory or threads could not be had.
+ */
+int init_pool(pool_t *pool, size_t count, unsigned nthreads) {
+  memset(pool, 0, sizeof(*pool));
+  if (count == 0 || count > UINT32_MAX) {
+    return -1;
+  }
+  // from here on, failing goes through free_pool(), which undoes all this
+  pthread_mutex_init(&pool->mtx, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+
+  if (nthreads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = cpus > 0 ? cpus : 1;
+  }
+
+  size_t capacity = 1;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+
+  pool->count = count;
+  pool->nthreads = nthreads;
+  pool->deque_mask = capacity - 1;
+
+  pool->slots = (pool_slot_t *)alloc_ram(count * sizeof(pool_slot_t));
+  pool->threads = (pthread_t *)alloc_ram(nthreads * sizeof(pthread_t));
+  pool->deques = (pool_deque_t *)alloc_ram(nthreads * sizeof(pool_deque_t));
+  if (pool->slots == MAP_FAILED || pool->threads == MAP_FAILED ||
+      pool->deques == MAP_FAILED) {
+    free_pool(pool);
+    return -1;
+  }
+  for (unsigned i = 0; i < nthreads; i++) {
+    pool->deques[i].tasks =
+        (_Atomic uint32_t *)alloc_ram(capacity * sizeof(uint32_t));
+    if (pool->deques[i].tasks == MAP_FAILED) {
+      free_pool(pool);
+      return -1;
+    }
+  }
+
+  for (unsigned i = 1; i < nthreads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+      free_pool(pool);
+      return -1;
+    }
+    pool->workers++;
+  }
+  return 0;
+}
+
+/**
+ * @brief Stops the pool's threads and powers off all of its consoles.
+ */
+void free_pool(pool_t *pool) {
+  if (pool->workers > 0) {
+    pthread_mutex_lock(&pool->mtx);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mtx);
+    for (unsigned i = 1; i <= pool->workers; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+  }
+
+  if (pool->slots && pool->slots != MAP_FAILED) {
+    for (size_t i = 0; i < pool->count; i++) {
+      if (pool->slots[i].powered) {
+        power_off(&pool->slots[i].nes);
+      }
+    }
+  }
+
+  size_t capacity = pool->deque_mask + 1;
+  if (pool->deques && pool->deques != MAP_FAILED) {
+    for (unsigned i = 0; i < pool->nthreads; i++) {
+      if (pool->deques[i].tasks && pool->deques[i].tasks != MAP_FAILED) {
+        munmap(pool->deques[i].tasks, capacity * sizeof(uint32_t));
+      }
+    }
+  }
+  void *bufs[] = {pool->slots, pool->threads, pool->deques};
+  size_t szs[] = {pool->count * sizeof(pool_slot_t),
+                  pool->nthreads * sizeof(pthread_t),
+                  pool->nthreads * sizeof(pool_deque_t)};
+  for (size_t i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+    if (bufs[i] && bufs[i] != MAP_FAILED) {
+      munmap(bufs[i], szs[i]);
+    }
+  }
+  pthread_cond_destroy(&pool->finished);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->mtx);
+  memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Powers on console `which` (see power_on()). It takes part in
+ * every run_pool() from then on.
+ */
+cart_err_t pool_power_on(pool_t *pool, size_t which, const char *locale,
+                         const char *save) {
+  pool_slot_t *slot = &pool->slots[which];
+  if (slot->powered) {
+    power_off(&slot->nes);
+    slot->powered = false;
+  }
+  cart_err_t err = power_on(&slot->nes, locale, save);
+  slot->powered = err == CART_OK;
+  return err;
+}
+
+/**
+ * @brief Runs every powered-on console for `frames` frames, spread across
+ * the pool's threads, and returns once they are all done.
+ */
+void run_pool(pool_t *pool, unsigned frames) {
+  if (frames == 0) {
+    return;
+  }
+
+  // deal the consoles out round-robin; the workers are all waiting, and
+  // the mutex publishes this to them
+  size_t pending = 0;
+  for (size_t i = 0; i < pool->count; i++) {
+    if (pool->slots[i].powered) {
+      pool->slots[i].frames_left = frames;
+      deque_push(pool, &pool->deques[pending++ % pool->nthreads], i);
+    }
+  }
+  atomic_store(&pool->pending, pending);
+
+  pthread_mutex_lock(&pool->mtx);
+  pool->generation++;
+  pool->idle = 0;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mtx);
+
+  work(pool, 0);
+
+  // wait for the others to stop touching the deques before returning
+  pthread_mutex_lock(&pool->mtx);
+  while (pool->idle < pool->nthreads - 1) {
+    pthread_cond_wait(&pool->finished, &pool->mtx);
+  }
+  pthread_mutex_unlock(&pool->mtx);
+}
@@ -0,0 +1,86 @@
+/**
+ * @file pool.h
+ * @brief Many consoles, run side by side on a pool of threads.
+ *
+ * Each console in a pool is fully independent (its own bus, RAM, PPU and
+ * cartridge), so any of them can run on any thread. run_pool() advances
+ * every powered-on console by some number of frames. The unit of work is
+ * one frame of one console. Each thread keeps a deque of consoles and
+ * keeps running the one it ran last, which keeps that console's state hot
+ * in its cache. A thread that runs dry steals the oldest console from
+ * another thread's deque (Chase-Lev work stealing), so one slow console
+ * never holds up a whole thread's share.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "nes/unes.h"
+
+/*
+ * Called on a pool thread after every frame a console runs, e.g. to dump
+ * the frame or feed in input. Calls for the same console never overlap.
+ */
+typedef void (*pool_hook_t)(unes_t *nes, size_t which, void *arg);
+
+/*
+ * A worker's deque of consoles to run. Only its owner pushes and takes, at
+ * the bottom; anyone may steal, at the top.
+ */
+typedef struct pool_deque {
+  alignas(CACHE_LINE_SZ) atomic_long top;
+  alignas(CACHE_LINE_SZ) atomic_long bottom;
+  _Atomic uint32_t *tasks;  // a ring of console indices
+} pool_deque_t;
+
+/*
+ * A console and its bookkeeping, written only by whichever thread is
+ * running it. Being a unes_t, it starts on a cache line of its own.
+ */
+typedef struct pool_slot {
+  unes_t nes;
+  uint32_t frames_left;  // in the current run_pool()
+  bool powered;
+} pool_slot_t;
+
+typedef struct pool {
+  pool_slot_t *slots;
+  size_t count;
+
+  pool_hook_t hook;  // may be NULL
+  void *hook_arg;
+
+  pthread_t *threads;
+  pool_deque_t *deques;  // one per thread; the caller of run_pool() is 0
+  unsigned nthreads;  // counting the caller's; what the arrays are sized for
+  unsigned workers;   // threads actually created, i.e. nthreads - 1
+  size_t deque_mask;  // deque capacity - 1; capacity is a power of two
+
+  pthread_mutex_t mtx;
+  pthread_cond_t start;     // signaled when a run begins
+  pthread_cond_t finished;  // signaled when the last worker is done
+  uint64_t generation;      // run_pool() calls so far
+  unsigned started;         // worker threads started so far
+  unsigned idle;            // workers done with the current run
+  bool stopping;
+  alignas(CACHE_LINE_SZ) atomic_size_t pending;  // consoles not yet done
+} pool_t;
+
+int init_pool(pool_t *pool, size_t count, unsigned nthreads);
+void free_pool(pool_t *pool);
+
+cart_err_t pool_power_on(pool_t *pool, size_t which, const char *locale,
+                         const char *save);
+void run_pool(pool_t *pool, unsigned frames);
+
+/**
+ * @brief Console `which`. Only to be touched between calls to run_pool().
+ */
+static inline unes_t *pool_machine(pool_t *pool, size_t which) {
+  return &pool->slots[which].nes;
+}
@@ -0,0 +1,323 @@
+/**
+ * @file rewind.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "nes/rewind.h"
+
+#include <string.h>
+
+/*
+ * A capture is encoded as a series of (zero run, literal run) pairs, each
+ * length a LEB128 varint, and each literal run followed by its bytes. A
+ * literal run ends once at least this many zeros follow it.
+ */
+#define MIN_ZERO_RUN 4
+
+/*
+ * The most an encoded capture can take: at worst a 1-byte literal every
+ * MIN_ZERO_RUN + 1 bytes, with 1-byte varints
+ */
+#define MAX_ENCODED_SZ(state_sz) (2 * (state_sz) + 16)
+
+/* ENCODING */
+
+/**
+ * @brief The byte of the delta at `i`; the state itself if there is no
+ * capture to take it against.
+ */
+static inline byte_t delta_at(const byte_t *cur, const byte_t *ref,
+                              size_t i) {
+  return ref ? cur[i] ^ ref[i] : cur[i];
+}
+
+/**
+ * @brief Whether the 8 bytes of the delta at `i` are all zero.
+ */
+static inline bool zero_word_at(const byte_t *cur, const byte_t *ref,
+                                size_t i) {
+  uint64_t c, r = 0;
+  memcpy(&c, cur + i, 8);
+  if (ref) {
+    memcpy(&r, ref + i, 8);
+  }
+  return c == r;
+}
+
+static inline bool zero_run_at(const byte_t *cur, const byte_t *ref,
+                               size_t i, size_t n) {
+  for (size_t j = i; j < i + MIN_ZERO_RUN && j < n; j++) {
+    if (delta_at(cur, ref, j) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static byte_t *put_varint(byte_t *out, size_t what) {
+  while (what >= 0x80) {
+    *out++ = (what & 0x7F) | 0x80;
+    what >>= 7;
+  }
+  *out++ = what;
+  return out;
+}
+
+static const byte_t *get_varint(const byte_t *in, size_t *what) {
+  size_t x = 0;
+  for (int shift = 0;; shift += 7) {
+    byte_t b = *in++;
+    x |= (size_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      break;
+    }
+  }
+  *what = x;
+  return in;
+}
+
+/**
+ * @brief Encodes `cur` XOR `ref` (or just `cur`, if `ref` is NULL).
+ *
+ * @return The encoded size; at most MAX_ENCODED_SZ(n).
+ */
+static size_t encode(const byte_t *cur, const byte_t *ref, size_t n,
+                     byte_t *out) {
+  byte_t *at = out;
+  size_t i = 0;
+  while (i < n) {
+    size_t zeros = i;
+    while (i + 8 <= n && zero_word_at(cur, ref, i)) {
+      i += 8;
+    }
+    while (i < n && delta_at(cur, ref, i) == 0) {
+      i++;
+    }
+    at = put_varint(at, i - zeros);
+
+    size_t literals = i;
+    while (i < n && !zero_run_at(cur, ref, i, n)) {
+      i++;
+    }
+    at = put_varint(at, i - literals);
+    for (size_t j = literals; j < i; j++) {
+      *at++ = delta_at(cur, ref, j);
+    }
+  }
+  return at - out;
+}
+
+/**
+ * @brief XORs an encoded capture into `state`.
+ */
+static void decode_xor(const byte_t *in, size_t len, byte_t *state) {
+  const byte_t *end = in + len;
+  size_t i = 0;
+  while (in < end) {
+    size_t zeros, literals;
+    in = get_varint(in, &zeros);
+    in = get_varint(in, &literals);
+    i += zeros;
+    for (size_t j = 0; j < literals; j++) {
+      state[i++] ^= *in++;
+    }
+  }
+}
+
+/* THE RING */
+
+static rewind_entry_t *entry(rewind_t *rw, size_t i) {
+  return &rw->entries[(rw->first + i) % rw->max_entries];
+}
+
+/**
+ * @brief Drops the oldest keyframe, and every capture stored after it up to
+ * the next keyframe (none of which can be decoded without it).
+ */
+static void evict_group(rewind_t *rw) {
+  do {
+    rw->first = (rw->first + 1) % rw->max_entries;
+    rw->count--;
+  } while (rw->count > 0 && !entry(rw, 0)->key);
+}
+
+/**
+ * @brief Finds `len` contiguous bytes for a new capture, evicting the
+ * oldest ones until they fit.
+ *
+ * @return Their offset in the ring, or -1 if the ring is too small.
+ */
+static long reserve(rewind_t *rw, size_t len) {
+  if (len > rw->ring_sz) {
+    return -1;
+  }
+  for (;; evict_group(rw)) {
+    if (rw->count == 0) {
+      return 0;
+    }
+    if (rw->count == rw->max_entries) {
+      continue;
+    }
+    size_t tail = entry(rw, 0)->offset;
+    if (rw->head > tail) {
+      // free space is at the end, then wraps around to the start
+      if (rw->ring_sz - rw->head >= len) {
+        return rw->head;
+      }
+      if (tail >= len) {
+        return 0;
+      }
+    } else if (tail - rw->head >= len) {
+      return rw->head;  // head == tail only if the ring is full
+    }
+  }
+}
+
+/**
+ * @brief Sets up an empty history for `nes` (or any console with the same
+ * kind of cartridge), in a ring of `ring_sz` bytes.
+ *
+ * @param interval Frames per capture; see rewind_frame().
+ *
+ * @return 0, or -1 if the memory could not be allocated.
+ */
+int init_rewind(rewind_t *rw, const unes_t *nes, size_t ring_sz,
+                unsigned interval) {
+  memset(rw, 0, sizeof(*rw));
+  if (ring_sz > UINT32_MAX) {
+    return -1;
+  }
+  rw->ring_sz = ring_sz;
+  rw->max_entries = ring_sz / REWIND_ENTRY_BUDGET + 1;
+  rw->state_sz = state_size(nes);
+  rw->interval = interval ? interval : 1;
+  rw->need_key = true;
+
+  rw->ring = alloc_ram(ring_sz);
+  rw->entries = (rewind_entry_t *)alloc_ram(rw->max_entries *
+                                            sizeof(rewind_entry_t));
+  rw->prev = alloc_ram(rw->state_sz);
+  rw->state = alloc_ram(rw->state_sz);
+  rw->encoded = alloc_ram(MAX_ENCODED_SZ(rw->state_sz));
+  if (rw->ring == MAP_FAILED || rw->entries == MAP_FAILED ||
+      rw->prev == MAP_FAILED || rw->state == MAP_FAILED ||
+      rw->encoded == MAP_FAILED) {
+    free_rewind(rw);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Releases everything init_rewind() allocated.
+ */
+void free_rewind(rewind_t *rw) {
+  void *bufs[] = {rw->ring, rw->entries, rw->prev, rw->state, rw->encoded};
+  size_t szs[] = {rw->ring_sz, rw->max_entries * sizeof(rewind_entry_t),
+                  rw->state_sz, rw->state_sz,
+                  MAX_ENCODED_SZ(rw->state_sz)};
+  for (size_t i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+    if (bufs[i] && bufs[i] != MAP_FAILED) {
+      munmap(bufs[i], szs[i]);
+    }
+  }
+  memset(rw, 0, sizeof(*rw));
+}
+
+/**
+ * @brief Decodes the newest capture into rw->prev, from its keyframe on.
+ */
+static void decode_newest(rewind_t *rw) {
+  size_t newest = rw->count - 1;
+  size_t key = newest;
+  while (!entry(rw, key)->key) {
+    key--;
+  }
+  memset(rw->prev, 0, rw->state_sz);
+  for (size_t i = key; i <= newest; i++) {
+    rewind_entry_t *e = entry(rw, i);
+    decode_xor(rw->ring + e->offset, e->len, rw->prev);
+  }
+  rw->since_key = newest - key + 1;
+}
+
+/**
+ * @brief Counts a frame, capturing `nes` if one is due. Meant to be called
+ * after every run_frame().
+ */
+void rewind_frame(rewind_t *rw, const unes_t *nes) {
+  if (++rw->frames % rw->interval == 0) {
+    rewind_capture(rw, nes);
+  }
+}
+
+/**
+ * @brief Captures `nes` into the history now, evicting the oldest captures
+ * if the ring is full.
+ */
+void rewind_capture(rewind_t *rw, const unes_t *nes) {
+  save_state(nes, rw->state, rw->state_sz);
+
+  bool key = rw->need_key || rw->since_key >= REWIND_KEY_INTERVAL;
+  size_t len = encode(rw->state, key ? NULL : rw->prev, rw->state_sz,
+                      rw->encoded);
+  long offset = reserve(rw, len);
+  if (!key && rw->count == 0) {
+    // making room took the capture this one is stored against with it
+    key = true;
+    len = encode(rw->state, NULL, rw->state_sz, rw->encoded);
+    offset = reserve(rw, len);
+  }
+  if (offset < 0) {
+    rw->need_key = true;  // too big for the ring; try again next time
+    return;
+  }
+
+  memcpy(rw->ring + offset, rw->encoded, len);
+  if (key) {
+    rw->since_key = 0;
+    rw->need_key = false;
+  }
+  rw->since_key++;
+
+  // the capture just taken is what the next one is stored against
+  byte_t *prev = rw->prev;
+  rw->prev = rw->state;
+  rw->state = prev;
+  rw->head = offset + len;
+  *entry(rw, rw->count++) = (rewind_entry_t){.frame = nes->ppu.frame,
+                                             .offset = offset,
+                                             .len = len,
+                                             .key = key};
+}
+
+/**
+ * @brief Restores `nes` to the newest capture and drops it from the
+ * history, so that repeated calls step further and further back. A step
+ * usually costs one pass over the delta it drops; stepping past a keyframe
+ * decodes the captures before it again, from their own keyframe on.
+ *
+ * @return 0, or -1 if the history is empty.
+ */
+int rewind_step(rewind_t *rw, unes_t *nes) {
+  if (rw->count == 0) {
+    return -1;
+  }
+
+  rewind_entry_t *e = entry(rw, rw->count - 1);
+  int err = load_state(nes, rw->prev, rw->state_sz) == SAVE_OK ? 0 : -1;
+  rw->head = e->offset;
+  rw->count--;
+
+  if (!e->key) {
+    // a delta is its own inverse: XORing it back out leaves the capture
+    // before it
+    decode_xor(rw->ring + e->offset, e->len, rw->prev);
+    rw->since_key--;
+  } else if (rw->count > 0) {
+    decode_newest(rw);
+  }
+  rw->need_key = rw->count == 0;
+  return err;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file rewind.h
+ * @brief A rewind history: a fixed-size ring of recent savestates.
+ *
+ * Every `interval` frames a state is captured. Most captures are stored as
+ * the XOR of the state with the capture before it, which is almost all
+ * zeros (RAM and registers change little from frame to frame), and then
+ * run-length encoded; a keyframe, stored the same way against zeros, is
+ * taken every REWIND_KEY_INTERVAL captures. A capture costs two passes
+ * over a state's worth of memory. How big it is depends on the game: with
+ * a capture every frame, from a few dozen bytes for one idling on a still
+ * screen to a few hundred for a busy one, while a keyframe can take nearly
+ * a whole state (PRG-RAM and all).
+ *
+ * When the ring fills up the oldest keyframe goes, together with the
+ * captures after it up to the next keyframe.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nes/savestate.h"
+
+/*
+ * Captures per keyframe. Fewer keyframes take less room, but make stepping
+ * back past one slower (see rewind_step()) and the oldest captures go in
+ * bigger groups.
+ */
+#define REWIND_KEY_INTERVAL 32
+
+/*
+ * Ring bytes budgeted per capture, which decides how many captures are
+ * indexed; a ring that runs out of index first just holds fewer. Captures
+ * of a game that changes little take only a few dozen bytes, and it takes
+ * an index over a third the size of the ring to use all of it on them.
+ */
+#define REWIND_ENTRY_BUDGET 64
+
+/*
+ * A capture, stored in the ring at `offset`.
+ */
+typedef struct rewind_entry {
+  uint64_t frame;  // the frame it was captured after
+  uint32_t offset;
+  uint32_t len;
+  bool key;
+} rewind_entry_t;
+
+typedef struct rewind {
+  byte_t *ring;  // encoded captures, each stored contiguously
+  size_t ring_sz;
+  size_t head;  // where the next capture goes, unless it must wrap
+
+  rewind_entry_t *entries;  // itself a ring, oldest first
+  size_t max_entries;
+  size_t first;  // index of the oldest entry
+  size_t count;
+
+  size_t state_sz;
+  byte_t *prev;     // the newest capture's state, decoded
+  byte_t *state;    // scratch: the state being captured or restored
+  byte_t *encoded;  // scratch: the capture being encoded
+  bool need_key;    // whether the next capture must be a keyframe
+
+  unsigned interval;   // frames per capture
+  unsigned since_key;  // captures since the latest keyframe
+  uint64_t frames;     // frames seen by rewind_frame()
+} rewind_t;
+
+int init_rewind(rewind_t *rw, const unes_t *nes, size_t ring_sz,
+                unsigned interval);
+void free_rewind(rewind_t *rw);
+
+void rewind_frame(rewind_t *rw, const unes_t *nes);
+void rewind_capture(rewind_t *rw, const unes_t *nes);
+int rewind_step(rewind_t *rw, unes_t *nes);
@@ -0,0 +1,261 @@
+/**
+ * @file savestate.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "nes/savestate.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+#ifdef CPU_TESTS
+#define CPU_RAM_SZ TH_UNITTEST_MEM_CAP
+#else
+#define CPU_RAM_SZ UCPU_MEM_CAP
+#endif
+
+/*
+ * The most sections a state has
+ */
+#define MAX_SECTIONS 11
+
+typedef struct state_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t order;  // BYTE_ORDER_MARK, as written by the saving host
+} state_header_t;
+
+typedef struct section_header {
+  char tag[4];
+  uint32_t len;
+} section_header_t;
+
+/*
+ * What a state's cartridge must have in common with the one it is loaded
+ * into. Only compared on load, never copied.
+ */
+typedef struct cart_section {
+  uint32_t mapper;
+  uint32_t prg_rom_sz;
+  uint32_t chr_sz;
+  uint32_t chr_ram;
+  uint32_t prg_ram_sz;
+} cart_section_t;
+
+/*
+ * The bus's own state; everything else in bus_t is wiring.
+ */
+typedef struct bus_section {
+  bool nmi;
+  ustat_t irq;
+  ustat_t p_latch;
+} bus_section_t;
+
+/*
+ * A section of a state, and where its bytes live in the console (or, for
+ * CART, CPU and BUS, in scratch space).
+ */
+typedef struct section {
+  char tag[4];
+  byte_t *data;
+  size_t len;
+} section_t;
+
+/*
+ * Sections that are assembled in scratch space rather than copied in place.
+ */
+typedef struct scratch {
+  cart_section_t cart;
+  ucpu_t cpu;  // with its buslink zeroed, so states don't hold host pointers
+  bus_section_t bus;
+} scratch_t;
+
+static const char *SAVE_ERR_DESCRIPTIONS[] = {
+    [SAVE_OK] = "no error",
+    [SAVE_ERR_FORMAT] = "not a savestate, or a damaged one",
+    [SAVE_ERR_VERSION] = "savestate is from an incompatible build",
+    [SAVE_ERR_CART] = "savestate is for a different cartridge"};
+
+/**
+ * @brief Lists the sections a state of `nes` is made of, filling in
+ * `scratch` with the ones assembled rather than copied in place.
+ *
+ * @return The number of sections.
+ */
+static size_t list_sections(const unes_t *nes, scratch_t *scratch,
+                            section_t *out) {
+  unes_t *mut = (unes_t *)nes;  // only written through by load_state()
+  const cartridge_t *cart = &nes->cart;
+  size_t n = 0;
+
+  scratch->cart = (cart_section_t){.mapper = cart->mapper,
+                                   .prg_rom_sz = cart->prg_rom.size,
+                                   .chr_sz = cart->chr.size,
+                                   .chr_ram = cart->chr_ram,
+                                   .prg_ram_sz = cart->prg_ram.size};
+  scratch->cpu = nes->cpu;
+  memset(&scratch->cpu.buslink, 0, sizeof(scratch->cpu.buslink));
+  scratch->bus = (bus_section_t){.nmi = nes->bus.nmi,
+                                 .irq = nes->bus.irq,
+                                 .p_latch = nes->bus.p_latch};
+
+  out[n++] = (section_t){"CART", (byte_t *)&scratch->cart,
+                         sizeof(scratch->cart)};
+  out[n++] = (section_t){"CPU ", (byte_t *)&scratch->cpu,
+                         sizeof(scratch->cpu)};
+  out[n++] = (section_t){"PPU ", (byte_t *)&mut->ppu,
+                         offsetof(uppu_t, buslink)};
+  out[n++] = (section_t){"APU ", (byte_t *)&mut->apu,
+                         offsetof(uapu_t, buslink)};
+  out[n++] = (section_t){"JOYP", (byte_t *)&mut->controllers,
+                         offsetof(controllers_t, script)};
+  out[n++] = (section_t){"BUS ", (byte_t *)&scratch->bus,
+                         sizeof(scratch->bus)};
+  out[n++] = (section_t){"WRAM", mut->bus.cpu_ram, CPU_RAM_SZ};
+  out[n++] = (section_t){"VRAM", mut->bus.ppu_ram, UPPU_VRAM_CAP};
+  out[n++] = (section_t){"MAPR", (byte_t *)&mut->mapper.regs,
+                         sizeof(mut->mapper.regs)};
+  if (cart->prg_ram.size > 0) {
+    out[n++] = (section_t){"PRAM", cart->prg_ram.data, cart->prg_ram.size};
+  }
+  if (cart->chr_ram) {
+    out[n++] = (section_t){"CRAM", cart->chr.data, cart->chr.size};
+  }
+  return n;
+}
+
+const char *describe_save_err(save_err_t err) {
+  return SAVE_ERR_DESCRIPTIONS[err];
+}
+
+/**
+ * @brief The size of a state of `nes`, i.e. the buffer save_state() needs.
+ * It stays the same for as long as the same cartridge is in.
+ */
+size_t state_size(const unes_t *nes) {
+  scratch_t scratch;
+  section_t sections[MAX_SECTIONS];
+  size_t n = list_sections(nes, &scratch, sections);
+
+  size_t sz = sizeof(state_header_t);
+  for (size_t i = 0; i < n; i++) {
+    sz += sizeof(section_header_t) + sections[i].len;
+  }
+  return sz;
+}
+
+/**
+ * @brief Snapshots `nes` into `buf`. Best taken between frames (or at any
+ * rate between calls into the console).
+ *
+ * @return The size of the state, or 0 if it needs more than `cap` bytes.
+ */
+size_t save_state(const unes_t *nes, void *buf, size_t cap) {
+  if (cap < state_size(nes)) {
+    return 0;
+  }
+
+  scratch_t scratch;
+  section_t sections[MAX_SECTIONS];
+  size_t n = list_sections(nes, &scratch, sections);
+
+  byte_t *at = buf;
+  state_header_t header = {.version = SAVESTATE_VERSION,
+                           .order = BYTE_ORDER_MARK};
+  memcpy(header.magic, SAVESTATE_MAGIC, sizeof(header.magic));
+  memcpy(at, &header, sizeof(header));
+  at += sizeof(header);
+
+  for (size_t i = 0; i < n; i++) {
+    section_header_t section = {.len = sections[i].len};
+    memcpy(section.tag, sections[i].tag, sizeof(section.tag));
+    memcpy(at, &section, sizeof(section));
+    at += sizeof(section);
+    memcpy(at, sections[i].data, sections[i].len);
+    at += sections[i].len;
+  }
+  return at - (byte_t *)buf;
+}
+
+/**
+ * @brief Restores `nes` to the state in `buf`. `nes` must be powered on,
+ * with the same kind of cartridge the state was taken with.
+ *
+ * @return SAVE_OK, or why the state could not be loaded; `nes` is left
+ * untouched if so.
+ */
+save_err_t load_state(unes_t *nes, const void *buf, size_t len) {
+  const byte_t *at = buf;
+  const byte_t *end = at + len;
+
+  state_header_t header;
+  if (len < sizeof(header)) {
+    return SAVE_ERR_FORMAT;
+  }
+  memcpy(&header, at, sizeof(header));
+  at += sizeof(header);
+  if (memcmp(header.magic, SAVESTATE_MAGIC, sizeof(header.magic)) != 0) {
+    return SAVE_ERR_FORMAT;
+  }
+  if (header.version != SAVESTATE_VERSION ||
+      header.order != BYTE_ORDER_MARK) {
+    return SAVE_ERR_VERSION;
+  }
+
+  scratch_t scratch;
+  section_t sections[MAX_SECTIONS];
+  size_t n = list_sections(nes, &scratch, sections);
+  cart_section_t cart = scratch.cart;
+
+  // find every section before touching anything, so that a bad state
+  // leaves the console as it was
+  const byte_t *found[MAX_SECTIONS] = {0};
+  while (at < end) {
+    section_header_t section;
+    if ((size_t)(end - at) < sizeof(section)) {
+      return SAVE_ERR_FORMAT;
+    }
+    memcpy(&section, at, sizeof(section));
+    at += sizeof(section);
+    if ((size_t)(end - at) < section.len) {
+      return SAVE_ERR_FORMAT;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (memcmp(section.tag, sections[i].tag, sizeof(section.tag)) == 0) {
+        if (section.len != sections[i].len) {
+          return i == 0 ? SAVE_ERR_CART : SAVE_ERR_VERSION;
+        }
+        found[i] = at;
+      }
+    }
+    at += section.len;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!found[i]) {
+      return SAVE_ERR_FORMAT;
+    }
+  }
+  if (memcmp(found[0], &cart, sizeof(cart)) != 0) {
+    return SAVE_ERR_CART;
+  }
+
+  for (size_t i = 1; i < n; i++) {
+    memcpy(sections[i].data, found[i], sections[i].len);
+  }
+  scratch.cpu.buslink = nes->cpu.buslink;
+  nes->cpu = scratch.cpu;
+  nes->bus.nmi = scratch.bus.nmi;
+  nes->bus.irq = scratch.bus.irq;
+  nes->bus.p_latch = scratch.bus.p_latch;
+
+  // rebuild what was derived from the state: the banks the mapper has
+  // switched in, pattern tables decoded from old CHR-RAM, and synthesis,
+  // which starts over from the APU's restored clock
+  nes->mapper.ops->sync(&nes->mapper);
+  pt_invalidate_all(&nes->ppu.pt);
+  apu_set_output(&nes->apu, nes->apu.ring, nes->apu.sample_rate);
+  return SAVE_OK;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file savestate.h
+ * @brief Snapshots of a running console.
+ *
+ * A savestate is a header followed by tagged sections:
+ *
+ *   header:  "uNESsave", version (u32), byte-order mark (u32)
+ *   section: tag (4 chars), length (u32), then `length` bytes
+ *
+ * Each section is a straight copy of one of the emulator's own structs or
+ * RAM buffers, so saving and loading are a handful of memcpy()s. The flip
+ * side is that states are native-endian and tied to the struct layouts of
+ * the build that wrote them: they are for forking and resuming runs, not
+ * for archiving. A loader rejects sections whose size it doesn't expect,
+ * and skips tags it doesn't know.
+ *
+ * Derived state (the PPU's decoded pattern tables, the bus's page tables,
+ * the APU's synthesis buffer) is not saved; it is rebuilt from the rest
+ * on load. Nor is what belongs to the caller rather than the console, e.g.
+ * the ring the APU writes to or the script the controllers are playing.
+ * Structs holding some of each (the PPU's, the APU's, the controllers')
+ * are saved up to their LINKS marker and no further, so new fields go
+ * before it if they are the console's and after it if not.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stddef.h>
+
+#include "nes/unes.h"
+
+#define SAVESTATE_MAGIC "uNESsave"
+#define SAVESTATE_VERSION 4u
+
+/*
+ * Reasons loading a savestate can fail.
+ */
+typedef enum {
+  SAVE_OK = 0,
+  SAVE_ERR_FORMAT,   // not a savestate, or truncated
+  SAVE_ERR_VERSION,  // written by an incompatible build or host
+  SAVE_ERR_CART      // taken with a different kind of cartridge
+} save_err_t;
+
+const char *describe_save_err(save_err_t err);
+
+size_t state_size(const unes_t *nes);
+size_t save_state(const unes_t *nes, void *buf, size_t cap);
+save_err_t load_state(unes_t *nes, const void *buf, size_t len);
@@ -1 +1,125 @@
+/**
+ * @file unes.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "nes/unes.h"
 
+#include <string.h>
+
+/**
+ * @brief Runs the CPU for `cycs` cycles. A jammed CPU has nothing left to
+ * run, so its clock just moves on while the rest of the console carries on
+ * without it.
+ */
+static void run_cpu(unes_t *nes, clk_t cycs) {
+  if (cpu_jammed(&nes->cpu)) {
+    nes->cpu.clock += cycs;
+    return;
+  }
+  run_cycles(&nes->cpu, cycs);
+}
+
+/* SCHEDULING */
+
+/*
+ * The CPU leads. It runs freely up to the next event, the next moment
+ * another chip does something the CPU would notice without asking (see
+ * ppu_next_event() and apu_next_event()). Everything else runs behind it,
+ * and is only caught up at events and whenever the CPU accesses it in
+ * between, so a frame costs a handful of catch-ups rather than one per
+ * scanline or cycle.
+ */
+
+/**
+ * @brief Brings every chip that runs behind the CPU up to its access in
+ * progress; the bus's sync hook.
+ */
+static void sync_devices(bus_t *bus) {
+  ppu_sync(bus->ppu);
+  apu_sync(bus->apu);
+}
+
+/**
+ * @brief The CPU cycle the next event is due on.
+ */
+static clk_t next_event(const unes_t *nes) {
+  uint64_t dot = ppu_next_event(&nes->ppu);
+  clk_t ppu_due = (dot + PPU_DOTS_PER_CPU_CYC - 1) / PPU_DOTS_PER_CPU_CYC;
+  clk_t apu_due = apu_next_event(&nes->apu);
+  return apu_due < ppu_due ? apu_due : ppu_due;
+}
+
+/**
+ * @brief Runs the CPU up to the next event, and everything else up to the
+ * CPU.
+ */
+static void run_to_event(unes_t *nes) {
+  clk_t due = next_event(nes);
+  if (nes->cpu.clock < due) {
+    run_cpu(nes, due - nes->cpu.clock);
+  }
+  ppu_catch_up(&nes->ppu, nes->cpu.clock * PPU_DOTS_PER_CPU_CYC);
+  apu_catch_up(&nes->apu, nes->cpu.clock);
+}
+
+/**
+ * @brief Mounts the cartridge at `locale` (see mount()), plugs it and
+ * everything else into a fresh bus, and resets the CPU.
+ *
+ * @param[out] nes Where the console should be written. It must not move
+ * until it is powered off.
+ *
+ * @returns CART_OK, or why the cartridge could not be used. On failure
+ * nothing needs to be powered off.
+ */
+cart_err_t power_on(unes_t *nes, const char *locale, const char *save) {
+  memset(nes, 0, sizeof(*nes));
+  cart_err_t err = mount(&nes->cart, locale, save);
+  if (err != CART_OK) {
+    return err;
+  }
+
+  nes->bus = new_bus();
+  nes->bus.sync = sync_devices;
+  init_cpu(&nes->cpu);
+  link_device(&nes->cpu.buslink, &nes->bus);
+  nes->bus.cpu = &nes->cpu;
+  init_ppu(&nes->ppu);
+  connect_ppu(&nes->ppu, &nes->bus);
+  init_apu(&nes->apu);
+  connect_apu(&nes->apu, &nes->bus);
+  init_controllers(&nes->controllers);
+  connect_controllers(&nes->controllers, &nes->bus);
+
+  if (connect_mapper(&nes->mapper, &nes->cart, &nes->bus) != 0) {
+    free_bus(&nes->bus);
+    unmount(&nes->cart);
+    return CART_ERR_MAPPER;
+  }
+
+  reset_cpu(&nes->cpu);
+  return CART_OK;
+}
+
+/**
+ * @brief Releases everything power_on() acquired.
+ */
+void power_off(unes_t *nes) {
+  free_bus(&nes->bus);
+  unmount(&nes->cart);
+}
+
+/**
+ * @brief Runs the console until the PPU finishes a frame (i.e. enters
+ * VBlank). The frame is drawn into, and published to, nes->ppu.screen if
+ * it is set. Controllers being fed a script play its next frame.
+ */
+void run_frame(unes_t *nes) {
+  uint64_t frame = nes->ppu.frame;
+  controller_next_frame(&nes->controllers);
+  while (nes->ppu.frame == frame) {
+    run_to_event(nes);
+  }
+}
@@ -1,12 +1,40 @@
 /**
- * @file unes.hpp
- * @brief
+ * @file unes.h
+ * @brief The console as a whole: a CPU, a PPU, an APU, two controllers
+ * and a cartridge on one bus.
  *
  * @author Benedict Song <benedict04song@gmail.com>
  */
 #pragma once
+#include <stdalign.h>
+
+#include "apu/uapu.h"
+#include "cartridge/cartridge.h"
+#include "cartridge/mapper.h"
 #include "cpu/ucpu.h"
+#include "input/controller.h"
+#include "memory/bus.h"
+#include "ppu/uppu.h"
 
+/*
+ * Devices point into the bus and the bus points back at them, so a
+ * powered-on unes_t must stay where it is.
+ *
+ * A unes_t holds all of a console's mutable state, so consoles can run on
+ * any threads. It starts on a cache line of its own so that consoles side
+ * by side (e.g. in a pool) never share one.
+ */
 typedef struct unes {
-  ucpu_t cpu;
+  alignas(CACHE_LINE_SZ) ucpu_t cpu;
+  uppu_t ppu;
+  uapu_t apu;
+  controllers_t controllers;
+  bus_t bus;
+  cartridge_t cart;
+  mapper_t mapper;
 } unes_t;
+
+cart_err_t power_on(unes_t *nes, const char *locale, const char *save);
+void power_off(unes_t *nes);
+
+void run_frame(unes_t *nes);
@@ -0,0 +1,191 @@
+/**
+ * @file patterntable.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "ppu/patterntable.h"
+
+#include <string.h>
+
+/*
+ * Pick the widest tile decoder the target supports. Define UPPU_NO_SIMD to
+ * force the portable one.
+ */
+#ifndef UPPU_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PT_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PT_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PT_NEON
+#endif
+#endif
+
+/*
+ * Byte i holds the bit of a bitplane byte that lands on pixel i (pixels
+ * run from the most significant bit down).
+ */
+#define PLANE_MASK 0x0102040810204080ull
+
+/*
+ * Every decoder turns one tile (8 bytes of the low bitplane, then 8 of the
+ * high one) into 64 pixels, row by row.
+ */
+
+#if defined(PT_AVX2)
+
+/**
+ * @brief Decodes a tile 4 rows at a time: each row's plane bytes are
+ * spread across 8 lanes, tested against a per-lane bit, and combined.
+ */
+static void decode(const byte_t *tile, byte_t *out) {
+  __m256i planes =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tile));
+  __m256i mask = _mm256_set1_epi64x((long long)PLANE_MASK);
+  __m256i one = _mm256_set1_epi8(1);
+
+  for (int half = 0; half < 2; half++) {
+    // rows 4 * half + [0, 4), one per 8 lanes
+    char r = (char)(4 * half);
+    __m256i lo_idx = _mm256_setr_epi8(
+        r, r, r, r, r, r, r, r, r + 1, r + 1, r + 1, r + 1, r + 1, r + 1,
+        r + 1, r + 1, r + 2, r + 2, r + 2, r + 2, r + 2, r + 2, r + 2, r + 2,
+        r + 3, r + 3, r + 3, r + 3, r + 3, r + 3, r + 3, r + 3);
+    __m256i hi_idx = _mm256_add_epi8(lo_idx, _mm256_set1_epi8(8));
+
+    __m256i lo = _mm256_shuffle_epi8(planes, lo_idx);
+    __m256i hi = _mm256_shuffle_epi8(planes, hi_idx);
+    lo = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_and_si256(lo, mask), mask), one);
+    hi = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_and_si256(hi, mask), mask), one);
+    __m256i px = _mm256_or_si256(lo, _mm256_add_epi8(hi, hi));
+    _mm256_storeu_si256((__m256i *)(out + 32 * half), px);
+  }
+}
+
+#elif defined(PT_SSE2)
+
+/**
+ * @brief Spreads each of 8 plane bytes across 8 lanes (two rows per
+ * vector) and tests every lane against its pixel's bit.
+ */
+static inline __m128i spread(__m128i rows, __m128i mask) {
+  __m128i set = _mm_cmpeq_epi8(_mm_and_si128(rows, mask), mask);
+  return _mm_and_si128(set, _mm_set1_epi8(1));
+}
+
+/**
+ * @brief Decodes a tile 2 rows at a time.
+ */
+static void decode(const byte_t *tile, byte_t *out) {
+  __m128i mask = _mm_set1_epi64x((long long)PLANE_MASK);
+  __m128i lo = _mm_loadl_epi64((const __m128i *)tile);
+  __m128i hi = _mm_loadl_epi64((const __m128i *)(tile + 8));
+
+  // byte b of each plane, repeated 8 times: first doubled, then 4x, then 8x
+  lo = _mm_unpacklo_epi8(lo, lo);
+  hi = _mm_unpacklo_epi8(hi, hi);
+  __m128i lo4[2] = {_mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo)};
+  __m128i hi4[2] = {_mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi)};
+
+  for (int half = 0; half < 2; half++) {
+    __m128i lo8[2] = {_mm_unpacklo_epi32(lo4[half], lo4[half]),
+                      _mm_unpackhi_epi32(lo4[half], lo4[half])};
+    __m128i hi8[2] = {_mm_unpacklo_epi32(hi4[half], hi4[half]),
+                      _mm_unpackhi_epi32(hi4[half], hi4[half])};
+    for (int pair = 0; pair < 2; pair++) {
+      __m128i l = spread(lo8[pair], mask);
+      __m128i h = spread(hi8[pair], mask);
+      __m128i px = _mm_or_si128(l, _mm_add_epi8(h, h));
+      _mm_storeu_si128((__m128i *)(out + 32 * half + 16 * pair), px);
+    }
+  }
+}
+
+#elif defined(PT_NEON)
+
+/**
+ * @brief Decodes a tile a row at a time, testing each lane against its
+ * pixel's bit.
+ */
+static void decode(const byte_t *tile, byte_t *out) {
+  uint8x8_t mask = vcreate_u8(PLANE_MASK);
+  uint8x8_t one = vdup_n_u8(1);
+  for (int row = 0; row < 8; row++) {
+    uint8x8_t lo = vand_u8(vtst_u8(vdup_n_u8(tile[row]), mask), one);
+    uint8x8_t hi = vand_u8(vtst_u8(vdup_n_u8(tile[row + 8]), mask), one);
+    vst1_u8(out + 8 * row, vorr_u8(lo, vadd_u8(hi, hi)));
+  }
+}
+
+#else
+
+/**
+ * @brief Spreads the 8 bits of a plane byte into the low bits of 8 bytes,
+ * most significant bit first, without branching.
+ */
+static inline uint64_t spread(byte_t plane) {
+  uint64_t lanes = (plane * 0x0101010101010101ull) & PLANE_MASK;
+  // any set bit in a lane carries into that lane's top bit, and no further
+  return ((lanes + 0x7F7F7F7F7F7F7F7Full) >> 7) & 0x0101010101010101ull;
+}
+
+/**
+ * @brief Decodes a tile a row at a time, 8 pixels per 64-bit word. Pixels
+ * are stored in memory order, which assumes a little-endian host.
+ */
+static void decode(const byte_t *tile, byte_t *out) {
+  for (int row = 0; row < 8; row++) {
+    uint64_t px = spread(tile[row]) | (spread(tile[row + 8]) << 1);
+    memcpy(out + 8 * row, &px, 8);
+  }
+}
+
+#endif
+
+/**
+ * @brief Initializes an empty cache; everything is decoded on first use.
+ */
+void pt_init(pattern_table_t *pt) {
+  memset(pt, 0, sizeof(*pt));
+  pt->gen = UINT32_MAX;  // so the first pt_sync() checks every page
+  pt_invalidate_all(pt);
+}
+
+/**
+ * @brief Decodes tile `tile` from the page it was last seen in.
+ */
+void pt_decode_tile(pattern_table_t *pt, size_t tile) {
+  size_t page = tile / PT_PAGE_TILES;
+  const byte_t *src = pt->src[page];
+  if (src) {
+    decode(src + (tile % PT_PAGE_TILES) * PT_TILE_SZ, &pt->px[tile][0][0]);
+  } else {
+    memset(pt->px[tile], 0, sizeof(pt->px[tile]));  // nothing mapped
+  }
+  pt->dirty[page] &= ~(1ull << (tile % PT_PAGE_TILES));
+}
+
+/**
+ * @brief Catches the cache up with bank switches: any page now backed by
+ * different memory is marked changed. Costs a single compare if the
+ * bus's PPU mappings haven't changed.
+ */
+void pt_sync(pattern_table_t *pt, const bus_t *bus) {
+  if (pt->gen == bus->ppu_map_gen) {
+    return;
+  }
+  pt->gen = bus->ppu_map_gen;
+
+  for (size_t page = 0; page < PT_PAGES; page++) {
+    if (pt->src[page] != bus->ppu_read_map[page]) {
+      pt->src[page] = bus->ppu_read_map[page];
+      pt->dirty[page] = ~0ull;
+    }
+  }
+}
@@ -1,9 +1,76 @@
 /**
- * @file
- * @brief
+ * @file patterntable.h
+ * @brief A cache of the pattern tables, pre-decoded to a byte per pixel.
+ *
+ * Pattern tables store each 8x8 tile as two bitplanes, so every pixel the
+ * PPU draws would otherwise need its two bits shuffled out of two bytes.
+ * Here tiles are decoded once, a whole tile at a time (with SIMD where the
+ * target has it), and rendering becomes a lookup.
  *
  * @note The pattern table is often bank-switched to store more data,
- * and it cannot be modeled as a simple/"dumb" RAM.
+ * and it cannot be modeled as a simple/"dumb" RAM. The cache notices bank
+ * switches through the bus's mapping generation, and CHR-RAM writes through
+ * pt_invalidate(); either way only the affected tiles are decoded again,
+ * and only once they are next drawn.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#pragma once
+#include <stdint.h>
+
+#include "memory/bus.h"
+#include "memory/umem.h"
+
+#define PT_SZ 0x2000u  // both pattern tables
+#define PT_TILE_SZ 16  // bytes per tile: 8 rows in each of 2 bitplanes
+#define PT_TILES (PT_SZ / PT_TILE_SZ)
+#define PT_PAGES (PT_SZ / UPPU_PAGE_SZ)
+#define PT_PAGE_TILES (UPPU_PAGE_SZ / PT_TILE_SZ)  // 64: one dirty word
+
+typedef struct pattern_table {
+  byte_t px[PT_TILES][8][8];   // decoded pixels (0-3), by tile, row, column
+  uint64_t dirty[PT_PAGES];    // one bit per tile that needs decoding
+  const byte_t *src[PT_PAGES]; // what each page was last decoded from
+  uint32_t gen;                // the bus's ppu_map_gen when last checked
+} pattern_table_t;
+
+void pt_init(pattern_table_t *pt);
+void pt_decode_tile(pattern_table_t *pt, size_t tile);
+void pt_sync(pattern_table_t *pt, const bus_t *bus);
+
+/**
+ * @brief Marks the tile holding pattern address `which` as changed, e.g.
+ * after a CHR-RAM write into `page`, the memory backing that address. The
+ * same memory can back more than one page (e.g. when a mapper switches a
+ * bank in twice), so the tile is marked in every page decoded from it.
  */
+static inline void pt_invalidate(pattern_table_t *pt, const byte_t *page,
+                                 uaddr_t which) {
+  uint64_t tile = 1ull << ((which % UPPU_PAGE_SZ) / PT_TILE_SZ);
+  for (size_t i = 0; i < PT_PAGES; i++) {
+    if (pt->src[i] == page) {
+      pt->dirty[i] |= tile;
+    }
+  }
+}
 
-typedef struct pattern_table {};
\ No newline at end of file
+/**
+ * @brief Marks every tile as changed.
+ */
+static inline void pt_invalidate_all(pattern_table_t *pt) {
+  for (size_t page = 0; page < PT_PAGES; page++) {
+    pt->dirty[page] = ~0ull;
+  }
+}
+
+/**
+ * @brief Looks up the 8 decoded pixels of the pattern row at pattern
+ * address `which` (i.e. tile * 16 + row), decoding its tile if it changed.
+ */
+static inline const byte_t *pt_row(pattern_table_t *pt, uaddr_t which) {
+  size_t tile = (which % PT_SZ) / PT_TILE_SZ;
+  if (pt->dirty[tile / PT_PAGE_TILES] >> (tile % PT_PAGE_TILES) & 1) {
+    pt_decode_tile(pt, tile);
+  }
+  return pt->px[tile][which % 8];
+}
@@ -0,0 +1,865 @@
+/**
+ * @file uppu.c
+ * @brief
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include "ppu/uppu.h"
+
+#include <string.h>
+
+#include "cartridge/mapper.h"
+#include "cpu/ucpu.h"
+#include "graphics/gfxprimitives.h"
+
+/*
+ * Tiles fetched per scanline: 32 visible, plus one for fine X scroll
+ */
+#define LINE_TILES 33
+
+/*
+ * Where the nametables' attribute tables start
+ */
+#define ATTRIBUTE_START 0x23C0u
+
+/*
+ * Bits of v: coarse X, coarse Y, nametable select, fine Y
+ */
+#define V_COARSE_X 0x001Fu
+#define V_COARSE_Y 0x03E0u
+#define V_NAMETABLE_X 0x0400u
+#define V_NAMETABLE_Y 0x0800u
+#define V_FINE_Y 0x7000u
+#define V_HORIZONTAL (V_COARSE_X | V_NAMETABLE_X)
+#define V_VERTICAL (V_COARSE_Y | V_NAMETABLE_Y | V_FINE_Y)
+
+/*
+ * Sprite pixels in a line buffer: the palette index in the low 5 bits,
+ * plus these
+ */
+#define SPR_BEHIND 0x20u  // drawn behind opaque background
+#define SPR_ZERO 0x40u    // belongs to sprite 0
+
+/*
+ * OAM sprite attribute bits
+ */
+#define ATTR_PALETTE 0x03u
+#define ATTR_BEHIND 0x20u
+#define ATTR_FLIP_H 0x40u
+#define ATTR_FLIP_V 0x80u
+
+/*
+ * The 2C02's 64 colors as RGB
+ */
+static const uint8_t COLORS[64][3] = {
+    {0x66, 0x66, 0x66}, {0x00, 0x2A, 0x88}, {0x14, 0x12, 0xA7},
+    {0x3B, 0x00, 0xA4}, {0x5C, 0x00, 0x7E}, {0x6E, 0x00, 0x40},
+    {0x6C, 0x06, 0x00}, {0x56, 0x1D, 0x00}, {0x33, 0x35, 0x00},
+    {0x0B, 0x48, 0x00}, {0x00, 0x52, 0x00}, {0x00, 0x4F, 0x08},
+    {0x00, 0x40, 0x4D}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00},
+    {0x00, 0x00, 0x00}, {0xAD, 0xAD, 0xAD}, {0x15, 0x5F, 0xD9},
+    {0x42, 0x40, 0xFF}, {0x75, 0x27, 0xFE}, {0xA0, 0x1A, 0xCC},
+    {0xB7, 0x1E, 0x7B}, {0xB5, 0x31, 0x20}, {0x99, 0x4E, 0x00},
+    {0x6B, 0x6D, 0x00}, {0x38, 0x87, 0x00}, {0x0C, 0x93, 0x00},
+    {0x00, 0x8F, 0x32}, {0x00, 0x7C, 0x8D}, {0x00, 0x00, 0x00},
+    {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, {0xFF, 0xFE, 0xFF},
+    {0x64, 0xB0, 0xFF}, {0x92, 0x90, 0xFF}, {0xC6, 0x76, 0xFF},
+    {0xF3, 0x6A, 0xFF}, {0xFE, 0x6E, 0xCC}, {0xFE, 0x81, 0x70},
+    {0xEA, 0x9E, 0x22}, {0xBC, 0xBE, 0x00}, {0x88, 0xD8, 0x00},
+    {0x5C, 0xE4, 0x30}, {0x45, 0xE0, 0x82}, {0x48, 0xCD, 0xDE},
+    {0x4F, 0x4F, 0x4F}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00},
+    {0xFF, 0xFE, 0xFF}, {0xC0, 0xDF, 0xFF}, {0xD3, 0xD2, 0xFF},
+    {0xE8, 0xC8, 0xFF}, {0xFB, 0xC2, 0xFF}, {0xFE, 0xC4, 0xEA},
+    {0xFE, 0xCC, 0xC5}, {0xF7, 0xD8, 0xA5}, {0xE4, 0xE5, 0x94},
+    {0xCF, 0xEF, 0x96}, {0xBD, 0xF4, 0xAB}, {0xB3, 0xF3, 0xCC},
+    {0xB5, 0xEB, 0xF2}, {0xB8, 0xB8, 0xB8}, {0x00, 0x00, 0x00},
+    {0x00, 0x00, 0x00}};
+
+/**
+ * @brief Reads pattern table or nametable memory, without the checks
+ * ppu_read() does. `which` must be below $3F00.
+ */
+static inline byte_t vram_read(bus_t *bus, uaddr_t which) {
+  byte_t *page = bus->ppu_read_map[which / UPPU_PAGE_SZ];
+  return page ? page[which % UPPU_PAGE_SZ] : 0;
+}
+
+/**
+ * @brief Maps a palette address onto palette RAM. The backdrop entries of
+ * the sprite palettes ($3F10, $3F14, ...) mirror the background's.
+ */
+static inline size_t palette_index(uaddr_t which) {
+  size_t idx = which % PALETTE_SZ;
+  return (idx & 0x13) == 0x10 ? idx & ~0x10u : idx;
+}
+
+/**
+ * @brief Resolves every palette RAM entry to the pixel it displays as.
+ * Called whenever palette RAM or the grayscale bit changes.
+ */
+static void refresh_colors(uppu_t *ppu) {
+  byte_t mask = (ppu->PPU_MASK & MASK_GRAYSCALE) ? 0x30 : 0x3F;
+  for (size_t i = 0; i < PALETTE_SZ; i++) {
+    const uint8_t *rgb = COLORS[ppu->palette[palette_index(i)] & mask];
+    ppu->colors[i] = new_pixel(rgb[0], rgb[1], rgb[2]);
+  }
+}
+
+/**
+ * @brief Reads the byte at `which` in the PPU's address space.
+ */
+byte_t ppu_read(uppu_t *ppu, uaddr_t which) {
+  which %= UPPU_MEM_CAP;
+  if (which >= PALETTE_START) {
+    return ppu->palette[palette_index(which)];
+  }
+  return vram_read(ppu->buslink.bus, which);
+}
+
+/**
+ * @brief Writes the byte at `which` in the PPU's address space. Writes to
+ * CHR-ROM are dropped.
+ */
+void ppu_write(uppu_t *ppu, uaddr_t which, byte_t what) {
+  which %= UPPU_MEM_CAP;
+  if (which >= PALETTE_START) {
+    ppu->palette[palette_index(which)] = what & 0x3F;
+    refresh_colors(ppu);
+    return;
+  }
+
+  byte_t *page = ppu->buslink.bus->ppu_write_map[which / UPPU_PAGE_SZ];
+  if (page) {
+    page[which % UPPU_PAGE_SZ] = what;
+    if (which < PT_SZ) {
+      pt_invalidate(&ppu->pt, page, which);
+    }
+  }
+}
+
+/**
+ * @brief Moves v on to the next VRAM address after a PPU_DATA access.
+ */
+static void increment_addr(uppu_t *ppu) {
+  ppu->v += (ppu->PPU_CTRL & CTRL_INCREMENT) ? 32 : 1;
+  ppu->v &= 0x7FFF;
+}
+
+/**
+ * @brief Runs the PPU up to the moment the CPU is accessing the bus, so an
+ * access that reads or changes the PPU's state lands on the right dot (or,
+ * in scanline mode, the right scanline).
+ */
+void ppu_sync(uppu_t *ppu) {
+  ucpu_t *cpu = ppu->buslink.bus->cpu;
+  if (cpu) {
+    ppu_catch_up(ppu, access_clock(cpu) * PPU_DOTS_PER_CPU_CYC);
+  }
+}
+
+/**
+ * @brief Reads one of the 8 CPU-exposed PPU registers.
+ */
+static byte_t ppu_reg_read(bus_t *bus, uaddr_t which) {
+  uppu_t *ppu = bus->ppu;
+  ppu_sync(ppu);
+
+  // handle mirroring
+  uaddr_t request = (which % 8) + PPU_CTRL_ADDR;
+
+  switch (request) {
+    case PPU_STAT_ADDR: {
+      // the low 5 bits are stale bits of the latch
+      bus->p_latch = (ppu->PPU_STAT & 0xE0) | (bus->p_latch & 0x1F);
+      ppu->PPU_STAT &= ~STAT_VBLANK;
+      ppu->w = false;
+      break;
+    }
+
+    case PPU_OAMD_ADDR: {
+      bus->p_latch = ppu->oam[ppu->OAM_ADDR];
+      break;
+    }
+
+    case PPU_DATA_ADDR: {
+      uaddr_t addr = ppu->v % UPPU_MEM_CAP;
+      if (addr >= PALETTE_START) {
+        // palette reads skip the buffer, which is filled from the
+        // nametable "underneath" instead. the top 2 bits are open bus.
+        bus->p_latch = (bus->p_latch & 0xC0) | ppu_read(ppu, addr);
+        ppu->data_buf = vram_read(bus, addr - 0x1000);
+      } else {
+        bus->p_latch = ppu->data_buf;
+        ppu->data_buf = vram_read(bus, addr);
+      }
+      increment_addr(ppu);
+      break;
+    }
+
+    default:  // write-only registers read back the latch
+      break;
+  }
+  return bus->p_latch;
+}
+
+/**
+ * @brief Writes one of the 8 CPU-exposed PPU registers.
+ */
+static void ppu_reg_write(bus_t *bus, uaddr_t which, byte_t what) {
+  uppu_t *ppu = bus->ppu;
+  ppu_sync(ppu);
+
+  // writing anything to the PPU registers (even to STATUS)
+  // fills the 8-bit latch. when reading a write-only
+  // register, the value of the latch is returned.
+  // latch delay is unimplemented.
+  bus->p_latch = what;
+
+  // handle mirroring
+  uaddr_t request = (which % 8) + PPU_CTRL_ADDR;
+
+  switch (request) {
+    case PPU_CTRL_ADDR: {
+      // enabling NMIs during VBlank fires one straight away
+      if (!(ppu->PPU_CTRL & CTRL_NMI) && (what & CTRL_NMI) &&
+          (ppu->PPU_STAT & STAT_VBLANK)) {
+        bus->nmi = true;
+      }
+      ppu->PPU_CTRL = what;
+      ppu->t = (ppu->t & ~V_NAMETABLE_X & ~V_NAMETABLE_Y) |
+               ((what & CTRL_NAMETABLE) << 10);
+      break;
+    }
+
+    case PPU_MASK_ADDR: {
+      bool gray = (ppu->PPU_MASK ^ what) & MASK_GRAYSCALE;
+      ppu->PPU_MASK = what;
+      if (gray) {
+        refresh_colors(ppu);
+      }
+      break;
+    }
+
+    case PPU_OAMA_ADDR: {
+      ppu->OAM_ADDR = what;
+      break;
+    }
+
+    case PPU_OAMD_ADDR: {
+      ppu->oam[ppu->OAM_ADDR++] = what;
+      break;
+    }
+
+    case PPU_SCRL_ADDR: {
+      if (!ppu->w) {
+        ppu->t = (ppu->t & ~V_COARSE_X) | (what >> 3);
+        ppu->x = what & 0x07;
+      } else {
+        ppu->t = (ppu->t & ~V_COARSE_Y & ~V_FINE_Y) |
+                 ((uaddr_t)(what & 0xF8) << 2) | ((uaddr_t)(what & 0x07) << 12);
+      }
+      // toggle the write latch
+      ppu->w = !ppu->w;
+      break;
+    }
+
+    case PPU_ADDR_ADDR: {
+      if (!ppu->w) {
+        ppu->t = (ppu->t & 0x00FF) | ((uaddr_t)(what & 0x3F) << 8);
+      } else {
+        ppu->t = (ppu->t & 0xFF00) | what;
+        ppu->v = ppu->t;
+      }
+      // toggle the write latch
+      ppu->w = !ppu->w;
+      break;
+    }
+
+    case PPU_DATA_ADDR: {
+      ppu_write(ppu, ppu->v, what);
+      increment_addr(ppu);
+      break;
+    }
+
+    default:  // do nothing
+      break;
+  }
+}
+
+/**
+ * @brief Copies a page of CPU memory into OAM, starting at OAM_ADDR and
+ * wrapping around, as OAM DMA does. OAM_ADDR ends where it started.
+ */
+void ppu_oam_dma(uppu_t *ppu, const byte_t *page) {
+  ppu_sync(ppu);
+  size_t first = OAM_SZ - ppu->OAM_ADDR;
+  memcpy(ppu->oam + ppu->OAM_ADDR, page, first);
+  memcpy(ppu->oam, page + first, ppu->OAM_ADDR);
+}
+
+/* RENDERING */
+
+/**
+ * @brief Looks up the background for the scanline v points at. Nametable
+ * and attribute bytes come straight from VRAM and pattern rows from the
+ * decoded pattern tables; the shift registers are left alone.
+ *
+ * @param[out] bg Background palette indices for the line; 0 where the
+ * background is transparent.
+ */
+static void render_background(uppu_t *ppu, byte_t *bg) {
+  bus_t *bus = ppu->buslink.bus;
+  uaddr_t v = ppu->v;
+  // v already points past the two tiles prefetched at the end of the last
+  // line (see prefetch()); start from the first of them
+  if ((v & V_COARSE_X) < 2) {
+    v ^= V_NAMETABLE_X;
+  }
+  v = (v & ~V_COARSE_X) | ((v - 2) & V_COARSE_X);
+  uaddr_t table = (ppu->PPU_CTRL & CTRL_BG_TABLE) ? 0x1000 : 0x0000;
+  uaddr_t fine_y = (v & V_FINE_Y) >> 12;
+
+  // tiles are written 8 pixels at a time, with room on either side for
+  // the ones fine X scroll pushes partly off the line
+  byte_t line[8 + LINE_TILES * 8];
+  byte_t *at = line + 8 - ppu->x;
+  for (int tile = 0; tile < LINE_TILES; tile++, at += 8) {
+    byte_t index = vram_read(bus, UPPU_NAMETABLE_START | (v & 0x0FFF));
+    byte_t attr = vram_read(bus, ATTRIBUTE_START | (v & 0x0C00) |
+                                     ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+    // each attribute byte covers 4x4 tiles, 2 bits per 2x2 quadrant
+    uint64_t palette = ((attr >> (((v >> 4) & 4) | (v & 2))) & 3) << 2;
+
+    uint64_t px;
+    memcpy(&px, pt_row(&ppu->pt, table + index * 16 + fine_y), 8);
+    // give every opaque pixel the palette, all 8 at once
+    uint64_t opaque = (px | (px >> 1)) & 0x0101010101010101ull;
+    px |= opaque * palette;
+    memcpy(at, &px, 8);
+
+    // coarse X increment, wrapping into the next nametable over
+    if ((v & V_COARSE_X) == V_COARSE_X) {
+      v = (v & ~V_COARSE_X) ^ V_NAMETABLE_X;
+    } else {
+      v++;
+    }
+  }
+  memcpy(bg, line + 8, NES_PX_WIDTH);
+}
+
+/**
+ * @brief Evaluates and decodes the sprites on scanline `y`.
+ *
+ * A sprite's Y coordinate is one less than the first line it appears on.
+ * Only the first LINE_SPRITES sprites in OAM order are drawn; finding
+ * another sets the overflow flag (without the hardware's false positives).
+ *
+ * @param[out] spr Sprite pixels for the line (see SPR_BEHIND); 0 where no
+ * sprite is opaque.
+ */
+static void render_sprites(uppu_t *ppu, int y, byte_t *spr) {
+  int height = (ppu->PPU_CTRL & CTRL_SPR_LARGE) ? 16 : 8;
+  int found = 0;
+
+  for (int i = 0; i < OAM_SPRITES; i++) {
+    const byte_t *sprite = &ppu->oam[i * 4];
+    int row = y - 1 - sprite[0];
+    if (row < 0 || row >= height) {
+      continue;
+    }
+    if (found++ == LINE_SPRITES) {
+      ppu->PPU_STAT |= STAT_OVERFLOW;
+      break;
+    }
+
+    byte_t tile = sprite[1];
+    byte_t attr = sprite[2];
+    if (attr & ATTR_FLIP_V) {
+      row = height - 1 - row;
+    }
+
+    uaddr_t pattern;
+    if (height == 16) {
+      // 8x16 sprites pick their table with the tile number's low bit
+      pattern = ((tile & 1) ? 0x1000 : 0x0000) + (tile & 0xFE) * 16 +
+                (row & 8) * 2 + (row & 7);
+    } else {
+      pattern = ((ppu->PPU_CTRL & CTRL_SPR_TABLE) ? 0x1000 : 0x0000) +
+                tile * 16 + row;
+    }
+    const byte_t *px = pt_row(&ppu->pt, pattern);
+
+    byte_t flags = 0x10 | ((attr & ATTR_PALETTE) << 2) |
+                   ((attr & ATTR_BEHIND) ? SPR_BEHIND : 0) |
+                   (i == 0 ? SPR_ZERO : 0);
+    for (int b = 0; b < 8; b++) {
+      int at = sprite[3] + b;
+      if (at >= NES_PX_WIDTH) {
+        break;
+      }
+      byte_t bits = px[(attr & ATTR_FLIP_H) ? 7 - b : b];
+      // lower OAM indices win, even when they're behind the background
+      if (bits && !(spr[at] & 3)) {
+        spr[at] = flags | bits;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Picks which of a background and a sprite pixel shows at `x`, and
+ * checks for a sprite-0 hit.
+ *
+ * @returns the palette index of the pixel that shows.
+ */
+static inline byte_t compose(uppu_t *ppu, byte_t bg, byte_t spr, int x) {
+  if (!(spr & 3)) {
+    return bg;
+  }
+  // x = 255 never registers a hit
+  if ((spr & SPR_ZERO) && bg && x != NES_PX_WIDTH - 1) {
+    ppu->PPU_STAT |= STAT_SPR0_HIT;
+  }
+  return (!(spr & SPR_BEHIND) || !bg) ? spr & 0x1F : bg;
+}
+
+/**
+ * @brief Renders visible scanline `y`, into the screen if there is one.
+ */
+static void draw_line(uppu_t *ppu, int y) {
+  byte_t bg[NES_PX_WIDTH] = {0};
+  byte_t spr[NES_PX_WIDTH] = {0};
+
+  pt_sync(&ppu->pt, ppu->buslink.bus);
+
+  if (ppu->PPU_MASK & MASK_BG) {
+    render_background(ppu, bg);
+    if (!(ppu->PPU_MASK & MASK_BG_LEFT)) {
+      memset(bg, 0, 8);
+    }
+  }
+  if (ppu->PPU_MASK & MASK_SPR) {
+    render_sprites(ppu, y, spr);
+    if (!(ppu->PPU_MASK & MASK_SPR_LEFT)) {
+      memset(spr, 0, 8);
+    }
+  }
+
+  pixel_t *row =
+      ppu->screen ? back_frame(ppu->screen) + y * NES_PX_WIDTH : NULL;
+  for (int x = 0; x < NES_PX_WIDTH; x++) {
+    byte_t color = compose(ppu, bg[x], spr[x], x);
+    if (row) {
+      row[x] = ppu->colors[color];
+    }
+  }
+}
+
+/**
+ * @brief Moves v down a line, as the PPU does at the end of each rendered
+ * scanline.
+ */
+static void increment_y(uppu_t *ppu) {
+  uaddr_t v = ppu->v;
+  if ((v & V_FINE_Y) != V_FINE_Y) {
+    ppu->v = v + 0x1000;
+    return;
+  }
+
+  v &= ~V_FINE_Y;
+  uaddr_t coarse_y = (v & V_COARSE_Y) >> 5;
+  if (coarse_y == 29) {
+    // the last row of tiles; wrap into the next nametable down
+    coarse_y = 0;
+    v ^= V_NAMETABLE_Y;
+  } else if (coarse_y == 31) {
+    // out of bounds (i.e. in the attribute table); wraps without switching
+    coarse_y = 0;
+  } else {
+    coarse_y++;
+  }
+  ppu->v = (v & ~V_COARSE_Y) | (coarse_y << 5);
+}
+
+/**
+ * @brief Reloads v's horizontal position from t, as the PPU does on dot 257
+ * of each rendered scanline.
+ */
+static inline void copy_horizontal(uppu_t *ppu) {
+  ppu->v = (ppu->v & ~V_HORIZONTAL) | (ppu->t & V_HORIZONTAL);
+}
+
+/**
+ * @brief Reloads v's vertical position from t, as the PPU does on the
+ * pre-render line.
+ */
+static inline void copy_vertical(uppu_t *ppu) {
+  ppu->v = (ppu->v & ~V_VERTICAL) | (ppu->t & V_VERTICAL);
+}
+
+/**
+ * @brief Enters VBlank, raising an NMI if they are enabled. The frame just
+ * drawn is complete, so it goes to the screen.
+ */
+static void start_vblank(uppu_t *ppu) {
+  ppu->PPU_STAT |= STAT_VBLANK;
+  ppu->frame++;
+  if (ppu->screen) {
+    publish_frame(ppu->screen);
+  }
+  if (ppu->PPU_CTRL & CTRL_NMI) {
+    ppu->buslink.bus->nmi = true;
+  }
+}
+
+/**
+ * @brief Whether the PPU fetches on `line` while rendering, i.e. whether it
+ * is a visible line or the pre-render line.
+ */
+static inline bool fetch_line(int line) {
+  return line < PPU_VISIBLE_LINES || line == PPU_PRERENDER_LINE;
+}
+
+/**
+ * @brief Whether the cartridge's mapper counts the scanlines the PPU
+ * fetches on (e.g. MMC3, for its scanline IRQ).
+ */
+static inline bool counts_lines(const uppu_t *ppu) {
+  mapper_t *mapper = ppu->buslink.bus->mapper;
+  return mapper && mapper->ops->scanline;
+}
+
+/**
+ * @brief Clocks a mapper that counts scanlines, as the PPU's fetches on
+ * dot PPU_MAPPER_DOT of each fetching line would.
+ */
+static inline void clock_mapper(uppu_t *ppu) {
+  if (counts_lines(ppu)) {
+    mapper_t *mapper = ppu->buslink.bus->mapper;
+    mapper->ops->scanline(mapper);
+  }
+}
+
+/* DOT MODE */
+
+/*
+ * The background pipeline follows the hardware: every 8 dots the nametable,
+ * attribute and pattern bytes of a tile are fetched and then loaded into
+ * the low halves of 16-bit shift registers, which shift once per dot. The
+ * first two tiles of each line are prefetched at the end of the previous
+ * one.
+ *
+ * Sprites are evaluated and decoded for the next line all at once on dot
+ * 257, into a line buffer that is read out as the line is drawn.
+ */
+
+/**
+ * @brief Loads the tile just fetched into the low halves of the
+ * background shift registers.
+ */
+static inline void load_shifters(uppu_t *ppu) {
+  ppu->bg_lo = (ppu->bg_lo & 0xFF00) | ppu->next_lo;
+  ppu->bg_hi = (ppu->bg_hi & 0xFF00) | ppu->next_hi;
+  ppu->at_lo = (ppu->at_lo & 0xFF00) | ((ppu->next_attr & 1) ? 0xFF : 0x00);
+  ppu->at_hi = (ppu->at_hi & 0xFF00) | ((ppu->next_attr & 2) ? 0xFF : 0x00);
+}
+
+/**
+ * @brief Runs step `phase` of the 8-dot background fetch cycle.
+ */
+static inline void fetch(uppu_t *ppu, int phase) {
+  bus_t *bus = ppu->buslink.bus;
+  uaddr_t v = ppu->v;
+  uaddr_t pattern = ((ppu->PPU_CTRL & CTRL_BG_TABLE) ? 0x1000 : 0x0000) +
+                    ppu->next_tile * 16 + ((v & V_FINE_Y) >> 12);
+
+  switch (phase) {
+    case 0: {
+      load_shifters(ppu);
+      ppu->next_tile = vram_read(bus, UPPU_NAMETABLE_START | (v & 0x0FFF));
+      break;
+    }
+
+    case 2: {
+      byte_t attr = vram_read(bus, ATTRIBUTE_START | (v & 0x0C00) |
+                                       ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+      ppu->next_attr = (attr >> (((v >> 4) & 4) | (v & 2))) & 3;
+      break;
+    }
+
+    case 4: {
+      ppu->next_lo = vram_read(bus, pattern);
+      break;
+    }
+
+    case 6: {
+      ppu->next_hi = vram_read(bus, pattern + 8);
+      break;
+    }
+
+    case 7: {
+      // coarse X increment, wrapping into the next nametable over
+      if ((v & V_COARSE_X) == V_COARSE_X) {
+        ppu->v = (v & ~V_COARSE_X) ^ V_NAMETABLE_X;
+      } else {
+        ppu->v = v + 1;
+      }
+      break;
+    }
+
+    default:  // the second dot of each fetch
+      break;
+  }
+}
+
+/**
+ * @brief Draws the pixel at (x, y) from the shift registers and the
+ * sprite line buffer.
+ */
+static inline void output_pixel(uppu_t *ppu, int x, int y) {
+  byte_t bg = 0;
+  if ((ppu->PPU_MASK & MASK_BG) && (x >= 8 || (ppu->PPU_MASK & MASK_BG_LEFT))) {
+    uint16_t mux = 0x8000 >> ppu->x;
+    byte_t bits = ((ppu->bg_lo & mux) ? 1 : 0) | ((ppu->bg_hi & mux) ? 2 : 0);
+    byte_t palette =
+        ((ppu->at_lo & mux) ? 1 : 0) | ((ppu->at_hi & mux) ? 2 : 0);
+    bg = bits ? (palette << 2) | bits : 0;
+  }
+
+  byte_t spr = 0;
+  if ((ppu->PPU_MASK & MASK_SPR) &&
+      (x >= 8 || (ppu->PPU_MASK & MASK_SPR_LEFT))) {
+    spr = ppu->spr_line[x];
+  }
+
+  byte_t color = compose(ppu, bg, spr, x);
+  if (ppu->screen) {
+    back_frame(ppu->screen)[y * NES_PX_WIDTH + x] = ppu->colors[color];
+  }
+}
+
+/**
+ * @brief Runs the PPU for a single dot.
+ */
+static void tick(uppu_t *ppu) {
+  int line = ppu->scanline;
+  int dot = ppu->dot;
+  bool rendering = ppu->PPU_MASK & MASK_RENDERING;
+  bool visible = line < PPU_VISIBLE_LINES;
+
+  if (visible || line == PPU_PRERENDER_LINE) {
+    if (line == PPU_PRERENDER_LINE && dot == 1) {
+      ppu->PPU_STAT &= ~(STAT_VBLANK | STAT_SPR0_HIT | STAT_OVERFLOW);
+    }
+
+    if (rendering) {
+      if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337)) {
+        ppu->bg_lo <<= 1;
+        ppu->bg_hi <<= 1;
+        ppu->at_lo <<= 1;
+        ppu->at_hi <<= 1;
+      }
+      if ((dot >= 1 && dot <= 256) || (dot >= 321 && dot <= 336)) {
+        fetch(ppu, (dot - 1) % 8);
+      }
+
+      if (dot == 256) {
+        increment_y(ppu);
+      } else if (dot == 257) {
+        load_shifters(ppu);
+        copy_horizontal(ppu);
+        memset(ppu->spr_line, 0, sizeof(ppu->spr_line));
+        if (visible && (ppu->PPU_MASK & MASK_SPR)) {
+          pt_sync(&ppu->pt, ppu->buslink.bus);
+          render_sprites(ppu, line + 1, ppu->spr_line);
+        }
+      } else if (dot == PPU_MAPPER_DOT) {
+        clock_mapper(ppu);
+      } else if (line == PPU_PRERENDER_LINE && dot >= 280 && dot <= 304) {
+        copy_vertical(ppu);
+      }
+    }
+
+    if (visible && dot >= 1 && dot <= NES_PX_WIDTH) {
+      output_pixel(ppu, dot - 1, line);
+    }
+  } else if (line == PPU_VBLANK_LINE && dot == 1) {
+    start_vblank(ppu);
+  }
+
+  ppu->dots++;
+  ppu->dot++;
+  // with rendering on, odd frames skip the pre-render line's last dot
+  bool skip = line == PPU_PRERENDER_LINE && rendering && (ppu->frame & 1) &&
+              ppu->dot == PPU_DOTS_PER_LINE - 1;
+  if (ppu->dot == PPU_DOTS_PER_LINE || skip) {
+    ppu->dot = 0;
+    ppu->scanline = (line + 1) % PPU_LINES_PER_FRAME;
+  }
+}
+
+/**
+ * @brief Runs the prefetch of the next line's first two tiles (dots
+ * 321-337), so that a scanline mode PPU leaves the pipeline as a dot mode
+ * one would, and can be switched over at any line boundary.
+ */
+static void prefetch(uppu_t *ppu) {
+  for (int dot = 321; dot <= 337; dot++) {
+    if (dot >= 322) {
+      ppu->bg_lo <<= 1;
+      ppu->bg_hi <<= 1;
+      ppu->at_lo <<= 1;
+      ppu->at_hi <<= 1;
+    }
+    if (dot <= 336) {
+      fetch(ppu, (dot - 1) % 8);
+    }
+  }
+}
+
+/**
+ * @brief Initializes the PPU in its power-on state.
+ *
+ * @param[out] Pointer to where the ppu struct should be written.
+ */
+void init_ppu(uppu_t *ppu) {
+  memset(ppu, 0, sizeof(*ppu));
+  ppu->buslink = (buslink_t){DEV_PPU, NULL};
+  ppu->mode = PPU_DEFAULT_MODE;
+  pt_init(&ppu->pt);
+  refresh_colors(ppu);
+}
+
+/**
+ * @brief Links the PPU onto the bus and exposes its registers to the CPU at
+ * $2000-$3FFF.
+ */
+void connect_ppu(uppu_t *ppu, bus_t *bus) {
+  link_device(&ppu->buslink, bus);
+  bus->ppu = ppu;
+  map_io(bus, UCPU_MIRROR_RANGE, UCPU_PPU_REG_RANGE - UCPU_MIRROR_RANGE,
+         ppu_reg_read, ppu_reg_write);
+}
+
+/* SCANLINE MODE */
+
+/**
+ * @brief Moves a scanline mode PPU on to the start of the next line.
+ */
+static void end_line(uppu_t *ppu) {
+  int dots = PPU_DOTS_PER_LINE;
+  // with rendering on, odd frames skip the pre-render line's last dot
+  if (ppu->scanline == PPU_PRERENDER_LINE &&
+      (ppu->PPU_MASK & MASK_RENDERING) && (ppu->frame & 1)) {
+    dots--;
+  }
+  ppu->dots += dots - ppu->dot;
+  ppu->dot = 0;
+  ppu->scanline = (ppu->scanline + 1) % PPU_LINES_PER_FRAME;
+}
+
+/**
+ * @brief Runs a scanline mode PPU through the start of the next scanline.
+ *
+ * Everything the scanline does happens at once: visible lines are drawn
+ * and v moved on to the next, VBlank (and with it, NMI) begins on line
+ * PPU_VBLANK_LINE, and the pre-render line clears the status flags and
+ * reloads v from t. A line the mapper counts is left at PPU_MAPPER_DOT
+ * for finish_line(); any other line is over.
+ */
+static void start_line(uppu_t *ppu) {
+  int line = ppu->scanline;
+  bool rendering = ppu->PPU_MASK & MASK_RENDERING;
+
+  if (line < PPU_VISIBLE_LINES) {
+    draw_line(ppu, line);
+    if (rendering) {
+      increment_y(ppu);
+      copy_horizontal(ppu);
+      prefetch(ppu);
+    }
+  } else if (line == PPU_VBLANK_LINE) {
+    start_vblank(ppu);
+  } else if (line == PPU_PRERENDER_LINE) {
+    ppu->PPU_STAT &= ~(STAT_VBLANK | STAT_SPR0_HIT | STAT_OVERFLOW);
+    if (rendering) {
+      ppu->v = ppu->t;
+      prefetch(ppu);
+    }
+  }
+
+  if (fetch_line(line) && counts_lines(ppu)) {
+    ppu->dots += PPU_MAPPER_DOT;
+    ppu->dot = PPU_MAPPER_DOT;
+  } else {
+    end_line(ppu);
+  }
+}
+
+/**
+ * @brief Runs a scanline mode PPU through the rest of a line the mapper
+ * counts, from PPU_MAPPER_DOT on.
+ */
+static void finish_line(uppu_t *ppu) {
+  if (ppu->PPU_MASK & MASK_RENDERING) {
+    clock_mapper(ppu);
+  }
+  end_line(ppu);
+}
+
+/* CATCHING UP */
+
+/**
+ * @brief Runs the PPU until it reaches dot `dot` (counting from
+ * init_ppu()). Does nothing if it is already there.
+ *
+ * A scanline mode PPU does a line's work as soon as the line begins, so it
+ * runs every line that has begun by `dot` and may end up past it.
+ */
+void ppu_catch_up(uppu_t *ppu, uint64_t dot) {
+  for (;;) {
+    if (ppu->mode == PPU_DOT ||
+        (ppu->dot != 0 && ppu->dot != PPU_MAPPER_DOT)) {
+      // a PPU switched to scanline mode ticks on to the end of the line
+      if (ppu->dots >= dot) {
+        return;
+      }
+      tick(ppu);
+    } else {
+      if (ppu->dots > dot) {
+        return;
+      }
+      if (ppu->dot == 0) {
+        start_line(ppu);
+      } else {
+        finish_line(ppu);
+      }
+    }
+  }
+}
+
+/**
+ * @brief The dot by which the PPU must next be caught up, even if the CPU
+ * leaves it alone: when it next does something the CPU can notice
+ * without asking, i.e. enters VBlank (raising NMI, and finishing a frame)
+ * or clocks the mapper. The end of the pre-render line counts too, since
+ * whether it is a dot short is only known once it has been run.
+ */
+uint64_t ppu_next_event(const uppu_t *ppu) {
+  bool counted = counts_lines(ppu);
+  uint64_t start = ppu->dots - ppu->dot;
+
+  // catching up to one dot past an event is what runs it
+  for (int line = ppu->scanline;; line++) {
+    if (counted && fetch_line(line) && ppu->dots <= start + PPU_MAPPER_DOT) {
+      return start + PPU_MAPPER_DOT + 1;
+    }
+    if (line == PPU_VBLANK_LINE && ppu->dots <= start + 1) {
+      return start + 2;
+    }
+    if (line == PPU_PRERENDER_LINE) {
+      return start + PPU_DOTS_PER_LINE;
+    }
+    start += PPU_DOTS_PER_LINE;
+  }
+}
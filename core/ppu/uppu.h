@@ -1,10 +1,36 @@
-#ifndef CPU_TESTS
+/**
+ * @file uppu.h
+ * @brief The picture processing unit.
+ *
+ * By default rendering is scanline-granular: each visible scanline is
+ * fetched, evaluated and drawn in one go, from the state the registers are
+ * in when the line starts. Mid-line register writes therefore take effect
+ * on the next line, which is exact enough for the vast majority of games.
+ *
+ * Titles that rely on mid-scanline effects or exact sprite-0 timing can
+ * switch a PPU into dot mode, which runs the real 341-dot pipeline. Both
+ * modes keep all their state in uppu_t, and a mode switch takes effect at
+ * the next scanline.
+ *
+ * Either way the PPU runs behind the CPU, and is only caught up to it
+ * (see ppu_catch_up()) when the CPU touches a PPU register or a mapper
+ * register, or when the PPU is due to do something the CPU would notice
+ * (see ppu_next_event()).
+ *
+ * See spec here: https://www.nesdev.org/wiki/PPU
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
 #pragma once
 
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "graphics/frame_buffer.h"
+#include "graphics/pixels.h"
+#include "memory/bus.h"
 #include "memory/umem.h"
+#include "ppu/patterntable.h"
 
 #define PPU_CTRL_ADDR 0x2000u
 #define PPU_MASK_ADDR 0x2001u
@@ -17,20 +43,84 @@
 
 #define OAM_DMA_ADDR 0x4014u
 
+/*
+ * CPU cycles OAM DMA halts the CPU for: one to wait for the write to
+ * finish, then a read and a write per byte. It takes one more to line up
+ * if it starts on an odd cycle.
+ */
+#define OAM_DMA_CYCS 513
+
+/*
+ * PPU_CTRL bits
+ */
+#define CTRL_NAMETABLE 0x03u
+#define CTRL_INCREMENT 0x04u   // add 32 to v on PPU_DATA access, not 1
+#define CTRL_SPR_TABLE 0x08u   // 8x8 sprite patterns at $1000
+#define CTRL_BG_TABLE 0x10u    // background patterns at $1000
+#define CTRL_SPR_LARGE 0x20u   // 8x16 sprites
+#define CTRL_NMI 0x80u
+
+/*
+ * PPU_MASK bits
+ */
+#define MASK_GRAYSCALE 0x01u
+#define MASK_BG_LEFT 0x02u   // show background in the leftmost 8 pixels
+#define MASK_SPR_LEFT 0x04u  // ditto, for sprites
+#define MASK_BG 0x08u
+#define MASK_SPR 0x10u
+#define MASK_RENDERING (MASK_BG | MASK_SPR)
+
+/*
+ * PPU_STAT bits
+ */
+#define STAT_OVERFLOW 0x20u
+#define STAT_SPR0_HIT 0x40u
+#define STAT_VBLANK 0x80u
+
+/*
+ * Frame timing, in PPU dots (three per CPU cycle on NTSC)
+ */
+#define PPU_DOTS_PER_LINE 341
+#define PPU_LINES_PER_FRAME 262
+#define PPU_VISIBLE_LINES 240
+#define PPU_VBLANK_LINE 241
+#define PPU_PRERENDER_LINE 261
+#define PPU_DOTS_PER_CPU_CYC 3
+
+/*
+ * The dot on which a mapper watching PPU A12 sees its scanline edge
+ */
+#define PPU_MAPPER_DOT 260
+
+#define OAM_SZ 256
+#define OAM_SPRITES (OAM_SZ / 4)
+#define LINE_SPRITES 8  // sprites the PPU can draw on one scanline
+
+#define PALETTE_START 0x3F00u
+#define PALETTE_SZ 32
+
+/*
+ * How finely the PPU is emulated. Building with UPPU_DOT_DEFAULT makes dot
+ * mode the default for every PPU.
+ */
+typedef enum { PPU_SCANLINE, PPU_DOT } ppu_mode_t;
+
+#ifdef UPPU_DOT_DEFAULT
+#define PPU_DEFAULT_MODE PPU_DOT
+#else
+#define PPU_DEFAULT_MODE PPU_SCANLINE
+#endif
+
 typedef struct uppu {
-  /* The 8 standard CPU-exposed registers */
+  /* CPU-exposed registers that hold state */
 
+  // PPU_SCRL and PPU_ADDR only ever write into t, v, x and w, and
+  // OAM_DATA reads and writes oam[], so none of them is stored separately
   uregr_t PPU_CTRL;
   uregr_t PPU_MASK;
   uregr_t PPU_STAT;
   uregr_t OAM_ADDR;
-  uregr_t OAM_DATA;
-  uregr_t PPU_SCRL;
-  uregr_t PPU_ADDR;
-
-  /* The special CPU-exposed OAMDMA register */
-
-  uregr_t OAM_DMA;
+  byte_t data_buf;  // PPU_DATA's read buffer
 
   /* PPU internal registers */
 
@@ -39,6 +129,51 @@ typedef struct uppu {
   uregr_t x;  // fine X scroll; 3 bits
   bool w;     // first or second write toggle; 1 bit
 
+  /* INTERNAL MEMORY */
+
+  byte_t oam[OAM_SZ];          // object attribute memory: 64 sprites
+  byte_t palette[PALETTE_SZ];  // palette RAM
+  pixel_t colors[PALETTE_SZ];  // palette RAM resolved to pixels
+
+  /* TIMING */
+
+  ppu_mode_t mode;
+  int scanline;    // line being (or about to be) rendered
+  int dot;         // next dot to run; 0 or PPU_MAPPER_DOT in scanline mode
+  uint64_t frame;  // frames completed, i.e. VBlanks entered
+  uint64_t dots;   // dots elapsed since init_ppu()
+
+  /* DOT MODE PIPELINE */
+
+  uint16_t bg_lo;  // background pattern shift registers
+  uint16_t bg_hi;
+  uint16_t at_lo;  // background palette shift registers
+  uint16_t at_hi;
+  byte_t next_tile;  // the tile being fetched
+  byte_t next_attr;
+  byte_t next_lo;
+  byte_t next_hi;
+  byte_t spr_line[NES_PX_WIDTH];  // sprites evaluated for the current line
+
+  /* LINKS */
+
+  // not saved (see nes/savestate.h)
+  buslink_t buslink;
+  frame_buffer_t *screen;  // where frames are drawn; NULL to skip drawing
+
+  /* DERIVED STATE */
+
+  pattern_table_t pt;  // pattern tables, decoded; rebuilt on demand
+
 } uppu_t;
 
-#endif
\ No newline at end of file
+void init_ppu(uppu_t *ppu);
+void connect_ppu(uppu_t *ppu, bus_t *bus);
+
+byte_t ppu_read(uppu_t *ppu, uaddr_t which);
+void ppu_write(uppu_t *ppu, uaddr_t which, byte_t what);
+void ppu_oam_dma(uppu_t *ppu, const byte_t *page);
+
+void ppu_catch_up(uppu_t *ppu, uint64_t dot);
+void ppu_sync(uppu_t *ppu);
+uint64_t ppu_next_event(const uppu_t *ppu);
@@ -15,25 +15,22 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "cartridge/cartridge.h"
+#include "cartridge/mapper.h"
 #include "cpu/ucpu.h"
-#include "cpu/uerrno.h"
 #include "memory/umem.h"
-#include "memory/urom.h"
 
-#define NESTEST_SZ 0xFFFFu
-#define NES_HEADER_SZ 16
+#define NESTEST_PATH "eval/execs/official.nes"
 
-clk_t global_clock;
-uint64_t instrs_execed;
-uerrno_t UERRNO;
+/*
+ * Cycles handed to run_cycles() per call; roughly one NTSC frame.
+ */
+#define BATCH_CYCS 29781u
 
-bool stopped = false;
+// set from a signal handler, so it can't live anywhere but here
+static volatile sig_atomic_t stopped = false;
 
-void alarm_handler(int signal) {
-  printf("%llu instructions executed in %llu clock cycles\n", instrs_execed,
-         global_clock);
-  stopped = true;
-}
+void alarm_handler(int signal) { stopped = true; }
 
 typedef struct cpu_state {
   uaddr_t PC;
@@ -72,13 +69,10 @@ void preset_cpu_state(ucpu_t *cpu, cpu_state_t state) {
 }
 
 int main(int argc, char **argv) {
-  int nesfd = open("eval/execs/official.nes", O_RDWR);
-  byte_t *executable = mmap(NULL, NESTEST_SZ + NES_HEADER_SZ,
-                            PROT_READ | PROT_WRITE, MAP_PRIVATE, nesfd, 0) +
-                       NES_HEADER_SZ;
-  close(nesfd);
-  if (executable == (void *)-1) {
-    perror(strerror(errno));
+  cartridge_t cart;
+  cart_err_t err = mount(&cart, NESTEST_PATH, NULL);
+  if (err != CART_OK) {
+    fprintf(stderr, "%s: %s\n", NESTEST_PATH, describe_cart_err(err));
     exit(1);
   }
 
@@ -89,9 +83,15 @@ int main(int argc, char **argv) {
   init_cpu(&cpu);
 
   bus_t bus = new_bus();
-  bus.cartridge = executable;
+  mapper_t mapper;
+  if (connect_mapper(&mapper, &cart, &bus) != 0) {
+    fprintf(stderr, "%s: mapper %u is unsupported\n", NESTEST_PATH,
+            cart.mapper);
+    exit(1);
+  }
 
   link_device(&cpu.buslink, &bus);  // this is fine I think?
+  bus.cpu = &cpu;
 
   cpu_state_t stat = {0};
   stat.PC = exe_start;
@@ -104,13 +104,16 @@ int main(int argc, char **argv) {
   signal(SIGALRM, &alarm_handler);
 
   alarm(10);  // sample for 10 seconds
-  while (!stopped) {
-    int res = step(&cpu);
-    if (cpu.cycs_left == 0) {
-      instrs_execed++;
-    }
-    global_clock++;
+  while (!stopped && !cpu_jammed(&cpu)) {
+    run_cycles(&cpu, BATCH_CYCS);
+  }
+  if (cpu_jammed(&cpu)) {
+    fprintf(stderr, "CPU jammed on opcode %x at PC %x\n", cpu.fault_op,
+            cpu.fault_pc);
+    exit(3);
   }
+  printf("%" PRIu64 " instructions executed in %" PRIu64 " clock cycles\n",
+         cpu.instrs, cpu.clock);
   dump_cpu(stdout, &cpu);
   exit(0);
 }
@@ -0,0 +1,65 @@
+/**
+ * @file
+ * @brief Runs a ROM headlessly and streams its frames to stdout, e.g.
+ *
+ *   bin/framedump game.nes 3600 y4m 1 | ffmpeg -i - game.mp4
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "graphics/frame_buffer.h"
+#include "graphics/framedump.h"
+#include "nes/unes.h"
+
+static unes_t nes;
+static frame_buffer_t screen;
+static frame_dump_t dump;
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s ROM FRAMES [rgba|y4m|png] [SKIP]\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 5) {
+    usage(argv[0]);
+  }
+  const char *rom = argv[1];
+  unsigned long frames = strtoul(argv[2], NULL, 10);
+  dump_fmt_t fmt = DUMP_RGBA;
+  if (argc > 3 && parse_dump_fmt(argv[3], &fmt) != 0) {
+    usage(argv[0]);
+  }
+  unsigned skip = argc > 4 ? (unsigned)strtoul(argv[4], NULL, 10) : 0;
+
+  if (isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "%s: refusing to write frames to a terminal\n", argv[0]);
+    exit(2);
+  }
+
+  cart_err_t err = power_on(&nes, rom, NULL);
+  if (err != CART_OK) {
+    fprintf(stderr, "%s: %s\n", rom, describe_cart_err(err));
+    exit(1);
+  }
+  init_frame_buffer(&screen);
+  nes.ppu.screen = &screen;
+  init_frame_dump(&dump, STDOUT_FILENO, fmt, skip);
+
+  for (unsigned long f = 0; f < frames; f++) {
+    run_frame(&nes);
+    if (dump_frame(&dump, latest_frame(&screen, NULL)) != 0) {
+      fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+      power_off(&nes);
+      exit(1);
+    }
+  }
+
+  power_off(&nes);
+  exit(0);
+}
@@ -0,0 +1,549 @@
+/**
+ * @file
+ * @brief Runs Tom Harte's nes6502 tests in-process, e.g.
+ *
+ *   eval/py/harteconvert.py && bin/harte eval/execs/tomharte.bin
+ *
+ * The suite is converted to binary once (see eval/py/harteconvert.py) and
+ * mapped in whole; every case then resets one CPU and a flat 64 KB bus in
+ * place, so the run costs a few hundred nanoseconds per case rather than
+ * two process launches. Cases are spread over all cores.
+ *
+ * Besides the final registers and RAM, every case's bus activity is
+ * checked against the bus trace, so this must be built with
+ * UNES_BUS_TRACE (`make harte` does). By default the CPU runs on its fast
+ * core, which runs an instruction's logic all at once rather than cycle by
+ * cycle, so its reads must be ones the test expects (the fast core leaves
+ * out dummy reads), and its writes must match the test's in order (it
+ * leaves out the dummy write of read-modify-write instructions). -c runs
+ * the cycle-stepped core instead, which must match the exact
+ * cycle-by-cycle trace.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu/ucpu.h"
+#include "memory/bus.h"
+#include "memory/bustrace.h"
+#include "memory/umem.h"
+
+#ifndef UNES_BUS_TRACE
+#error "the Tom Harte runner needs the bus trace; build with -DUNES_BUS_TRACE"
+#endif
+
+#define HARTE_MAGIC "uNEShrte"
+#define HARTE_MAGIC_SZ 8
+#define HARTE_VERSION 1u
+#define HARTE_HEADER_SZ (HARTE_MAGIC_SZ + 8)
+
+/*
+ * Per-case limits; keep in sync with harteconvert.py
+ */
+#define MAX_RAM 16
+#define MAX_CYCLES 16
+
+/*
+ * Most bus accesses one instruction can make before the case is failed
+ */
+#define MAX_ACCESSES 64
+
+/*
+ * Cases a thread claims at a time
+ */
+#define CHUNK_CASES 1024
+
+/*
+ * Failing cases printed in full per opcode
+ */
+#define SHOWN_FAILURES 1
+
+typedef enum { CASE_PASS, CASE_FAIL, CASE_JAM } verdict_t;
+
+typedef struct regs {
+  uaddr_t PC;
+  uregr_t S;
+  uregr_t A;
+  uregr_t X;
+  uregr_t Y;
+  ustat_t status;
+} regs_t;
+
+typedef struct harte_case {
+  byte_t opcode;
+  byte_t n_ram;
+  byte_t n_final_ram;
+  byte_t n_cycles;
+  regs_t initial;
+  regs_t final;
+  bus_access_t ram[MAX_RAM];  // flags are unused in these
+  bus_access_t final_ram[MAX_RAM];
+  bus_access_t cycles[MAX_CYCLES];
+} harte_case_t;
+
+/*
+ * A flat 64 KB bus, traced
+ */
+typedef struct harte_bus {
+  bus_t bus;
+  byte_t ram[UNES_MEM_CAP];
+  bus_trace_t trace;
+  bus_access_t log[MAX_ACCESSES];  // the trace of the last case run
+  size_t n_log;
+  bool wrapped;  // the case made more accesses than the trace holds
+} harte_bus_t;
+
+typedef struct suite {
+  const byte_t *data;  // the whole file, mapped
+  size_t data_sz;
+  size_t count;
+  const byte_t **cases;  // where each case starts
+  byte_t *verdicts;      // one verdict_t per case
+  int only;              // the one opcode to run, or -1 for all
+  bool cycle;            // run on the cycle-stepped core, and check exactly
+  atomic_size_t next;  // first case not yet claimed by a thread
+} suite_t;
+
+/* THE BUS */
+
+static void init_harte_bus(harte_bus_t *hb) {
+  memset(hb, 0, sizeof(*hb));
+  map_memory(&hb->bus, 0, UNES_MEM_CAP, hb->ram, UNES_MEM_CAP, true);
+  if (init_bus_trace(&hb->trace, MAX_ACCESSES) != 0) {
+    perror("init_bus_trace");
+    exit(1);
+  }
+  hb->bus.trace = &hb->trace;
+}
+
+static void free_harte_bus(harte_bus_t *hb) {
+  free_bus_trace(&hb->trace);
+  free(hb);
+}
+
+static bool is_write(bus_access_t access) {
+  return access.flags & ACCESS_WRITE;
+}
+
+/* LOADING */
+
+static uint16_t get16(const byte_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t get32(const byte_t *p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static const byte_t *get_regs(const byte_t *p, regs_t *regs) {
+  *regs = (regs_t){get16(p), p[2], p[3], p[4], p[5], p[6]};
+  return p + 7;
+}
+
+/**
+ * @brief The size of the case starting at `p`, judging by its header.
+ */
+static size_t case_size(const byte_t *p) {
+  return 4 + 2 * 7 + 3 * (p[1] + p[2]) + 4 * p[3];
+}
+
+/**
+ * @brief Unpacks the case starting at `p`.
+ */
+static void decode_case(const byte_t *p, harte_case_t *c) {
+  c->opcode = p[0];
+  c->n_ram = p[1];
+  c->n_final_ram = p[2];
+  c->n_cycles = p[3];
+  p = get_regs(p + 4, &c->initial);
+  p = get_regs(p, &c->final);
+  for (size_t i = 0; i < c->n_ram; i++, p += 3) {
+    c->ram[i] = (bus_access_t){get16(p), p[2], 0};
+  }
+  for (size_t i = 0; i < c->n_final_ram; i++, p += 3) {
+    c->final_ram[i] = (bus_access_t){get16(p), p[2], 0};
+  }
+  for (size_t i = 0; i < c->n_cycles; i++, p += 4) {
+    c->cycles[i] = (bus_access_t){get16(p), p[2], p[3] ? ACCESS_WRITE : 0};
+  }
+}
+
+/**
+ * @brief Maps in and indexes the suite at `path`.
+ *
+ * @returns 0 on success, or -1 (having said why) if the file can't be read
+ * or isn't a suite.
+ */
+static int load_suite(suite_t *suite, const char *path) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    return -1;
+  }
+  suite->data_sz = st.st_size;
+  if (suite->data_sz < HARTE_HEADER_SZ) {
+    fprintf(stderr, "%s: not a test suite\n", path);
+    close(fd);
+    return -1;
+  }
+  suite->data = mmap(NULL, suite->data_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (suite->data == MAP_FAILED) {
+    perror(path);
+    return -1;
+  }
+
+  const byte_t *p = suite->data;
+  if (memcmp(p, HARTE_MAGIC, HARTE_MAGIC_SZ) != 0 ||
+      get32(p + HARTE_MAGIC_SZ) != HARTE_VERSION) {
+    fprintf(stderr, "%s: not a version %u test suite\n", path, HARTE_VERSION);
+    return -1;
+  }
+  suite->count = get32(p + HARTE_MAGIC_SZ + 4);
+  suite->cases = malloc(suite->count * sizeof(*suite->cases));
+  suite->verdicts = calloc(suite->count, 1);
+  if (!suite->cases || !suite->verdicts) {
+    perror("malloc");
+    return -1;
+  }
+
+  const byte_t *end = suite->data + suite->data_sz;
+  p += HARTE_HEADER_SZ;
+  for (size_t i = 0; i < suite->count; i++) {
+    if (end - p < 4 || p[1] > MAX_RAM || p[2] > MAX_RAM ||
+        p[3] > MAX_CYCLES || (size_t)(end - p) < case_size(p)) {
+      fprintf(stderr, "%s: case %zu is truncated or corrupt\n", path, i);
+      return -1;
+    }
+    suite->cases[i] = p;
+    p += case_size(p);
+  }
+  return 0;
+}
+
+/* RUNNING */
+
+static void dump_regs(FILE *out, const char *what, regs_t r) {
+  fprintf(out,
+          "%s PC: %04" PRIx16 " A: %02" PRIx8 " X: %02" PRIx8 " Y: %02" PRIx8
+          " S: %02" PRIx8 " P: %02" PRIx8 "\n",
+          what, r.PC, r.A, r.X, r.Y, r.S, r.status);
+}
+
+static void dump_accesses(FILE *out, const char *what,
+                          const bus_access_t *log, size_t n) {
+  fprintf(out, "%s:", what);
+  for (size_t i = 0; i < n; i++) {
+    fprintf(out, " %c%04" PRIx16 "=%02" PRIx8, is_write(log[i]) ? 'W' : 'R',
+            log[i].addr, log[i].val);
+  }
+  fprintf(out, "\n");
+}
+
+static bool same_regs(regs_t a, regs_t b) {
+  return a.PC == b.PC && a.S == b.S && a.A == b.A && a.X == b.X &&
+         a.Y == b.Y && a.status == b.status;
+}
+
+/**
+ * @brief Finds the next write at or after `*i` that is not immediately
+ * overwritten, i.e. that isn't the dummy write of a read-modify-write.
+ *
+ * @returns the write, or NULL if there are none left.
+ */
+static const bus_access_t *next_write(const bus_access_t *log, size_t n,
+                                      size_t *i) {
+  for (; *i < n; (*i)++) {
+    if (!is_write(log[*i])) {
+      continue;
+    }
+    size_t j = *i + 1;
+    while (j < n && !is_write(log[j])) j++;
+    if (j == n || log[j].addr != log[*i].addr) {
+      return &log[(*i)++];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Checks the CPU's bus activity against the case's.
+ */
+static bool check_bus(const harte_case_t *c, const harte_bus_t *hb,
+                      bool exact) {
+  if (hb->wrapped) {
+    return false;
+  }
+  if (exact) {
+    if (hb->n_log != c->n_cycles) {
+      return false;
+    }
+    for (size_t i = 0; i < hb->n_log; i++) {
+      bus_access_t got = hb->log[i], want = c->cycles[i];
+      if (got.addr != want.addr || got.val != want.val ||
+          is_write(got) != is_write(want)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // every read must be one the real thing makes...
+  for (size_t i = 0; i < hb->n_log; i++) {
+    if (is_write(hb->log[i])) {
+      continue;
+    }
+    bool expected = false;
+    for (size_t j = 0; j < c->n_cycles && !expected; j++) {
+      expected =
+          !is_write(c->cycles[j]) && c->cycles[j].addr == hb->log[i].addr;
+    }
+    if (!expected) {
+      return false;
+    }
+  }
+
+  // ...and the writes must be the same ones, in the same order
+  size_t i = 0, j = 0;
+  for (;;) {
+    const bus_access_t *got = next_write(hb->log, hb->n_log, &i);
+    const bus_access_t *want = next_write(c->cycles, c->n_cycles, &j);
+    if (!got || !want) {
+      return got == want;
+    }
+    if (got->addr != want->addr || got->val != want->val) {
+      return false;
+    }
+  }
+}
+
+/**
+ * @brief Runs one case on `cpu` and `hb`, leaving the bus zeroed again
+ * afterwards. If `diag` isn't NULL, what went wrong is written to it.
+ */
+static verdict_t run_case(const harte_case_t *c, ucpu_t *cpu,
+                          harte_bus_t *hb, bool cycle, FILE *diag) {
+  for (size_t i = 0; i < c->n_ram; i++) {
+    hb->ram[c->ram[i].addr] = c->ram[i].val;
+  }
+  bus_trace_clear(&hb->trace);
+
+  init_cpu(cpu);
+  cpu->core = cycle ? CPU_CYCLE : CPU_FAST;
+  link_device(&cpu->buslink, &hb->bus);
+  cpu->PC = c->initial.PC;
+  cpu->S = c->initial.S;
+  cpu->A = c->initial.A;
+  cpu->X = c->initial.X;
+  cpu->Y = c->initial.Y;
+  cpu->status = c->initial.status;
+
+  int res;
+  size_t cycs = 0;
+  do {
+    res = step(cpu);
+    cycs++;
+  } while (res == STEP_BUSY && cycs < MAX_CYCLES);
+  hb->n_log = bus_trace_last(&hb->trace, hb->log, MAX_ACCESSES);
+  hb->wrapped = bus_trace_wrapped(&hb->trace);
+
+  verdict_t verdict = CASE_JAM;
+  if (res != STEP_JAMMED) {
+    regs_t got = {cpu->PC, cpu->S, cpu->A, cpu->X, cpu->Y, cpu->status};
+    bool regs_ok = same_regs(got, c->final);
+    bool cycs_ok = cycs == c->n_cycles;
+    bool bus_ok = check_bus(c, hb, cycle);
+    bool ram_ok = true;
+    for (size_t i = 0; i < c->n_final_ram; i++) {
+      ram_ok &= hb->ram[c->final_ram[i].addr] == c->final_ram[i].val;
+    }
+    verdict = regs_ok && cycs_ok && bus_ok && ram_ok ? CASE_PASS : CASE_FAIL;
+
+    if (diag && verdict == CASE_FAIL) {
+      dump_regs(diag, "initial ", c->initial);
+      dump_regs(diag, "expected", c->final);
+      dump_regs(diag, "actual  ", got);
+      if (!cycs_ok) {
+        fprintf(diag, "took %zu cycles, not %u\n", cycs, c->n_cycles);
+      }
+      for (size_t i = 0; i < c->n_final_ram; i++) {
+        bus_access_t want = c->final_ram[i];
+        if (hb->ram[want.addr] != want.val) {
+          fprintf(diag, "%04" PRIx16 " is %02" PRIx8 ", not %02" PRIx8 "\n",
+                  want.addr, hb->ram[want.addr], want.val);
+        }
+      }
+      if (!bus_ok) {
+        dump_accesses(diag, "expected bus", c->cycles, c->n_cycles);
+        dump_accesses(diag, "actual bus  ", hb->log, hb->n_log);
+      }
+    }
+  }
+
+  // only the case's own RAM and whatever was written can be non-zero
+  for (size_t i = 0; i < c->n_ram; i++) {
+    hb->ram[c->ram[i].addr] = 0;
+  }
+  for (size_t i = 0; i < hb->n_log; i++) {
+    hb->ram[hb->log[i].addr] = 0;
+  }
+  if (hb->wrapped) {
+    memset(hb->ram, 0, sizeof(hb->ram));
+  }
+  return verdict;
+}
+
+/**
+ * @brief A worker thread: claims chunks of the suite until it's all been
+ * run.
+ */
+static void *run_chunks(void *arg) {
+  suite_t *suite = arg;
+  harte_bus_t *hb = malloc(sizeof(*hb));
+  if (!hb) {
+    perror("malloc");
+    exit(1);
+  }
+  init_harte_bus(hb);
+  ucpu_t cpu;
+
+  for (;;) {
+    size_t start = atomic_fetch_add(&suite->next, CHUNK_CASES);
+    if (start >= suite->count) {
+      break;
+    }
+    size_t end = start + CHUNK_CASES;
+    end = end < suite->count ? end : suite->count;
+    for (size_t i = start; i < end; i++) {
+      harte_case_t c;
+      decode_case(suite->cases[i], &c);
+      if (suite->only < 0 || c.opcode == suite->only) {
+        suite->verdicts[i] = run_case(&c, &cpu, hb, suite->cycle, NULL);
+      }
+    }
+  }
+  free_harte_bus(hb);
+  return NULL;
+}
+
+/* REPORTING */
+
+/**
+ * @brief Prints a line for every opcode with failing or jammed cases (and
+ * the details of its first failures), then a summary.
+ *
+ * @returns the number of cases that failed.
+ */
+static size_t report(suite_t *suite) {
+  size_t tried[256] = {0}, failed[256] = {0}, jammed[256] = {0};
+  harte_bus_t *hb = malloc(sizeof(*hb));
+  if (!hb) {
+    perror("malloc");
+    exit(1);
+  }
+  init_harte_bus(hb);
+  ucpu_t cpu;
+
+  for (size_t i = 0; i < suite->count; i++) {
+    byte_t op = suite->cases[i][0];
+    if (suite->only >= 0 && op != suite->only) {
+      continue;
+    }
+    tried[op]++;
+    jammed[op] += suite->verdicts[i] == CASE_JAM;
+    if (suite->verdicts[i] == CASE_FAIL && failed[op]++ < SHOWN_FAILURES) {
+      // run it again, this time saying what went wrong
+      harte_case_t c;
+      decode_case(suite->cases[i], &c);
+      printf("\n%02x: case %zu failed\n", op, i);
+      run_case(&c, &cpu, hb, suite->cycle, stdout);
+    }
+  }
+  free_harte_bus(hb);
+
+  size_t total = 0, total_failed = 0;
+  printf("\n");
+  for (int op = 0; op < 256; op++) {
+    total += tried[op];
+    total_failed += failed[op];
+    if (failed[op]) {
+      printf("%02x: %zu of %zu failed\n", op, failed[op], tried[op]);
+    } else if (jammed[op]) {
+      printf("%02x: jams, skipped\n", op);
+    }
+  }
+  if (total_failed == 0) {
+    printf("ALL TESTS PASSED!!!\n");
+  }
+  printf("TESTS ATTEMPTED: %zu TESTS FAILED: %zu\n", total, total_failed);
+  return total_failed;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-c] [-j THREADS] [-o OPCODE] SUITE\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static suite_t suite;
+  suite.only = -1;
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "cj:o:")) != -1) {
+    switch (opt) {
+      case 'c':
+        suite.cycle = true;
+        break;
+      case 'j':
+        nthreads = strtol(optarg, NULL, 10);
+        break;
+      case 'o':
+        suite.only = (int)strtol(optarg, NULL, 16) & 0xFF;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+  }
+  nthreads = nthreads > 0 ? nthreads : 1;
+
+  if (load_suite(&suite, argv[optind]) != 0) {
+    exit(1);
+  }
+
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  pthread_t *threads = malloc(nthreads * sizeof(*threads));
+  if (!threads) {
+    perror("malloc");
+    exit(1);
+  }
+  for (long t = 0; t < nthreads; t++) {
+    if (pthread_create(&threads[t], NULL, run_chunks, &suite) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  for (long t = 0; t < nthreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  size_t failed = report(&suite);
+  printf("Ran in %.2f s on %ld threads\n",
+         (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9,
+         nthreads);
+  exit(failed ? 1 : 0);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file
+ * @brief Records and plays back input movies headlessly, e.g.
+ *
+ *   bin/movie record game.nes inputs.bin game.mov 60
+ *   bin/movie play game.nes game.mov verify
+ *
+ * Inputs to record are raw, CONTROLLER_PORTS bytes a frame (see
+ * input/controller.h); a movie is recorded of the console running them
+ * from power-on, with a keyframe every KEYS frames. Keyframes carry frame
+ * hashes as well as RAM hashes, and playback only draws frames when it
+ * has them to verify.
+ *
+ * @author Benedict Song <benedict04song@gmail.com>
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "graphics/frame_buffer.h"
+#include "nes/movie.h"
+#include "nes/unes.h"
+
+/*
+ * Keyframe interval when none is given: one a second
+ */
+#define DEFAULT_KEY_INTERVAL 60u
+
+static unes_t nes;
+static frame_buffer_t screen;
+static movie_t movie;
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s record ROM INPUTS MOVIE [KEYS]\n"
+          "       %s play ROM MOVIE [verify]\n",
+          prog, prog);
+  exit(2);
+}
+
+static void fail(const char *what, const char *why) {
+  fprintf(stderr, "%s: %s\n", what, why);
+  exit(1);
+}
+
+/**
+ * @brief Maps the file at `path` read-only into memory.
+ */
+static const byte_t *map_file(const char *path, size_t *len) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fail(path, strerror(errno));
+  }
+  *len = st.st_size;
+  if (*len == 0) {
+    close(fd);
+    return NULL;
+  }
+  const byte_t *data = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fail(path, strerror(errno));
+  }
+  return data;
+}
+
+static double seconds_since(const struct timespec *t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void record(const char *inputs, const char *out, unsigned keys) {
+  size_t len;
+  const byte_t *script = map_file(inputs, &len);
+  size_t frames = len / CONTROLLER_PORTS;
+
+  // the header, then a run and a keyframe per frame at worst
+  size_t cap = 64 * (frames + 1);
+  byte_t *buf = alloc_ram(cap);
+  if (buf == MAP_FAILED) {
+    fail(out, strerror(errno));
+  }
+  nes.ppu.screen = &screen;
+  movie_err_t err = movie_record(&movie, &nes, buf, cap, keys, false);
+
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  controller_feed(&nes.controllers, script, frames);
+  for (size_t f = 0; f < frames && err == MOVIE_OK; f++) {
+    run_frame(&nes);
+    err = movie_record_frame(&movie, &nes);
+  }
+  if (err == MOVIE_OK) {
+    err = movie_finish(&movie);
+  }
+  if (err != MOVIE_OK) {
+    fail(out, describe_movie_err(err));
+  }
+  double secs = seconds_since(&t0);
+
+  FILE *f = fopen(out, "wb");
+  if (!f || fwrite(buf, 1, movie.len, f) != movie.len || fclose(f) != 0) {
+    fail(out, strerror(errno));
+  }
+  printf("%zu frames in %zu bytes, %.3fs (%.0f fps)\n", frames, movie.len,
+         secs, frames / secs);
+}
+
+static void play(const char *in, bool verify) {
+  size_t len;
+  const byte_t *buf = map_file(in, &len);
+  movie_err_t err = movie_open(&movie, buf, len);
+  if (err == MOVIE_OK) {
+    err = movie_start(&movie, &nes);
+  }
+  if (err != MOVIE_OK) {
+    fail(in, describe_movie_err(err));
+  }
+  if (verify) {
+    nes.ppu.screen = &screen;
+  }
+
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  err = movie_play(&movie, &nes, verify);
+  double secs = seconds_since(&t0);
+  if (err == MOVIE_ERR_DESYNC) {
+    fprintf(stderr, "%s: out of sync by frame %llu\n", in,
+            (unsigned long long)movie.bad_frame);
+    exit(1);
+  }
+  if (err != MOVIE_OK) {
+    fail(in, describe_movie_err(err));
+  }
+  printf("%llu frames, %.3fs (%.0f fps)%s\n",
+         (unsigned long long)movie.frames, secs, movie.frames / secs,
+         verify ? ", verified" : "");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    usage(argv[0]);
+  }
+  bool recording = strcmp(argv[1], "record") == 0;
+  if (recording ? argc < 5 || argc > 6
+                : strcmp(argv[1], "play") != 0 || argc > 5 ||
+                      (argc == 5 && strcmp(argv[4], "verify") != 0)) {
+    usage(argv[0]);
+  }
+
+  const char *rom = argv[2];
+  cart_err_t err = power_on(&nes, rom, NULL);
+  if (err != CART_OK) {
+    fail(rom, describe_cart_err(err));
+  }
+  init_frame_buffer(&screen);
+
+  if (recording) {
+    unsigned keys =
+        argc > 5 ? strtoul(argv[5], NULL, 10) : DEFAULT_KEY_INTERVAL;
+    record(argv[3], argv[4], keys);
+  } else {
+    play(argv[3], argc == 5);
+  }
+
+  power_off(&nes);
+  exit(0);
+}
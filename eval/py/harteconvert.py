@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Packs Tom Harte's nes6502 tests into the single binary file the native
+runner (eval/drivers/harte_driver.c) loads, so the JSON is only ever parsed
+once.
+
+Usage: harteconvert.py [JSON_DIR] [OUTPUT]
+
+Every XX.json in JSON_DIR (by default eval/execs/tomharte) is included. All
+values are little-endian:
+
+    header  "uNEShrte", u32 version, u32 case count
+    case    u8 opcode, u8 ram entries, u8 final ram entries, u8 cycles,
+            initial registers, final registers,
+            ram entries, final ram entries, cycles
+    regs    u16 pc, u8 s, a, x, y, p
+    ram     u16 address, u8 value
+    cycle   u16 address, u8 value, u8 1 if a write else 0
+"""
+from pathlib import Path
+
+import json
+import struct
+import sys
+
+MAGIC = b"uNEShrte"
+VERSION = 1
+
+# keep in sync with harte_driver.c
+MAX_RAM = 16
+MAX_CYCLES = 16
+
+def pack_regs(state: dict) -> bytes:
+    return struct.pack("<HBBBBB", state["pc"], state["s"], state["a"],
+                       state["x"], state["y"], state["p"])
+
+def pack_case(opcode: int, case: dict) -> bytes:
+    initial, final, cycles = case["initial"], case["final"], case["cycles"]
+    if len(initial["ram"]) > MAX_RAM or len(final["ram"]) > MAX_RAM:
+        raise ValueError(f"{case['name']}: too many RAM entries")
+    if len(cycles) > MAX_CYCLES:
+        raise ValueError(f"{case['name']}: too many cycles")
+
+    out = struct.pack("<BBBB", opcode, len(initial["ram"]),
+                      len(final["ram"]), len(cycles))
+    out += pack_regs(initial) + pack_regs(final)
+    for addr, val in initial["ram"] + final["ram"]:
+        out += struct.pack("<HB", addr, val)
+    for addr, val, kind in cycles:
+        out += struct.pack("<HBB", addr, val, kind == "write")
+    return out
+
+if __name__ == "__main__":
+    json_dir = Path(sys.argv[1] if len(sys.argv) > 1
+                    else "eval/execs/tomharte")
+    output = Path(sys.argv[2] if len(sys.argv) > 2
+                  else "eval/execs/tomharte.bin")
+
+    count = 0
+    body = bytearray()
+    for opcode in range(256):
+        path = json_dir / f"{opcode:02x}.json"
+        if not path.exists():
+            continue
+        with open(path, "r") as jfile:
+            for case in json.load(jfile):
+                body += pack_case(opcode, case)
+                count += 1
+
+    with open(output, "wb") as bin_file:
+        bin_file.write(MAGIC + struct.pack("<II", VERSION, count))
+        bin_file.write(body)
+    print(f"{count} cases written to {output}")